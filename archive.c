@@ -0,0 +1,373 @@
+#define _GNU_SOURCE
+#include "utils.h"
+#include "config.h"
+#include "archive.h"
+#include <glib/gstdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <iniparser.h>
+
+/* linux/ioprio.h 不一定随 libc 头文件安装 */
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_WHO_PROCESS 1
+
+#define DEFAULT_CHUNK (4 * 1024 * 1024)
+
+struct _Archiver {
+    gchar *archive_path;
+    guint64 rate;                       /* 字节/秒，0 表示不限速 */
+    gsize chunk;
+    gboolean verify_checksum;
+    gchar *journal_path;
+
+    GThread *thread;
+    GMutex lock;
+    GCond cond;
+    GQueue pending;                     /* 待迁移的文件路径，队首为正在迁移的文件 */
+    gboolean stopping;
+};
+
+/* 限速状态：按累计字节数计算应当经过的时间 */
+typedef struct {
+    guint64 rate;
+    guint64 bytes;
+    gint64 start;
+} Throttle;
+
+// 辅助函数：把待迁移列表写入日志文件 (调用者持有锁)
+static void save_journal(Archiver *ar) {
+    g_autoptr(GString) contents = g_string_new(NULL);
+    for (GList *l = ar->pending.head; l; l = l->next) {
+        g_string_append_printf(contents, "%s\n", (const char *)l->data);
+    }
+
+    g_autoptr(GError) error = NULL;
+    if (!g_file_set_contents(ar->journal_path, contents->str, contents->len, &error)) {
+        g_printerr("Warning: Could not write archive journal %s: %s\n", ar->journal_path, error->message);
+    }
+}
+
+static void load_journal(Archiver *ar) {
+    g_autofree gchar *contents = NULL;
+    if (!g_file_get_contents(ar->journal_path, &contents, NULL, NULL)) {
+        return;
+    }
+
+    g_auto(GStrv) lines = g_strsplit(contents, "\n", -1);
+    for (int i = 0; lines[i] != NULL; i++) {
+        if (lines[i][0] != '\0' && g_file_test(lines[i], G_FILE_TEST_IS_REGULAR)) {
+            g_queue_push_tail(&ar->pending, g_strdup(lines[i]));
+        }
+    }
+    if (ar->pending.length > 0) {
+        g_print("Archive: resuming %u file(s) from the previous run.\n", ar->pending.length);
+    }
+}
+
+// 辅助函数：限速，累计字节数超过速率允许的量时睡眠
+static gboolean throttle(Archiver *ar, Throttle *t, gsize bytes) {
+    t->bytes += bytes;
+    if (t->rate > 0) {
+        gint64 due = t->start + (gint64)(t->bytes * G_USEC_PER_SEC / t->rate);
+        gint64 now = g_get_monotonic_time();
+        if (due > now) {
+            g_usleep(due - now);
+        }
+    }
+    return !g_atomic_int_get(&ar->stopping);
+}
+
+// 辅助函数：从 offset 开始复制，优先 copy_file_range，跨文件系统不支持时退回 sendfile，最后退回 read/write
+static gboolean copy_range(Archiver *ar, Throttle *t, int in_fd, int out_fd, off_t offset, off_t size) {
+    enum { USE_COPY_FILE_RANGE, USE_SENDFILE, USE_READ_WRITE } method = USE_COPY_FILE_RANGE;
+    g_autofree guint8 *buffer = NULL;
+
+    while (offset < size) {
+        size_t len = (size_t)MIN((off_t)ar->chunk, size - offset);
+        ssize_t n = -1;
+
+        if (method == USE_COPY_FILE_RANGE) {
+            off_t in_off = offset, out_off = offset;
+            n = copy_file_range(in_fd, &in_off, out_fd, &out_off, len, 0);
+            if (n < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) {
+                method = USE_SENDFILE;
+                continue;
+            }
+        } else if (method == USE_SENDFILE) {
+            off_t in_off = offset;
+            if (lseek(out_fd, offset, SEEK_SET) < 0) return FALSE;
+            n = sendfile(out_fd, in_fd, &in_off, len);
+            if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                method = USE_READ_WRITE;
+                continue;
+            }
+        } else {
+            if (!buffer) buffer = g_malloc(ar->chunk);
+            n = pread(in_fd, buffer, len, offset);
+            if (n > 0) {
+                ssize_t written = pwrite(out_fd, buffer, n, offset);
+                if (written != n) n = -1;
+            }
+        }
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return FALSE;
+        }
+        if (n == 0) {
+            errno = EIO;                // 源文件被截断
+            return FALSE;
+        }
+        offset += n;
+        if (!throttle(ar, t, n)) {
+            errno = ECANCELED;
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// 辅助函数：计算文件的 SHA1，读取同样受限速约束
+static gchar *file_checksum(Archiver *ar, Throttle *t, const char *path, gboolean drop_cache) {
+    int fd = g_open(path, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) return NULL;
+
+    // 丢弃页缓存，确保校验的是实际落盘的数据
+    if (drop_cache) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+
+    g_autoptr(GChecksum) checksum = g_checksum_new(G_CHECKSUM_SHA1);
+    g_autofree guint8 *buffer = g_malloc(ar->chunk);
+    ssize_t n;
+    while ((n = read(fd, buffer, ar->chunk)) > 0) {
+        g_checksum_update(checksum, buffer, n);
+        if (!throttle(ar, t, n)) {
+            close(fd);
+            return NULL;
+        }
+    }
+    close(fd);
+    return n == 0 ? g_strdup(g_checksum_get_string(checksum)) : NULL;
+}
+
+// 辅助函数：选择目标路径。已存在的同名文件只有 SHA1 一致才视为上次已经复制完成 (改名后还没来得及删除源文件)，
+// 否则依次尝试 <名字>-1.<扩展名>、<名字>-2.<扩展名>...，同一个源文件每次都会选中同一个名字，.part 可以续传
+static gchar *pick_destination(Archiver *ar, Throttle *t, const char *src, const GStatBuf *src_st, gboolean *copied) {
+    g_autofree gchar *basename = g_path_get_basename(src);
+    const char *dot = strrchr(basename, '.');
+    const char *ext = dot && dot != basename ? dot : "";
+    g_autofree gchar *stem = g_strndup(basename, strlen(basename) - strlen(ext));
+    g_autofree gchar *src_sum = NULL;
+
+    *copied = FALSE;
+    for (guint i = 0; ; i++) {
+        g_autofree gchar *name = i == 0 ? g_strdup(basename) : g_strdup_printf("%s-%u%s", stem, i, ext);
+        g_autofree gchar *dest = g_build_filename(ar->archive_path, name, NULL);
+
+        GStatBuf dest_st;
+        if (g_stat(dest, &dest_st) != 0) {
+            if (i > 0) {
+                g_print("Archive: %s already exists with different contents, archiving as %s.\n", basename, name);
+            }
+            return g_steal_pointer(&dest);
+        }
+        if (dest_st.st_size != src_st->st_size) continue;
+
+        if (!src_sum) {
+            src_sum = file_checksum(ar, t, src, FALSE);
+            if (!src_sum) return NULL;
+        }
+        g_autofree gchar *dest_sum = file_checksum(ar, t, dest, TRUE);
+        if (g_atomic_int_get(&ar->stopping)) return NULL;
+        if (dest_sum && strcmp(src_sum, dest_sum) == 0) {
+            *copied = TRUE;
+            return g_steal_pointer(&dest);
+        }
+    }
+}
+
+// 迁移一个文件：复制到 <name>.part (可断点续传)，校验后改名，最后删除源文件
+static gboolean migrate_file(Archiver *ar, const char *src) {
+    g_autofree gchar *basename = g_path_get_basename(src);
+    Throttle t = { .rate = ar->rate, .bytes = 0, .start = g_get_monotonic_time() };
+
+    GStatBuf src_st, dest_st;
+    if (g_stat(src, &src_st) != 0) {
+        g_printerr("Archive: %s disappeared, skipping.\n", src);
+        return TRUE;
+    }
+
+    gboolean copied;
+    g_autofree gchar *dest = pick_destination(ar, &t, src, &src_st, &copied);
+    if (!dest) {
+        if (!g_atomic_int_get(&ar->stopping)) {
+            g_printerr("Archive: could not checksum %s: %s\n", src, g_strerror(errno));
+        }
+        return FALSE;
+    }
+    g_autofree gchar *part = g_strconcat(dest, ".part", NULL);
+    const char *target = copied ? dest : part;
+
+    if (!copied) {
+        int in_fd = g_open(src, O_RDONLY | O_CLOEXEC, 0);
+        int out_fd = g_open(part, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        gboolean ok = in_fd >= 0 && out_fd >= 0;
+
+        off_t offset = 0;
+        if (ok && fstat(out_fd, &dest_st) == 0 && dest_st.st_size <= src_st.st_size) {
+            offset = dest_st.st_size;
+            if (offset > 0) {
+                g_print("Archive: resuming %s at %.1f MB.\n", basename, offset / 1e6);
+            }
+        } else if (ok) {
+            ok = ftruncate(out_fd, 0) == 0;
+        }
+
+        ok = ok && copy_range(ar, &t, in_fd, out_fd, offset, src_st.st_size) && fdatasync(out_fd) == 0;
+        int err = errno;
+        if (in_fd >= 0) close(in_fd);
+        if (out_fd >= 0) close(out_fd);
+        if (!ok) {
+            if (err != ECANCELED) {
+                g_printerr("Archive: copying %s failed: %s\n", src, g_strerror(err));
+            }
+            return FALSE;
+        }
+    }
+
+    // --- 校验：大小一致，按配置再比较 SHA1 (已存在的目标文件在选择时已经比较过 SHA1) ---
+    gboolean verified = g_stat(target, &dest_st) == 0 && dest_st.st_size == src_st.st_size;
+    if (verified && !copied && ar->verify_checksum) {
+        g_autofree gchar *src_sum = file_checksum(ar, &t, src, FALSE);
+        g_autofree gchar *dest_sum = file_checksum(ar, &t, target, TRUE);
+        verified = src_sum && dest_sum && strcmp(src_sum, dest_sum) == 0;
+    }
+    if (!verified) {
+        if (!g_atomic_int_get(&ar->stopping)) {
+            // 下一轮从头重新复制
+            g_printerr("Archive: verification of %s failed, copying again.\n", basename);
+            g_unlink(target);
+        }
+        return FALSE;
+    }
+
+    if (!copied && g_rename(part, dest) != 0) {
+        g_printerr("Archive: could not rename %s: %s\n", part, g_strerror(errno));
+        return FALSE;
+    }
+    g_unlink(src);
+
+    gdouble elapsed = (g_get_monotonic_time() - t.start) / (gdouble)G_USEC_PER_SEC;
+    g_print("Archive: moved %s (%.1f MB, %.1f s).\n", basename, src_st.st_size / 1e6, elapsed);
+    return TRUE;
+}
+
+static gpointer archive_thread(gpointer user_data) {
+    Archiver *ar = (Archiver *)user_data;
+
+    // 空闲 I/O 优先级：只使用采集写入之外的空闲磁盘带宽
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) != 0) {
+        g_printerr("Warning: Could not set idle I/O priority for the archiver: %s\n", g_strerror(errno));
+    }
+
+    g_mutex_lock(&ar->lock);
+    while (!ar->stopping) {
+        const char *head = g_queue_peek_head(&ar->pending);
+        if (!head) {
+            g_cond_wait(&ar->cond, &ar->lock);
+            continue;
+        }
+
+        g_autofree gchar *path = g_strdup(head);
+        g_mutex_unlock(&ar->lock);
+        gboolean done = migrate_file(ar, path);
+        g_mutex_lock(&ar->lock);
+
+        if (done) {
+            g_free(g_queue_pop_head(&ar->pending));
+            save_journal(ar);
+        } else if (!ar->stopping) {
+            // 失败的文件移到队尾稍后重试，避免阻塞其他文件
+            g_queue_push_tail(&ar->pending, g_queue_pop_head(&ar->pending));
+            gint64 retry_at = g_get_monotonic_time() + 10 * G_TIME_SPAN_SECOND;
+            g_cond_wait_until(&ar->cond, &ar->lock, retry_at);
+        }
+    }
+    g_mutex_unlock(&ar->lock);
+    return NULL;
+}
+
+void archive_init(CustomData *data) {
+    dictionary *dict = data->config_dict;
+    const char *archive_path = iniparser_getstring(dict, "archive:path", "");
+    if (!archive_path || archive_path[0] == '\0') {
+        return;
+    }
+
+    if (g_mkdir_with_parents(archive_path, 0755) != 0) {
+        g_printerr("Failed to create archive directory %s: %s. Archiving disabled.\n", archive_path, g_strerror(errno));
+        return;
+    }
+
+    Archiver *ar = g_new0(Archiver, 1);
+    ar->archive_path = g_strdup(archive_path);
+    ar->rate = get_ini_size(dict, "archive:rate", 0);
+    ar->chunk = (gsize)MAX(get_ini_size(dict, "archive:chunk", DEFAULT_CHUNK), 64 * 1024);
+    ar->verify_checksum = g_strcmp0(iniparser_getstring(dict, "archive:verify", "checksum"), "size") != 0;
+    g_autofree gchar *cache_dir = g_build_filename(g_get_user_cache_dir(), "gst-capture", NULL);
+    g_mkdir_with_parents(cache_dir, 0755);
+    ar->journal_path = g_build_filename(cache_dir, "archive-journal", NULL);
+    g_mutex_init(&ar->lock);
+    g_cond_init(&ar->cond);
+    g_queue_init(&ar->pending);
+    load_journal(ar);
+
+    ar->thread = g_thread_new("archiver", archive_thread, ar);
+    data->archiver = ar;
+    g_print("Archiving finished recordings to %s (%s).\n", archive_path,
+            ar->rate > 0 ? "rate limited" : "unthrottled");
+}
+
+void archive_enqueue(CustomData *data, const char *path) {
+    Archiver *ar = data->archiver;
+    if (!ar || !path) return;
+
+    g_mutex_lock(&ar->lock);
+    if (!g_queue_find_custom(&ar->pending, path, (GCompareFunc)g_strcmp0)) {
+        g_queue_push_tail(&ar->pending, g_strdup(path));
+        save_journal(ar);
+        g_cond_signal(&ar->cond);
+#ifdef DEBUG
+        g_print("Archive: queued %s.\n", path);
+#endif
+    }
+    g_mutex_unlock(&ar->lock);
+}
+
+void archive_free(CustomData *data) {
+    Archiver *ar = g_steal_pointer(&data->archiver);
+    if (!ar) return;
+
+    g_mutex_lock(&ar->lock);
+    g_atomic_int_set(&ar->stopping, TRUE);
+    g_cond_signal(&ar->cond);
+    g_mutex_unlock(&ar->lock);
+    g_thread_join(ar->thread);
+
+    if (ar->pending.length > 0) {
+        g_print("Archive: %u file(s) left for the next run.\n", ar->pending.length);
+    }
+    g_queue_clear_full(&ar->pending, g_free);
+    g_mutex_clear(&ar->lock);
+    g_cond_clear(&ar->cond);
+    g_free(ar->archive_path);
+    g_free(ar->journal_path);
+    g_free(ar);
+}
@@ -0,0 +1,28 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include "config.h"
+
+/*
+ * Start the background mover when [archive] path is set. Files queued in the
+ * journal by a previous run are resumed, continuing partially copied files.
+ * data: Pointer to the CustomData structure.
+ */
+void archive_init(CustomData *data);
+
+/*
+ * Queue a finalized recording for migration to [archive] path. The file is copied
+ * with copy_file_range/sendfile at idle I/O priority and [archive] rate, verified,
+ * and only then removed from record_path. An existing file of the same name in
+ * the archive counts as already copied only if its SHA1 matches; otherwise the
+ * recording is archived under a unique name. Paths already queued are ignored.
+ * path: Finished recording file.
+ */
+void archive_enqueue(CustomData *data, const char *path);
+
+/*
+ * Stop the mover after the current chunk. Unfinished files stay in the journal.
+ */
+void archive_free(CustomData *data);
+
+#endif // ARCHIVE_H
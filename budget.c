@@ -0,0 +1,162 @@
+#include "utils.h"
+#include "config.h"
+#include "budget.h"
+#include "recorder.h"
+#include <gst/gst.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <iniparser.h>
+
+struct _RecordBudget {
+    gchar *record_path;
+    guint64 min_free;                   /* record_path 至少保留的空闲字节 */
+    guint64 max_rss;                    /* 进程常驻内存上限，0 表示不限 */
+    guint64 max_bytes;                  /* 单次录制写入的字节上限，0 表示不限 */
+    gboolean rotate;                    /* 达到 max_bytes 时切换到新文件而不是停止 */
+    guint timeout_id;
+
+    guint64 bytes;                      /* 当前录制已写入的字节数，由流线程无锁更新 */
+};
+
+// 探针回调：统计复用器输出的字节数
+static GstPadProbeReturn count_bytes_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    RecordBudget *budget = (RecordBudget *)user_data;
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (buffer) {
+        counter_add(&budget->bytes, gst_buffer_get_size(buffer));
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+// 辅助函数：读取 /proc/self/statm 中的常驻页数
+static guint64 process_rss(void) {
+    unsigned long size = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    if (fscanf(f, "%lu %lu", &size, &resident) != 2) resident = 0;
+    fclose(f);
+    return (guint64)resident * (guint64)sysconf(_SC_PAGESIZE);
+}
+
+static gchar *format_duration(guint64 seconds) {
+    if (seconds >= 3600) {
+        return g_strdup_printf("%" G_GUINT64_FORMAT "h %02" G_GUINT64_FORMAT "m", seconds / 3600, seconds / 60 % 60);
+    }
+    return g_strdup_printf("%" G_GUINT64_FORMAT "m %02" G_GUINT64_FORMAT "s", seconds / 60, seconds % 60);
+}
+
+// 辅助函数：结束当前录制，rotate 时在清理完成后自动开始新的录制
+static void enforce(CustomData *data, const char *reason, gboolean rotate) {
+    g_printerr("Recording budget: %s. %s recording.\n", reason, rotate ? "Rotating" : "Stopping");
+    data->restart_recording = rotate;
+    if (!stop_recording(data)) {
+        data->restart_recording = FALSE;
+    }
+    if (!rotate && data->record_icon) {
+        gtk_image_set_from_icon_name(GTK_IMAGE(data->record_icon), "media-record-symbolic", GTK_ICON_SIZE_SMALL_TOOLBAR);
+    }
+}
+
+static gboolean budget_tick(gpointer user_data) {
+    CustomData *data = (CustomData *)user_data;
+    RecordBudget *budget = data->budget;
+
+    struct statvfs vfs;
+    guint64 free_bytes = G_MAXUINT64;
+    if (statvfs(budget->record_path, &vfs) == 0) {
+        free_bytes = (guint64)vfs.f_bavail * vfs.f_frsize;
+    }
+    guint64 usable = free_bytes > budget->min_free ? free_bytes - budget->min_free : 0;
+    guint64 rss = budget->max_rss > 0 ? process_rss() : 0;
+
+    if (!data->is_recording || data->is_stopping_recording) {
+        if (data->header_bar && free_bytes != G_MAXUINT64) {
+            g_autofree gchar *subtitle = g_strdup_printf("%.1f GB free", free_bytes / 1e9);
+            gtk_header_bar_set_subtitle(GTK_HEADER_BAR(data->header_bar), subtitle);
+        }
+        return G_SOURCE_CONTINUE;
+    }
+
+    // --- 1. 超出预算时在复用器出错之前通过 stop_recording 正常结束 ---
+    guint64 bytes = counter_get(&budget->bytes);
+    if (free_bytes != G_MAXUINT64 && usable == 0) {
+        enforce(data, "record_path is almost full", FALSE);
+        return G_SOURCE_CONTINUE;
+    }
+    if (budget->max_rss > 0 && rss >= budget->max_rss) {
+        g_autofree gchar *reason = g_strdup_printf("process RSS %.0f MB exceeds the limit", rss / 1e6);
+        enforce(data, reason, FALSE);
+        return G_SOURCE_CONTINUE;
+    }
+    if (budget->max_bytes > 0 && bytes >= budget->max_bytes) {
+        enforce(data, "file size limit reached", budget->rotate);
+        return G_SOURCE_CONTINUE;
+    }
+
+    // --- 2. 按当前平均码率估算剩余录制时间 ---
+    if (data->header_bar) {
+        guint64 elapsed_us = (guint64)MAX(g_get_monotonic_time() - data->record_start_time, 1);
+        gdouble rate = bytes * (gdouble)G_USEC_PER_SEC / elapsed_us;
+        guint64 headroom = usable;
+        if (budget->max_bytes > 0 && !budget->rotate) {
+            headroom = MIN(headroom, budget->max_bytes - bytes);
+        }
+
+        g_autofree gchar *elapsed = format_duration(elapsed_us / G_USEC_PER_SEC);
+        g_autofree gchar *subtitle = NULL;
+        if (rate > 0 && free_bytes != G_MAXUINT64) {
+            g_autofree gchar *left = format_duration((guint64)(headroom / rate));
+            subtitle = g_strdup_printf("REC %s · %.1f MB · %s left", elapsed, bytes / 1e6, left);
+        } else {
+            subtitle = g_strdup_printf("REC %s · %.1f MB", elapsed, bytes / 1e6);
+        }
+        gtk_header_bar_set_subtitle(GTK_HEADER_BAR(data->header_bar), subtitle);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+void record_budget_init(CustomData *data) {
+    dictionary *dict = data->config_dict;
+    if (!iniparser_getboolean(dict, "budget:enable", 0)) {
+        return;
+    }
+
+    RecordBudget *budget = g_new0(RecordBudget, 1);
+    budget->record_path = g_strdup(iniparser_getstring(dict, "main:record_path", "/tmp"));
+    budget->min_free = get_ini_size(dict, "budget:min_free", 256 * 1024 * 1024);
+    budget->max_rss = get_ini_size(dict, "budget:max_rss", 0);
+    budget->max_bytes = get_ini_size(dict, "budget:max_bytes", 0);
+    budget->rotate = g_strcmp0(iniparser_getstring(dict, "budget:action", "stop"), "rotate") == 0;
+    data->budget = budget;
+
+    int interval = MAX(iniparser_getint(dict, "budget:interval", 1000), 100);
+    budget->timeout_id = g_timeout_add(interval, budget_tick, data);
+    budget_tick(data);
+}
+
+void record_budget_attach(CustomData *data, GstElement *muxer) {
+    if (!data->budget || !muxer) return;
+
+    g_autoptr(GstPad) src_pad = gst_element_get_static_pad(muxer, "src");
+    if (src_pad) {
+        gst_pad_add_probe(src_pad, GST_PAD_PROBE_TYPE_BUFFER, count_bytes_probe, data->budget, NULL);
+    }
+}
+
+void record_budget_reset(CustomData *data) {
+    if (data->budget) {
+        counter_set(&data->budget->bytes, 0);
+    }
+}
+
+void record_budget_free(CustomData *data) {
+    RecordBudget *budget = g_steal_pointer(&data->budget);
+    if (!budget) return;
+
+    if (budget->timeout_id) {
+        g_source_remove(budget->timeout_id);
+    }
+    g_free(budget->record_path);
+    g_free(budget);
+}
@@ -0,0 +1,28 @@
+#ifndef BUDGET_H
+#define BUDGET_H
+
+#include "config.h"
+
+/*
+ * Start the periodic [budget] check: free space on main:record_path, process RSS
+ * and bytes written by the current recording. When a limit is crossed the recording
+ * is stopped through stop_recording(), or rotated into a new file for max_bytes with
+ * action=rotate. The header bar subtitle shows the remaining recording time.
+ * data: Pointer to the CustomData structure; call after create_ui().
+ */
+void record_budget_init(CustomData *data);
+
+/*
+ * Count the output of a recording muxer towards the bytes written.
+ * muxer: Muxer element whose src pad feeds a file sink.
+ */
+void record_budget_attach(CustomData *data, GstElement *muxer);
+
+/*
+ * Reset the byte counter at the start of a recording.
+ */
+void record_budget_reset(CustomData *data);
+
+void record_budget_free(CustomData *data);
+
+#endif // BUDGET_H
@@ -0,0 +1,151 @@
+#include "utils.h"
+#include "config.h"
+#include "codec.h"
+#include <gst/gst.h>
+#include <string.h>
+#include <iniparser.h>
+
+#define DEFAULT_MUXERS "webmmux,mp4mux,matroskamux"
+#define DEFAULT_AUDIO_ENCODERS "fdkaacenc,opusenc,avenc_aac,voaacenc,vorbisenc"
+
+/* 已知复用器对应的文件扩展名 */
+static const struct {
+    const char *muxer;
+    const char *extension;
+} muxer_extensions[] = {
+    { "mp4mux", ".mp4" },
+    { "qtmux", ".mov" },
+    { "matroskamux", ".mkv" },
+    { "webmmux", ".webm" },
+    { "mpegtsmux", ".ts" },
+};
+
+static const char *extension_for_muxer(const char *muxer) {
+    for (guint i = 0; i < G_N_ELEMENTS(muxer_extensions); i++) {
+        if (strcmp(muxer, muxer_extensions[i].muxer) == 0) return muxer_extensions[i].extension;
+    }
+    return NULL;
+}
+
+// 辅助函数：合并工厂中指定方向的所有 pad 模板 caps
+static GstCaps *factory_template_caps(GstElementFactory *factory, GstPadDirection direction) {
+    GstCaps *caps = gst_caps_new_empty();
+    for (const GList *l = gst_element_factory_get_static_pad_templates(factory); l; l = l->next) {
+        GstStaticPadTemplate *templ = l->data;
+        if (templ->direction == direction) {
+            caps = gst_caps_merge(caps, gst_static_pad_template_get_caps(templ));
+        }
+    }
+    return caps;
+}
+
+// 辅助函数：找到能接收编码器输出的解析器 (按 rank 选择)，没有则返回 NULL
+static const char *find_parser(GstCaps *encoded_caps) {
+    GList *parsers = gst_element_factory_list_get_elements(GST_ELEMENT_FACTORY_TYPE_PARSER, GST_RANK_MARGINAL);
+    GList *matching = gst_element_factory_list_filter(parsers, encoded_caps, GST_PAD_SINK, FALSE);
+    matching = g_list_sort(matching, gst_plugin_feature_rank_compare_func);
+
+    const char *parser = NULL;
+    if (matching) {
+        parser = g_intern_string(GST_OBJECT_NAME(matching->data));
+    }
+    gst_plugin_feature_list_free(matching);
+    gst_plugin_feature_list_free(parsers);
+    return parser;
+}
+
+// 辅助函数：在临时 bin 中实际链接一遍，确认 pad 模板之间可以协商
+static gboolean validate_chain(const RecordChain *chain) {
+    g_autoptr(GstElement) bin = gst_object_ref_sink(gst_bin_new("record-chain-check"));
+    GstElement *video_encoder = create_and_add_element(chain->video_encoder, "check-video-encoder", GST_BIN(bin));
+    GstElement *video_parser = chain->video_parser ?
+                               create_and_add_element(chain->video_parser, "check-video-parser", GST_BIN(bin)) : NULL;
+    GstElement *audio_encoder = create_and_add_element(chain->audio_encoder, "check-audio-encoder", GST_BIN(bin));
+    GstElement *muxer = create_and_add_element(chain->muxer, "check-muxer", GST_BIN(bin));
+
+    if (!video_encoder || (chain->video_parser && !video_parser) || !audio_encoder || !muxer) {
+        return FALSE;
+    }
+
+    GstElement *video_last = video_parser ? video_parser : video_encoder;
+    return (!video_parser || gst_element_link(video_encoder, video_parser)) &&
+           gst_element_link(video_last, muxer) &&
+           gst_element_link(audio_encoder, muxer);
+}
+
+gboolean codec_resolve_chain(CustomData *data) {
+    dictionary *dict = data->config_dict;
+    RecordChain *chain = &data->record_chain;
+    memset(chain, 0, sizeof(*chain));
+    chain->video_encoder = data->video_encoder;
+
+    // --- 1. 编码器输出 caps ---
+    g_autoptr(GstElementFactory) encoder_factory = gst_element_factory_find(chain->video_encoder);
+    if (!encoder_factory) {
+        g_printerr("Video encoder %s is not installed.\n", chain->video_encoder);
+        return FALSE;
+    }
+    g_autoptr(GstCaps) encoded_caps = factory_template_caps(encoder_factory, GST_PAD_SRC);
+
+    // --- 2. 解析器：接收编码器输出的 Codec/Parser ---
+    chain->video_parser = find_parser(encoded_caps);
+    g_autoptr(GstCaps) video_caps = NULL;
+    if (chain->video_parser) {
+        g_autoptr(GstElementFactory) parser_factory = gst_element_factory_find(chain->video_parser);
+        video_caps = factory_template_caps(parser_factory, GST_PAD_SRC);
+    } else {
+        video_caps = gst_caps_ref(encoded_caps);
+    }
+
+    // --- 3. 复用器与音频编码器：按配置顺序选择第一组兼容的组合 ---
+    const char *muxers_str = iniparser_getstring(dict, "main:muxers", DEFAULT_MUXERS);
+    const char *audio_str = iniparser_getstring(dict, "main:audio_encoders", DEFAULT_AUDIO_ENCODERS);
+    g_auto(GStrv) muxers = g_strsplit(muxers_str, ",", -1);
+    g_auto(GStrv) audio_encoders = g_strsplit(audio_str, ",", -1);
+
+    for (int i = 0; muxers[i] != NULL && !chain->muxer; i++) {
+        const char *muxer_name = g_strstrip(muxers[i]);
+        const char *extension = extension_for_muxer(muxer_name);
+        g_autoptr(GstElementFactory) muxer_factory = gst_element_factory_find(muxer_name);
+        if (!muxer_factory || !extension) {
+            if (!extension) g_printerr("Warning: Unsupported muxer %s in main:muxers.\n", muxer_name);
+            continue;
+        }
+        if (!gst_element_factory_can_sink_any_caps(muxer_factory, video_caps)) {
+            continue;
+        }
+
+        for (int j = 0; audio_encoders[j] != NULL; j++) {
+            const char *audio_name = g_strstrip(audio_encoders[j]);
+            g_autoptr(GstElementFactory) audio_factory = gst_element_factory_find(audio_name);
+            if (!audio_factory) continue;
+
+            g_autoptr(GstCaps) audio_caps = factory_template_caps(audio_factory, GST_PAD_SRC);
+            if (gst_element_factory_can_sink_any_caps(muxer_factory, audio_caps)) {
+                chain->muxer = g_intern_string(muxer_name);
+                chain->extension = extension;
+                chain->audio_encoder = g_intern_string(audio_name);
+                break;
+            }
+        }
+    }
+
+    if (!chain->muxer) {
+        g_autofree gchar *caps_str = gst_caps_to_string(video_caps);
+        g_printerr("No muxer in '%s' accepts %s output (%s) together with an encoder from '%s'.\n",
+                   muxers_str, chain->video_encoder, caps_str, audio_str);
+        return FALSE;
+    }
+
+    // --- 4. 启动时验证整条链 ---
+    if (!validate_chain(chain)) {
+        g_printerr("Recording chain %s ! %s ! %s + %s failed to link.\n", chain->video_encoder,
+                   chain->video_parser ? chain->video_parser : "(no parser)", chain->muxer, chain->audio_encoder);
+        return FALSE;
+    }
+
+    g_print("Recording chain: %s ! %s ! %s (%s) + %s.\n", chain->video_encoder,
+            chain->video_parser ? chain->video_parser : "(no parser)", chain->muxer, chain->extension,
+            chain->audio_encoder);
+    return TRUE;
+}
@@ -0,0 +1,17 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include "config.h"
+
+/*
+ * Resolve data->record_chain for data->video_encoder from element factory pad
+ * templates: a parser accepting the encoder's src caps, the first muxer from
+ * main:muxers that accepts the parsed video, and the first encoder from
+ * main:audio_encoders whose output that muxer accepts. The chain is then linked
+ * once in a throwaway bin so incompatible combinations fail at startup.
+ * data: Pointer to the CustomData structure.
+ * Returns: TRUE if a complete chain was found and validated, FALSE otherwise.
+ */
+gboolean codec_resolve_chain(CustomData *data);
+
+#endif // CODEC_H
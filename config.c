@@ -1,5 +1,11 @@
 #include "utils.h"
 #include "config.h"
+#include "preroll.h"
+#include "recorder.h"
+#include "recqueue.h"
+#include "encctl.h"
+#include "budget.h"
+#include "preview.h"
 #include <string.h>
 #include <stdlib.h>
 #include <iniparser.h>
@@ -50,6 +56,8 @@ gboolean initialize_gstreamer_pipeline(CustomData *data) {
 #endif
                 }
                 prev_element = data->video_tee;
+                // 无界面模式：tee 之后的元素只服务于预览 (GL 上传等)，全部跳过
+                if (data->headless) break;
                 continue;
             }
 
@@ -96,8 +104,20 @@ gboolean initialize_gstreamer_pipeline(CustomData *data) {
         success = FALSE;
     }
 
-    // --- 2. 添加并配置视频接收器 glsinkbin/gtkglsink ---
-    if (success && last_video_element) {
+    // --- 2. 添加并配置视频接收器 glsinkbin/gtkglsink (无界面模式使用 main:headless_sink) ---
+    if (success && last_video_element && data->headless) {
+        const char *sink_factory = iniparser_getstring(dict, "main:headless_sink", "fakesink");
+        data->videosink = create_and_add_element(sink_factory, "headless-sink", bin);
+        if (!data->videosink) {
+            success = FALSE;
+        } else {
+            configure_element_from_ini(data->videosink, dict, sink_factory);
+            if (!gst_element_link(last_video_element, data->videosink)) {
+                g_printerr ("Failed to link %s to %s.\n", GST_OBJECT_NAME(last_video_element), GST_OBJECT_NAME(data->videosink));
+                success = FALSE;
+            }
+        }
+    } else if (success && last_video_element) {
         GstElement *gtkglsink = gst_element_factory_make("gtkglsink", "gtk-gl-sink");
         data->videosink = create_and_add_element("glsinkbin", "gl-sink-bin", bin);
 
@@ -112,7 +132,22 @@ gboolean initialize_gstreamer_pipeline(CustomData *data) {
             // 获取 gtkglsink 的 widget 用于 UI 显示
             g_object_get (gtkglsink, "widget", &data->sink_widget, NULL);
 
-            if (!gst_element_link(last_video_element, data->videosink)) {
+            // 最新帧模式：单帧 leaky 队列只保留最新一帧，sink 不再按时钟等待，
+            // 控件在每个帧时钟周期绘制收到的最新一帧，旧帧直接被覆盖
+            if (g_strcmp0(iniparser_getstring(dict, "preview:present", "queue"), "mailbox") == 0) {
+                GstElement *mailbox = create_and_add_element("queue", "preview-mailbox", bin);
+                if (!mailbox || !gst_element_link(last_video_element, mailbox)) {
+                    g_printerr("Failed to add the preview mailbox queue.\n");
+                    success = FALSE;
+                } else {
+                    g_object_set(mailbox, "leaky", 2, "max-size-buffers", 1, "max-size-bytes", 0,
+                                 "max-size-time", (guint64)0, NULL);
+                    g_object_set(data->videosink, "sync", FALSE, NULL);
+                    last_video_element = mailbox;
+                }
+            }
+
+            if (success && !gst_element_link(last_video_element, data->videosink)) {
                 g_printerr ("Failed to link %s to %s.\n", GST_OBJECT_NAME(last_video_element), GST_OBJECT_NAME(data->videosink));
                 success = FALSE;
             } else {
@@ -195,14 +230,17 @@ gboolean initialize_gstreamer_pipeline(CustomData *data) {
 #endif
                 }
 
+                // 无界面模式的机器通常也没有音频输出设备
+                const char *audio_sink_factory = data->headless ?
+                    iniparser_getstring(dict, "main:headless_sink", "fakesink") : last_audio_factory_name;
                 GstElement *audio_sink = create_and_add_element(
-                    last_audio_factory_name, 
+                    audio_sink_factory, 
                     "audio-sink",
                     bin
                 );
 
                 if (!audio_sink) success = FALSE;
-                configure_element_from_ini(audio_sink, dict, last_audio_factory_name);
+                configure_element_from_ini(audio_sink, dict, audio_sink_factory);
 
                 if (success && !gst_element_link(data->audio_tee, audio_sink)) {
                      g_printerr("Failed to link audio-tee to audio-sink.\n");
@@ -223,6 +261,20 @@ gboolean initialize_gstreamer_pipeline(CustomData *data) {
         }
     }
 
+    // --- 4. 预录模式：在 tee 后面常驻编码分支 ---
+    if (success) {
+        preview_throttle_init(data);
+        record_queue_guard_init(data);
+        encoder_control_init(data);
+        record_budget_init(data);
+    }
+    if (success && !preroll_branch_init(data)) {
+        success = FALSE;
+    }
+    if (success) {
+        recorder_prepare_tail(data);
+    }
+
     if (!success) {
         g_printerr("Pipeline initialization failed. Cleaning up.\n");
         if (data->pipeline) {
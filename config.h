@@ -5,9 +5,33 @@
 #include <gst/gst.h>
 #include <gtk/gtk.h>
 
+/* 录制分支使用的元素链，启动时根据编码器的 pad 模板解析并验证 */
+typedef struct {
+    const char *video_encoder;
+    const char *video_parser;         /* 编码器输出无需解析时为 NULL */
+    const char *audio_encoder;
+    const char *muxer;
+    const char *extension;
+} RecordChain;
+
+typedef struct _PrerollBranch PrerollBranch;
+typedef struct _RecordQueueGuard RecordQueueGuard;
+typedef struct _EncoderController EncoderController;
+typedef struct _Archiver Archiver;
+typedef struct _RecordBudget RecordBudget;
+typedef struct _Transcoder Transcoder;
+typedef struct _RecordCut RecordCut;
+typedef struct _ControlServer ControlServer;
+typedef struct _PreviewThrottle PreviewThrottle;
+typedef struct _PreviewLatency PreviewLatency;
+typedef struct _LatencyTracer LatencyTracer;
+typedef struct _MetricsExporter MetricsExporter;
+typedef struct _ThreadMonitor ThreadMonitor;
+
 /* 结构体包含所有需要传递的信息 (与 main.c 中的定义一致) */
 typedef struct _CustomData {
-  GtkApplication *app;                /* 指向 GtkApplication 实例的指针 */
+  GApplication *app;                  /* 应用实例：有界面时为 GtkApplication，无界面模式为 GApplication */
+  gboolean headless;                  /* 无界面模式：不创建窗口，预览 sink 换成 main:headless_sink */
   guint inhibit_cookie;               /* 用于取消 inhibit 的 ID */
 
   GstElement *pipeline;               /* 主管道 */
@@ -19,15 +43,37 @@ typedef struct _CustomData {
   GstElement *recording_bin;          /* 录制子管道容器 (GstBin) */
   GstPad *video_tee_q_pad;            /* 从视频 Tee 请求的 Pad (用于取消链接和释放) */
   GstPad *audio_tee_q_pad;            /* 从音频 Tee 请求的 Pad (用于取消链接和释放) */
+  RecordCut *record_cut;              /* tee pad 上的定时开始/结束探针 (预录模式下为 NULL) */
+  PrerollBranch *preroll;             /* 常驻编码分支及预录环形缓冲 (未启用时为 NULL) */
+  GstElement *spare_recording_bin;    /* 预先构建、等待下一次录制使用的尾部 */
+  RecordQueueGuard *record_guard;     /* 录制队列的过载策略与丢帧统计 */
+  EncoderController *encoder_control; /* 根据录制队列深度调节编码器参数 (未启用时为 NULL) */
+  Archiver *archiver;                 /* 把录制完成的文件迁移到 [archive] path (未启用时为 NULL) */
+  RecordBudget *budget;               /* 磁盘空间/内存/文件大小预算 (未启用时为 NULL) */
+  Transcoder *transcoder;             /* 录制完成后的后台转码队列 (未启用时为 NULL) */
+  ControlServer *control;             /* 本地控制 socket (未启用时为 NULL) */
+  PreviewThrottle *preview_throttle;  /* 窗口不可见时对预览分支抽帧 (无界面模式为 NULL) */
+  PreviewLatency *preview_latency;    /* 采集到上屏的延迟统计 (未启用时为 NULL) */
+  LatencyTracer *latency_tracer;      /* 各元素输出相对采集时刻的延迟直方图 (未启用时为 NULL) */
+  MetricsExporter *metrics;           /* Prometheus 指标端点 (未启用时为 NULL) */
+  ThreadMonitor *thread_monitor;      /* 流线程命名与按分段的 CPU 统计 (未启用时为 NULL) */
 
   GtkWidget *sink_widget;             /* 视频显示组件 */
   GtkWidget *main_window;             /* 主窗口指针, 用于全屏/退出控制 */
+  GtkWidget *header_bar;              /* 标题栏, 副标题显示剩余录制时间 */
   dictionary *config_dict;            /* 指向解析后的配置数据的指针 */
+  gchar *video_encoder;               /* 录制使用的视频编码器 (main:encoder 或启动测试选出的编码器) */
+  RecordChain record_chain;           /* 录制使用的编码器/解析器/复用器 */
 
   gboolean has_tee;                   /* 标志是否存在 tee 元素 */
   gboolean is_recording;              /* 录制状态标志 */
   gboolean is_stopping_recording;     /* 正在停止/清理过程中的标志 */
   gchar *recording_filename;          /* 录制文件名指针 */
+  gint64 record_start_time;           /* start_recording 调用时刻 (单调时钟, 微秒) */
+  gint64 record_stop_time;            /* stop_recording 调用时刻 (单调时钟, 微秒) */
+  gboolean restart_recording;         /* 清理完成后立即开始新的录制 (预算轮换) */
+  gboolean quit_after_recording;      /* 清理完成后再向主管道发送 EOS (无界面模式退出) */
+  guint record_sinks_pending;         /* 尚未收到 EOS 的文件 sink 数 (主文件 + 代理文件) */
   GtkWidget *record_icon;             /* 录制图标指针 */
 
   GtkWidget *dialog;
@@ -0,0 +1,398 @@
+#include "utils.h"
+#include "config.h"
+#include "control.h"
+#include "recorder.h"
+#include "cut.h"
+#include <gio/gio.h>
+#include <gio/gunixsocketaddress.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <iniparser.h>
+
+/* 等待应答的命令 */
+typedef enum {
+    WAIT_START,                         /* 新文件的第一帧已写入 */
+    WAIT_STOP,                          /* 文件已关闭 */
+    WAIT_SPLIT,                         /* splitmuxsink 已切换到新文件 */
+} WaitKind;
+
+typedef struct {
+    ControlServer *srv;
+    GSocketConnection *connection;
+    GDataInputStream *input;
+    GCancellable *cancellable;
+} ControlClient;
+
+typedef struct {
+    ControlClient *client;
+    WaitKind kind;
+    gint64 issued;                      /* 收到命令的时刻 (单调时钟, 微秒) */
+    gint64 deadline;
+    gchar *file;                        /* 收到命令时的录制文件 */
+} ControlWaiter;
+
+struct _ControlServer {
+    CustomData *data;
+    GSocketService *service;
+    gchar *socket_path;
+    gint64 wait_timeout;                /* 微秒 */
+    GList *clients;                     /* ControlClient */
+    GList *waiters;                     /* ControlWaiter */
+    guint timeout_id;
+};
+
+static void read_next_line(ControlClient *client);
+
+// 辅助函数：发送一行应答，失败时由读取回调关闭连接
+static void reply(ControlClient *client, const char *format, ...) G_GNUC_PRINTF(2, 3);
+static void reply(ControlClient *client, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    g_autofree gchar *line = g_strdup_vprintf(format, args);
+    va_end(args);
+
+    g_autofree gchar *text = g_strconcat(line, "\n", NULL);
+    GOutputStream *out = g_io_stream_get_output_stream(G_IO_STREAM(client->connection));
+    if (!g_output_stream_write_all(out, text, strlen(text), NULL, client->cancellable, NULL)) {
+        g_cancellable_cancel(client->cancellable);
+    }
+#ifdef DEBUG
+    g_print("Control reply: %s\n", line);
+#endif
+}
+
+static void waiter_free(ControlWaiter *waiter) {
+    g_free(waiter->file);
+    g_free(waiter);
+}
+
+static void client_free(ControlClient *client) {
+    ControlServer *srv = client->srv;
+    for (GList *l = srv->waiters; l;) {
+        GList *next = l->next;
+        ControlWaiter *waiter = l->data;
+        if (waiter->client == client) {
+            waiter_free(waiter);
+            srv->waiters = g_list_delete_link(srv->waiters, l);
+        }
+        l = next;
+    }
+    srv->clients = g_list_remove(srv->clients, client);
+
+    // 取消挂起的读取，回调只访问 source object，不再访问 client
+    g_cancellable_cancel(client->cancellable);
+    g_io_stream_close(G_IO_STREAM(client->connection), NULL, NULL);
+    g_object_unref(client->input);
+    g_object_unref(client->connection);
+    g_object_unref(client->cancellable);
+    g_free(client);
+}
+
+static void update_record_icon(CustomData *data) {
+    if (data->record_icon) {
+        gtk_image_set_from_icon_name(GTK_IMAGE(data->record_icon),
+                                     data->is_recording && !data->is_stopping_recording ? "media-playback-stop-symbolic" : "media-record-symbolic",
+                                     GTK_ICON_SIZE_SMALL_TOOLBAR);
+    }
+}
+
+// 辅助函数：检查等待的条件，满足时发送应答并返回 TRUE
+static gboolean waiter_done(ControlServer *srv, ControlWaiter *waiter, gint64 now) {
+    CustomData *data = srv->data;
+    gboolean active = data->is_recording && !data->is_stopping_recording;
+
+    switch (waiter->kind) {
+    case WAIT_START: {
+        if (!active) break;
+        gint64 first_frame = record_cut_first_frame_time(data);
+        if (data->record_cut && first_frame < waiter->issued) break;
+        // 预录模式没有切分探针，只能以开始录制的时刻为准
+        gint64 latency = (data->record_cut ? first_frame : now) - waiter->issued;
+        GstClockTime pts = record_cut_first_pts(data);
+        GstClockTime running_time = record_cut_first_running_time(data);
+        g_print("Control: first frame recorded %.1f ms after the command.\n", latency / 1000.0);
+        reply(waiter->client, "OK pts=%" G_GINT64_FORMAT " running_time=%" G_GINT64_FORMAT " latency_ms=%.1f file=%s",
+              GST_CLOCK_TIME_IS_VALID(pts) ? (gint64)pts : -1,
+              GST_CLOCK_TIME_IS_VALID(running_time) ? (gint64)running_time : -1,
+              latency / 1000.0, data->recording_filename ? data->recording_filename : "");
+        return TRUE;
+    }
+    case WAIT_STOP:
+        if (data->is_recording && g_strcmp0(data->recording_filename, waiter->file) == 0) break;
+        reply(waiter->client, "OK latency_ms=%.1f file=%s", (now - waiter->issued) / 1000.0, waiter->file ? waiter->file : "");
+        return TRUE;
+    case WAIT_SPLIT:
+        if (!active || g_strcmp0(data->recording_filename, waiter->file) == 0) break;
+        reply(waiter->client, "OK latency_ms=%.1f file=%s", (now - waiter->issued) / 1000.0, data->recording_filename);
+        return TRUE;
+    }
+
+    if (now >= waiter->deadline) {
+        reply(waiter->client, "ERR timeout");
+        return TRUE;
+    }
+    return FALSE;
+}
+
+// 定时回调：只在有命令等待应答时运行
+static gboolean control_tick(gpointer user_data) {
+    ControlServer *srv = (ControlServer *)user_data;
+    gint64 now = g_get_monotonic_time();
+
+    for (GList *l = srv->waiters; l;) {
+        GList *next = l->next;
+        ControlWaiter *waiter = l->data;
+        if (waiter_done(srv, waiter, now)) {
+            waiter_free(waiter);
+            srv->waiters = g_list_delete_link(srv->waiters, l);
+        }
+        l = next;
+    }
+    // 写应答失败的连接
+    for (GList *l = srv->clients; l;) {
+        GList *next = l->next;
+        ControlClient *client = l->data;
+        if (g_cancellable_is_cancelled(client->cancellable)) {
+            client_free(client);
+        }
+        l = next;
+    }
+
+    update_record_icon(srv->data);
+    if (!srv->waiters) {
+        srv->timeout_id = 0;
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static void add_waiter(ControlClient *client, WaitKind kind, gint64 issued, gint64 target_real_time) {
+    ControlServer *srv = client->srv;
+    ControlWaiter *waiter = g_new0(ControlWaiter, 1);
+    waiter->client = client;
+    waiter->kind = kind;
+    waiter->issued = issued;
+    waiter->deadline = issued + srv->wait_timeout;
+    if (target_real_time > 0) {
+        waiter->deadline += MAX(target_real_time - g_get_real_time(), 0);
+    }
+    waiter->file = g_strdup(srv->data->recording_filename);
+    srv->waiters = g_list_append(srv->waiters, waiter);
+
+    if (!srv->timeout_id) {
+        srv->timeout_id = g_timeout_add_full(G_PRIORITY_HIGH, 5, control_tick, srv, NULL);
+    }
+}
+
+// 辅助函数：解析可选的 "at <unix_us>"，返回对应的运行时间
+static gboolean parse_at(CustomData *data, gchar **args, gint64 *real_time, GstClockTime *running_time) {
+    *real_time = 0;
+    *running_time = GST_CLOCK_TIME_NONE;
+    if (!args[0]) return TRUE;
+    if (g_strcmp0(args[0], "at") != 0 || !args[1] || args[2]) return FALSE;
+
+    gchar *end = NULL;
+    *real_time = g_ascii_strtoll(args[1], &end, 10);
+    if (!end || *end != '\0' || *real_time <= 0) return FALSE;
+    *running_time = record_cut_running_time(data, *real_time);
+    return TRUE;
+}
+
+static void handle_command(ControlClient *client, const char *line, gint64 issued) {
+    CustomData *data = client->srv->data;
+    g_auto(GStrv) argv = g_strsplit_set(line, " \t", -1);
+    g_autoptr(GPtrArray) args = g_ptr_array_new();
+    for (int i = 0; argv[i]; i++) {
+        if (*argv[i]) g_ptr_array_add(args, argv[i]);
+    }
+    g_ptr_array_add(args, NULL);
+    gchar **arg = (gchar **)args->pdata;
+    if (!arg[0]) return;
+
+    if (g_strcmp0(arg[0], "status") == 0) {
+        GstClockTime pts = data->is_recording ? record_cut_first_pts(data) : GST_CLOCK_TIME_NONE;
+        reply(client, "OK recording=%d stopping=%d elapsed=%.3f pts=%" G_GINT64_FORMAT " file=%s",
+              data->is_recording ? 1 : 0, data->is_stopping_recording ? 1 : 0,
+              data->is_recording ? (g_get_monotonic_time() - data->record_start_time) / 1e6 : 0.0,
+              GST_CLOCK_TIME_IS_VALID(pts) ? (gint64)pts : -1,
+              data->is_recording && data->recording_filename ? data->recording_filename : "");
+        return;
+    }
+
+    if (g_strcmp0(arg[0], "start") == 0) {
+        gint64 real_time;
+        GstClockTime start;
+        if (!parse_at(data, arg + 1, &real_time, &start)) {
+            reply(client, "ERR usage: start [at <unix_us>]");
+        } else if (data->is_recording || data->is_stopping_recording) {
+            reply(client, "ERR already recording");
+        } else if (!start_recording_at(data, start)) {
+            reply(client, "ERR failed to start recording");
+        } else {
+            add_waiter(client, WAIT_START, issued, real_time);
+        }
+        update_record_icon(data);
+        return;
+    }
+
+    if (g_strcmp0(arg[0], "stop") == 0) {
+        gint64 real_time;
+        GstClockTime stop;
+        if (!parse_at(data, arg + 1, &real_time, &stop)) {
+            reply(client, "ERR usage: stop [at <unix_us>]");
+        } else if (!data->is_recording || data->is_stopping_recording) {
+            reply(client, "ERR not recording");
+        } else if (!stop_recording_at(data, stop)) {
+            reply(client, "ERR failed to stop recording");
+        } else {
+            add_waiter(client, WAIT_STOP, issued, real_time);
+        }
+        update_record_icon(data);
+        return;
+    }
+
+    if (g_strcmp0(arg[0], "segment") == 0) {
+        if (!data->is_recording || data->is_stopping_recording || !data->recording_bin) {
+            reply(client, "ERR not recording");
+            return;
+        }
+        // 分段模式：splitmuxsink 在下一个关键帧切换文件；其他模式与预算轮换相同，重新开始录制
+        g_autoptr(GstElement) splitmux = gst_bin_get_by_name(GST_BIN(data->recording_bin), "record-splitmuxsink");
+        if (splitmux) {
+            g_signal_emit_by_name(splitmux, "split-now");
+            add_waiter(client, WAIT_SPLIT, issued, 0);
+        } else if (stop_recording(data)) {
+            data->restart_recording = TRUE;
+            add_waiter(client, WAIT_START, issued, 0);
+        } else {
+            reply(client, "ERR failed to stop recording");
+        }
+        return;
+    }
+
+    if (g_strcmp0(arg[0], "marker") == 0) {
+        g_autofree gchar *text = g_strstrip(g_strdup(strstr(line, "marker") + strlen("marker")));
+        if (!data->is_recording || !data->recording_filename) {
+            reply(client, "ERR not recording");
+            return;
+        }
+        // 标记时间相对于第一帧，预录模式下相对于开始录制的时刻
+        gdouble seconds = (g_get_monotonic_time() - data->record_start_time) / 1e6;
+        GstClockTime first = record_cut_first_running_time(data);
+        GstClockTime now = record_cut_running_time(data, g_get_real_time());
+        if (GST_CLOCK_TIME_IS_VALID(first) && GST_CLOCK_TIME_IS_VALID(now)) {
+            seconds = now > first ? (gdouble)(now - first) / GST_SECOND : 0.0;
+        }
+
+        g_autofree gchar *path = g_strconcat(data->recording_filename, RECORD_MARKERS_SUFFIX, NULL);
+        FILE *fp = fopen(path, "a");
+        if (!fp) {
+            reply(client, "ERR cannot write %s", path);
+            return;
+        }
+        fprintf(fp, "%.3f %s\n", seconds, text);
+        fclose(fp);
+        reply(client, "OK time=%.3f file=%s", seconds, data->recording_filename);
+        return;
+    }
+
+    reply(client, "ERR unknown command: %s", arg[0]);
+}
+
+static void on_line_read(GObject *source, GAsyncResult *result, gpointer user_data) {
+    g_autoptr(GError) error = NULL;
+    gsize length = 0;
+    g_autofree gchar *line = g_data_input_stream_read_line_finish(G_DATA_INPUT_STREAM(source), result, &length, &error);
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        return;
+    }
+
+    ControlClient *client = (ControlClient *)user_data;
+    if (!line) {
+        // 对端关闭或读取出错
+        client_free(client);
+        return;
+    }
+
+    gint64 issued = g_get_monotonic_time();
+    g_strchomp(line);
+#ifdef DEBUG
+    g_print("Control command: %s\n", line);
+#endif
+    handle_command(client, line, issued);
+    if (g_cancellable_is_cancelled(client->cancellable)) {
+        client_free(client);
+        return;
+    }
+    read_next_line(client);
+}
+
+static void read_next_line(ControlClient *client) {
+    g_data_input_stream_read_line_async(client->input, G_PRIORITY_HIGH, client->cancellable, on_line_read, client);
+}
+
+static gboolean on_incoming(GSocketService *service, GSocketConnection *connection, GObject *source_object, gpointer user_data) {
+    ControlServer *srv = (ControlServer *)user_data;
+
+    ControlClient *client = g_new0(ControlClient, 1);
+    client->srv = srv;
+    client->connection = g_object_ref(connection);
+    client->input = g_data_input_stream_new(g_io_stream_get_input_stream(G_IO_STREAM(connection)));
+    client->cancellable = g_cancellable_new();
+    srv->clients = g_list_prepend(srv->clients, client);
+    read_next_line(client);
+    return TRUE;
+}
+
+void control_init(CustomData *data) {
+    dictionary *dict = data->config_dict;
+    if (!iniparser_getboolean(dict, "control:enable", 0)) {
+        return;
+    }
+
+    g_autofree gchar *default_path = g_build_filename(g_get_user_runtime_dir(), "gst-capture.sock", NULL);
+    const char *path = iniparser_getstring(dict, "control:socket", default_path);
+
+    // 上次运行留下的 socket 文件
+    g_unlink(path);
+    g_autoptr(GSocketAddress) address = g_unix_socket_address_new(path);
+    GSocketService *service = g_socket_service_new();
+    g_autoptr(GError) error = NULL;
+    if (!g_socket_listener_add_address(G_SOCKET_LISTENER(service), address, G_SOCKET_TYPE_STREAM,
+                                       G_SOCKET_PROTOCOL_DEFAULT, NULL, NULL, &error)) {
+        g_printerr("Warning: Could not listen on control socket %s: %s\n", path, error->message);
+        g_object_unref(service);
+        return;
+    }
+    g_chmod(path, 0600);
+
+    ControlServer *srv = g_new0(ControlServer, 1);
+    srv->data = data;
+    srv->service = service;
+    srv->socket_path = g_strdup(path);
+    srv->wait_timeout = (gint64)MAX(iniparser_getint(dict, "control:wait_timeout", 10), 1) * G_USEC_PER_SEC;
+    g_signal_connect(service, "incoming", G_CALLBACK(on_incoming), srv);
+    g_socket_service_start(service);
+
+    data->control = srv;
+    g_print("Control socket listening on %s.\n", path);
+}
+
+void control_free(CustomData *data) {
+    ControlServer *srv = g_steal_pointer(&data->control);
+    if (!srv) return;
+
+    g_socket_service_stop(srv->service);
+    g_socket_listener_close(G_SOCKET_LISTENER(srv->service));
+    g_object_unref(srv->service);
+    while (srv->clients) {
+        client_free(srv->clients->data);
+    }
+    if (srv->timeout_id) {
+        g_source_remove(srv->timeout_id);
+    }
+    g_unlink(srv->socket_path);
+    g_free(srv->socket_path);
+    g_free(srv);
+}
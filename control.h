@@ -0,0 +1,31 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include "config.h"
+
+/*
+ * Listen on the unix socket [control] socket when [control] enable is set. Each
+ * line is one command, handled on the main loop; each reply is one line starting
+ * with "OK" or "ERR". A "file=" field is always last and runs to the end of line.
+ *
+ *   start [at <unix_us>]   Reply once the first frame is recorded:
+ *                          OK pts=<ns> running_time=<ns> latency_ms=<ms> file=<path>
+ *   stop [at <unix_us>]    Reply once the file is finalized:
+ *                          OK latency_ms=<ms> file=<path>
+ *   segment                Start a new file at the next keyframe (splitmuxsink) or
+ *                          restart the recording; replies like start.
+ *   marker <text>          Append "<seconds> <text>" to <file>.markers:
+ *                          OK time=<seconds> file=<path>
+ *   status                 OK recording=<0|1> stopping=<0|1> elapsed=<s> pts=<ns> file=<path>
+ *
+ * <unix_us> is wall-clock time in microseconds (g_get_real_time()).
+ */
+void control_init(CustomData *data);
+
+/* Suffix of the marker file written next to the recording; it follows the
+ * recording through transcode and archive. */
+#define RECORD_MARKERS_SUFFIX ".markers"
+
+void control_free(CustomData *data);
+
+#endif // CONTROL_H
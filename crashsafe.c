@@ -0,0 +1,296 @@
+#include "utils.h"
+#include "config.h"
+#include "crashsafe.h"
+#include "transcode.h"
+#include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+#include <glib/gstdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <iniparser.h>
+
+#define DEFAULT_FRAGMENT_DURATION 1000
+#define DEFAULT_SYNC_INTERVAL 1000
+
+/* 顶层 box 扫描结果 */
+typedef struct {
+    gboolean has_moov;
+    gboolean has_moof;
+    gboolean has_mfra;                  /* 正常结束的分片文件末尾带 mfra */
+    gboolean truncated;                 /* 最后一个 box 超出文件末尾 */
+    guint64 fragments;                  /* 完整的 moof+mdat 对 */
+    guint64 good_end;                   /* 最后一个完整分片之后的偏移 */
+} Mp4Scan;
+
+// 辅助函数：设置分片时长和同步间隔，元素没有对应属性时跳过
+static void apply_settings(GstElement *muxer, GstElement *sink, guint fragment_ms, gint sync_ms) {
+    if (g_object_class_find_property(G_OBJECT_GET_CLASS(muxer), "fragment-duration")) {
+        g_object_set(G_OBJECT(muxer), "fragment-duration", fragment_ms, NULL);
+        // 非 streamable 模式在结束时写入 mfra，恢复时据此判断文件是否正常结束
+        if (g_object_class_find_property(G_OBJECT_GET_CLASS(muxer), "streamable")) {
+            g_object_set(G_OBJECT(muxer), "streamable", FALSE, NULL);
+        }
+    }
+    if (sink && g_object_class_find_property(G_OBJECT_GET_CLASS(sink), "sync-interval")) {
+        g_object_set(G_OBJECT(sink), "sync-interval", sync_ms, NULL);
+    }
+}
+
+void crash_safe_apply(CustomData *data, GstElement *muxer, GstElement *sink) {
+    dictionary *dict = data->config_dict;
+    if (!muxer || !iniparser_getboolean(dict, "crash_safe:enable", 0)) {
+        return;
+    }
+
+    if (!g_object_class_find_property(G_OBJECT_GET_CLASS(muxer), "fragment-duration")) {
+        g_printerr("Warning: %s cannot write fragments. Crash-safe recording needs an MP4 muxer.\n",
+                   GST_OBJECT_NAME(muxer));
+        return;
+    }
+    if (sink && !g_object_class_find_property(G_OBJECT_GET_CLASS(sink), "sync-interval")) {
+        g_printerr("Warning: %s has no periodic sync. Use main:record_sink=fastfilesink for crash-safe recording.\n",
+                   GST_OBJECT_NAME(sink));
+    }
+    apply_settings(muxer, sink,
+                   (guint)MAX(iniparser_getint(dict, "crash_safe:fragment_duration", DEFAULT_FRAGMENT_DURATION), 100),
+                   iniparser_getint(dict, "crash_safe:sync_interval", DEFAULT_SYNC_INTERVAL));
+}
+
+// 辅助函数：读取 offset 处的 box 头，size 为 0 表示一直到文件末尾
+static gboolean read_box(int fd, guint64 offset, guint64 file_size, guint64 *size, guint32 *type) {
+    guint8 header[16];
+    if (pread(fd, header, 8, (off_t)offset) != 8) return FALSE;
+
+    *size = GST_READ_UINT32_BE(header);
+    *type = GST_READ_UINT32_LE(header + 4);
+    if (*size == 1) {
+        if (pread(fd, header + 8, 8, (off_t)offset + 8) != 8) return FALSE;
+        *size = GST_READ_UINT64_BE(header + 8);
+    } else if (*size == 0) {
+        *size = file_size - offset;
+    }
+    return *size >= 8;
+}
+
+static void scan_mp4(int fd, guint64 file_size, Mp4Scan *scan) {
+    guint64 offset = 0;
+    gboolean pending_moof = FALSE;
+
+    memset(scan, 0, sizeof(*scan));
+    while (offset < file_size) {
+        guint64 size;
+        guint32 type;
+        if (!read_box(fd, offset, file_size, &size, &type) || size > file_size - offset) {
+            scan->truncated = TRUE;
+            break;
+        }
+        guint64 end = offset + size;
+
+        if (type == GST_MAKE_FOURCC('m', 'o', 'o', 'f')) {
+            // moof 只有在对应的 mdat 完整写入后才算有效
+            scan->has_moof = TRUE;
+            pending_moof = TRUE;
+        } else if (type == GST_MAKE_FOURCC('m', 'd', 'a', 't') && pending_moof) {
+            pending_moof = FALSE;
+            scan->fragments++;
+            scan->good_end = end;
+        } else if (!pending_moof) {
+            if (type == GST_MAKE_FOURCC('m', 'o', 'o', 'v')) scan->has_moov = TRUE;
+            if (type == GST_MAKE_FOURCC('m', 'f', 'r', 'a')) scan->has_mfra = TRUE;
+            scan->good_end = end;
+        }
+        offset = end;
+    }
+}
+
+// 辅助函数：在 offset 处写入只含 mfro 的空 mfra，标记文件已经结束 (tfra 是可选的)
+static gboolean write_empty_mfra(int fd, guint64 offset) {
+    guint8 box[24];
+    GST_WRITE_UINT32_BE(box, 24);
+    GST_WRITE_UINT32_LE(box + 4, GST_MAKE_FOURCC('m', 'f', 'r', 'a'));
+    GST_WRITE_UINT32_BE(box + 8, 16);
+    GST_WRITE_UINT32_LE(box + 12, GST_MAKE_FOURCC('m', 'f', 'r', 'o'));
+    GST_WRITE_UINT32_BE(box + 16, 0);   /* version/flags */
+    GST_WRITE_UINT32_BE(box + 20, 24);  /* 整个 mfra 的大小 */
+    return pwrite(fd, box, sizeof(box), (off_t)offset) == sizeof(box);
+}
+
+// 修复一个文件：截掉最后一个完整分片之后的内容，并补上 mfra，下次启动不会再次处理
+static gboolean recover_file(const char *path) {
+    int fd = g_open(path, O_RDWR | O_CLOEXEC, 0);
+    if (fd < 0) return FALSE;
+
+    GStatBuf st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return FALSE;
+    }
+    guint64 file_size = (guint64)st.st_size;
+    Mp4Scan scan;
+    scan_mp4(fd, file_size, &scan);
+
+    g_autofree gchar *name = g_path_get_basename(path);
+    gboolean recovered = FALSE;
+    if (!scan.has_moof) {
+        // 非分片文件：moov 在结束时才写入，只剩 mdat 时无法恢复
+        if (!scan.has_moov && file_size > 0) {
+            g_printerr("Recovery: %s has no moov and no fragments and cannot be repaired.\n", name);
+        }
+    } else if (!scan.has_mfra || scan.truncated || scan.good_end < file_size) {
+        if (!scan.has_moov || scan.fragments == 0) {
+            g_printerr("Recovery: %s has no complete fragment.\n", name);
+        } else if (ftruncate(fd, (off_t)scan.good_end) != 0 || !write_empty_mfra(fd, scan.good_end) || fdatasync(fd) != 0) {
+            g_printerr("Recovery: could not truncate %s: %s\n", name, g_strerror(errno));
+        } else {
+            g_print("Recovery: repaired %s, kept %" G_GUINT64_FORMAT " fragments (%.1f MB), dropped %.1f KB.\n",
+                    name, scan.fragments, scan.good_end / 1e6, (file_size - scan.good_end) / 1e3);
+            recovered = TRUE;
+        }
+    }
+    close(fd);
+    return recovered;
+}
+
+void crash_safe_recover(CustomData *data) {
+    dictionary *dict = data->config_dict;
+    if (!iniparser_getboolean(dict, "crash_safe:recover", 1)) {
+        return;
+    }
+
+    const char *record_path = iniparser_getstring(dict, "main:record_path", "/tmp");
+    g_autoptr(GDir) dir = g_dir_open(record_path, 0, NULL);
+    if (!dir) return;
+
+    const gchar *entry;
+    guint recovered = 0;
+    while ((entry = g_dir_read_name(dir)) != NULL) {
+        if (!g_str_has_suffix(entry, ".mp4") && !g_str_has_suffix(entry, ".mov") && !g_str_has_suffix(entry, ".m4v")) {
+            continue;
+        }
+        g_autofree gchar *path = g_build_filename(record_path, entry, NULL);
+        if (g_file_test(path, G_FILE_TEST_IS_REGULAR) && recover_file(path)) {
+            // 修复后的文件与正常结束的录制一样进入转码/迁移流程
+            transcode_enqueue(data, path);
+            recovered++;
+        }
+    }
+    if (recovered > 0) {
+        g_print("Recovery: %u unfinalized recording(s) repaired in %s.\n", recovered, record_path);
+    }
+}
+
+// 辅助函数：把编码好的 buffer 送入 muxer -> sink，返回耗时 (秒)，失败时返回负数
+static gdouble run_mux(dictionary *dict, GstCaps *caps, GPtrArray *buffers, const char *location,
+                       gboolean crash_safe, guint64 *bytes) {
+    const char *sink_factory = iniparser_getstring(dict, "main:record_sink", "fastfilesink");
+    g_autoptr(GstElement) pipeline = gst_pipeline_new("benchmark");
+    GstElement *src = gst_element_factory_make("appsrc", NULL);
+    GstElement *muxer = gst_element_factory_make("mp4mux", NULL);
+    GstElement *sink = gst_element_factory_make(sink_factory, NULL);
+    if (!src || !muxer || !sink) {
+        g_printerr("Benchmark: could not create appsrc/mp4mux/%s.\n", sink_factory);
+        if (src) gst_object_unref(src);
+        if (muxer) gst_object_unref(muxer);
+        if (sink) gst_object_unref(sink);
+        return -1;
+    }
+    gst_bin_add_many(GST_BIN(pipeline), src, muxer, sink, NULL);
+    if (!gst_element_link_many(src, muxer, sink, NULL)) {
+        return -1;
+    }
+
+    configure_element_from_ini(sink, dict, sink_factory);
+    g_object_set(G_OBJECT(src), "caps", caps, "format", GST_FORMAT_TIME, "block", TRUE, NULL);
+    g_object_set(G_OBJECT(sink), "location", location, NULL);
+    if (crash_safe) {
+        apply_settings(muxer, sink,
+                       (guint)MAX(iniparser_getint(dict, "crash_safe:fragment_duration", DEFAULT_FRAGMENT_DURATION), 100),
+                       iniparser_getint(dict, "crash_safe:sync_interval", DEFAULT_SYNC_INTERVAL));
+    }
+
+    gint64 start = g_get_monotonic_time();
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    for (guint i = 0; i < buffers->len; i++) {
+        gst_app_src_push_buffer(GST_APP_SRC(src), gst_buffer_ref(g_ptr_array_index(buffers, i)));
+    }
+    gst_app_src_end_of_stream(GST_APP_SRC(src));
+
+    g_autoptr(GstBus) bus = gst_element_get_bus(pipeline);
+    g_autoptr(GstMessage) msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+    // 关闭文件 (包括最后一次同步) 计入耗时
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gdouble elapsed = (g_get_monotonic_time() - start) / (gdouble)G_USEC_PER_SEC;
+
+    GStatBuf st;
+    *bytes = g_stat(location, &st) == 0 ? (guint64)st.st_size : 0;
+    g_unlink(location);
+    if (!msg || GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+        g_printerr("Benchmark: muxing failed.\n");
+        return -1;
+    }
+    return elapsed;
+}
+
+int crash_safe_benchmark(dictionary *dict) {
+    int frames = MAX(iniparser_getint(dict, "crash_safe:benchmark_frames", 600), 1);
+    int runs = MAX(iniparser_getint(dict, "crash_safe:benchmark_runs", 3), 1);
+    const char *record_path = iniparser_getstring(dict, "main:record_path", "/tmp");
+
+    // --- 1. 先把测试画面编码到内存中，只测量复用和写盘的开销 ---
+    g_autofree gchar *description = g_strdup_printf(
+        "videotestsrc num-buffers=%d pattern=smpte ! video/x-raw,width=1920,height=1080,framerate=60/1 ! "
+        "x264enc speed-preset=ultrafast bitrate=20000 key-int-max=60 ! h264parse ! appsink name=sink sync=false",
+        frames);
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GstElement) encode = gst_parse_launch(description, &error);
+    if (!encode) {
+        g_printerr("Benchmark: could not build the encoder pipeline: %s\n", error->message);
+        return 1;
+    }
+    g_autoptr(GstElement) appsink = gst_bin_get_by_name(GST_BIN(encode), "sink");
+    g_autoptr(GPtrArray) buffers = g_ptr_array_new_with_free_func((GDestroyNotify)gst_buffer_unref);
+    g_autoptr(GstCaps) caps = NULL;
+    gsize total = 0;
+
+    g_print("Benchmark: encoding %d frames...\n", frames);
+    gst_element_set_state(encode, GST_STATE_PLAYING);
+    GstSample *sample;
+    while ((sample = gst_app_sink_pull_sample(GST_APP_SINK(appsink))) != NULL) {
+        if (!caps) caps = gst_caps_ref(gst_sample_get_caps(sample));
+        GstBuffer *buffer = gst_sample_get_buffer(sample);
+        total += gst_buffer_get_size(buffer);
+        g_ptr_array_add(buffers, gst_buffer_ref(buffer));
+        gst_sample_unref(sample);
+    }
+    gst_element_set_state(encode, GST_STATE_NULL);
+    if (!caps || buffers->len == 0) {
+        g_printerr("Benchmark: no encoded frames.\n");
+        return 1;
+    }
+
+    // --- 2. 普通 mp4mux 与分片 + 定期同步各运行若干次，取最快的一次 ---
+    g_autofree gchar *location = g_build_filename(record_path, "benchmark-mux.mp4", NULL);
+    gdouble best[2] = { G_MAXDOUBLE, G_MAXDOUBLE };
+    guint64 bytes[2] = { 0, 0 };
+    for (int run = 0; run < runs; run++) {
+        for (int mode = 0; mode < 2; mode++) {
+            gdouble elapsed = run_mux(dict, caps, buffers, location, mode == 1, &bytes[mode]);
+            if (elapsed < 0) return 1;
+            best[mode] = MIN(best[mode], elapsed);
+        }
+    }
+
+    const char *labels[2] = { "plain mp4mux", "crash-safe" };
+    for (int mode = 0; mode < 2; mode++) {
+        g_print("Benchmark: %-12s %6.1f MB/s, %7.1f fps, file %.1f MB.\n", labels[mode],
+                total / 1e6 / best[mode], buffers->len / best[mode], bytes[mode] / 1e6);
+    }
+    g_print("Benchmark: crash-safe overhead %.1f%% throughput, %.1f%% size (fragment %d ms, sync %d ms, %s).\n",
+            (1.0 - best[0] / best[1]) * 100.0, bytes[0] ? ((gdouble)bytes[1] / bytes[0] - 1.0) * 100.0 : 0.0,
+            iniparser_getint(dict, "crash_safe:fragment_duration", DEFAULT_FRAGMENT_DURATION),
+            iniparser_getint(dict, "crash_safe:sync_interval", DEFAULT_SYNC_INTERVAL), record_path);
+    return 0;
+}
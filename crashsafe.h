@@ -0,0 +1,30 @@
+#ifndef CRASHSAFE_H
+#define CRASHSAFE_H
+
+#include "config.h"
+
+/*
+ * Put a recording muxer and its file sink into crash-safe mode when [crash_safe]
+ * enable is set: MP4 muxers write moof/mdat fragments of fragment_duration ms and
+ * the sink fdatasyncs every sync_interval ms (fastfilesink "sync-interval").
+ * Muxers without fragment support are left unchanged.
+ * muxer: Recording muxer.
+ * sink: File sink fed by the muxer, may be NULL.
+ */
+void crash_safe_apply(CustomData *data, GstElement *muxer, GstElement *sink);
+
+/*
+ * Scan main:record_path for fragmented MP4 recordings that were never finalized,
+ * truncate each one after its last complete fragment and hand it to
+ * transcode_enqueue(). Call at startup, after transcode_init().
+ */
+void crash_safe_recover(CustomData *data);
+
+/*
+ * Encode a synthetic clip once, then mux it repeatedly with plain and crash-safe
+ * mp4mux into main:record_path and print throughput and overhead.
+ * Returns: Process exit status.
+ */
+int crash_safe_benchmark(dictionary *dict);
+
+#endif // CRASHSAFE_H
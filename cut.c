@@ -0,0 +1,227 @@
+#include "utils.h"
+#include "config.h"
+#include "cut.h"
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+#include <gst/video/video.h>
+
+enum { CUT_VIDEO, CUT_AUDIO };
+
+struct _RecordCut {
+    CustomData *data;
+    GstPad *pads[2];                    /* video_tee / audio_tee 的请求 pad */
+    gulong probe_ids[2];
+    GstClockTime start;                 /* 第一帧的运行时间下限，0 表示下一帧 */
+    guint64 stop;                       /* 结束的运行时间，未安排时为 GST_CLOCK_TIME_NONE，主线程写、流线程读 */
+
+    /* 只由各自的流线程访问 */
+    gboolean started[2];
+    gboolean stopped[2];
+
+    guint64 first_running_time;
+    guint64 first_pts;
+    guint64 first_frame_time;           /* 第一帧通过探针的时刻 (单调时钟, 微秒) */
+};
+
+// 辅助函数：根据 pad 上的 segment 计算 buffer 的运行时间
+static GstClockTime buffer_running_time(GstPad *pad, GstBuffer *buffer) {
+    if (!GST_BUFFER_PTS_IS_VALID(buffer)) return GST_CLOCK_TIME_NONE;
+
+    g_autoptr(GstEvent) event = gst_pad_get_sticky_event(pad, GST_EVENT_SEGMENT, 0);
+    if (!event) return GST_CLOCK_TIME_NONE;
+    const GstSegment *segment;
+    gst_event_parse_segment(event, &segment);
+    return gst_segment_to_running_time(segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+}
+
+// 主循环回调：与 stop_recording() 相同，向录制 bin 发送 EOS 后释放 tee pad
+static void finish_stream(CustomData *data, const char *ghost_name, GstElement *tee, GstPad **tee_pad) {
+    if (!data->is_stopping_recording) {
+        g_print("Stopping recording at the scheduled cut...\n");
+        data->is_stopping_recording = TRUE;
+        data->record_stop_time = g_get_monotonic_time();
+        if (data->record_icon) {
+            gtk_image_set_from_icon_name(GTK_IMAGE(data->record_icon), "media-record-symbolic", GTK_ICON_SIZE_SMALL_TOOLBAR);
+        }
+    }
+    if (data->recording_bin) {
+        g_autoptr(GstPad) ghost = gst_element_get_static_pad(data->recording_bin, ghost_name);
+        if (ghost) {
+            gst_pad_send_event(ghost, gst_event_new_eos());
+        }
+    }
+    if (*tee_pad && tee) {
+        gst_element_release_request_pad(tee, *tee_pad);
+        *tee_pad = NULL;
+    }
+}
+
+static gboolean on_video_stopped(gpointer user_data) {
+    CustomData *data = (CustomData *)user_data;
+    finish_stream(data, "videosink", data->video_tee, &data->video_tee_q_pad);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean on_audio_stopped(gpointer user_data) {
+    CustomData *data = (CustomData *)user_data;
+    finish_stream(data, "audiosink", data->audio_tee, &data->audio_tee_q_pad);
+    return G_SOURCE_REMOVE;
+}
+
+// 辅助函数：到达结束点后丢弃该流之后的所有 buffer，EOS 由主循环发送
+static GstPadProbeReturn stop_stream(RecordCut *cut, int stream) {
+    cut->stopped[stream] = TRUE;
+    g_idle_add(stream == CUT_VIDEO ? on_video_stopped : on_audio_stopped, cut->data);
+    return GST_PAD_PROBE_DROP;
+}
+
+// 探针回调：视频按帧切分，第一帧之前插入强制关键帧事件
+static GstPadProbeReturn video_cut_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    RecordCut *cut = (RecordCut *)user_data;
+    if (cut->stopped[CUT_VIDEO]) return GST_PAD_PROBE_DROP;
+
+    guint64 stop = counter_get(&cut->stop);
+    if (cut->started[CUT_VIDEO] && stop == GST_CLOCK_TIME_NONE) return GST_PAD_PROBE_OK;
+
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    GstClockTime running_time = buffer_running_time(pad, buffer);
+    if (!GST_CLOCK_TIME_IS_VALID(running_time)) {
+        return cut->started[CUT_VIDEO] ? GST_PAD_PROBE_OK : GST_PAD_PROBE_DROP;
+    }
+
+    if (stop != GST_CLOCK_TIME_NONE && running_time >= stop) {
+        return stop_stream(cut, CUT_VIDEO);
+    }
+    if (!cut->started[CUT_VIDEO]) {
+        if (running_time < cut->start) return GST_PAD_PROBE_DROP;
+
+        cut->started[CUT_VIDEO] = TRUE;
+        counter_set(&cut->first_running_time, running_time);
+        counter_set(&cut->first_pts, GST_BUFFER_PTS(buffer));
+        counter_set(&cut->first_frame_time, g_get_monotonic_time());
+        gst_pad_push_event(pad, gst_video_event_new_downstream_force_key_unit(GST_BUFFER_PTS(buffer),
+                                                                              GST_CLOCK_TIME_NONE, running_time, TRUE, 0));
+#ifdef DEBUG
+        g_print("Recording cut in at running time %" GST_TIME_FORMAT ".\n", GST_TIME_ARGS(running_time));
+#endif
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+// 辅助函数：只保留运行时间 [from, to) 内的音频采样，全部在范围外时返回 NULL
+static GstBuffer *trim_audio(GstPad *pad, GstBuffer *buffer, GstClockTime running_time, GstClockTime from, GstClockTime to) {
+    g_autoptr(GstCaps) caps = gst_pad_get_current_caps(pad);
+    GstAudioInfo audio_info;
+    if (!caps || !gst_audio_info_from_caps(&audio_info, caps) || GST_AUDIO_INFO_BPF(&audio_info) == 0) {
+        // 非原始音频无法按采样切分，按整个 buffer 判断
+        return (running_time >= from && (to == GST_CLOCK_TIME_NONE || running_time < to)) ? buffer : NULL;
+    }
+
+    gint rate = GST_AUDIO_INFO_RATE(&audio_info);
+    gint bpf = GST_AUDIO_INFO_BPF(&audio_info);
+    guint64 samples = gst_buffer_get_size(buffer) / bpf;
+    guint64 head = from > running_time ? gst_util_uint64_scale_round(from - running_time, rate, GST_SECOND) : 0;
+    guint64 tail = samples;
+    if (to != GST_CLOCK_TIME_NONE) {
+        tail = to > running_time ? MIN(gst_util_uint64_scale_round(to - running_time, rate, GST_SECOND), samples) : 0;
+    }
+    if (head >= tail) return NULL;
+    if (head == 0 && tail == samples) return buffer;
+
+    GstBuffer *trimmed = gst_buffer_copy_region(buffer, GST_BUFFER_COPY_ALL, head * bpf, (tail - head) * bpf);
+    GST_BUFFER_PTS(trimmed) = GST_BUFFER_PTS(buffer) + gst_util_uint64_scale_int(head, GST_SECOND, rate);
+    GST_BUFFER_DURATION(trimmed) = gst_util_uint64_scale_int(tail - head, GST_SECOND, rate);
+    gst_buffer_unref(buffer);
+    return trimmed;
+}
+
+// 探针回调：音频在同一运行时间按采样裁剪
+static GstPadProbeReturn audio_cut_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    RecordCut *cut = (RecordCut *)user_data;
+    if (cut->stopped[CUT_AUDIO]) return GST_PAD_PROBE_DROP;
+
+    guint64 stop = counter_get(&cut->stop);
+    if (cut->started[CUT_AUDIO] && stop == GST_CLOCK_TIME_NONE) return GST_PAD_PROBE_OK;
+
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    GstClockTime running_time = buffer_running_time(pad, buffer);
+    if (!GST_CLOCK_TIME_IS_VALID(running_time)) {
+        return cut->started[CUT_AUDIO] ? GST_PAD_PROBE_OK : GST_PAD_PROBE_DROP;
+    }
+
+    if (stop != GST_CLOCK_TIME_NONE && running_time >= stop) {
+        return stop_stream(cut, CUT_AUDIO);
+    }
+
+    GstClockTime from = cut->started[CUT_AUDIO] ? 0 : cut->start;
+    GstBuffer *trimmed = trim_audio(pad, buffer, running_time, from, stop);
+    if (!trimmed) {
+        return GST_PAD_PROBE_DROP;
+    }
+    cut->started[CUT_AUDIO] = TRUE;
+    GST_PAD_PROBE_INFO_DATA(info) = trimmed;
+    return GST_PAD_PROBE_OK;
+}
+
+void record_cut_attach(CustomData *data, GstPad *video_pad, GstPad *audio_pad, GstClockTime start) {
+    record_cut_free(data);
+
+    RecordCut *cut = g_new0(RecordCut, 1);
+    cut->data = data;
+    cut->start = GST_CLOCK_TIME_IS_VALID(start) ? start : 0;
+    cut->stop = GST_CLOCK_TIME_NONE;
+    cut->first_running_time = cut->first_pts = GST_CLOCK_TIME_NONE;
+    cut->pads[CUT_VIDEO] = gst_object_ref(video_pad);
+    cut->pads[CUT_AUDIO] = gst_object_ref(audio_pad);
+    cut->probe_ids[CUT_VIDEO] = gst_pad_add_probe(video_pad, GST_PAD_PROBE_TYPE_BUFFER, video_cut_probe, cut, NULL);
+    cut->probe_ids[CUT_AUDIO] = gst_pad_add_probe(audio_pad, GST_PAD_PROBE_TYPE_BUFFER, audio_cut_probe, cut, NULL);
+    data->record_cut = cut;
+
+    if (GST_CLOCK_TIME_IS_VALID(start)) {
+        g_print("Recording scheduled to start at running time %" GST_TIME_FORMAT ".\n", GST_TIME_ARGS(start));
+    }
+}
+
+gboolean record_cut_schedule_stop(CustomData *data, GstClockTime stop) {
+    RecordCut *cut = data->record_cut;
+    if (!cut || !GST_CLOCK_TIME_IS_VALID(stop)) return FALSE;
+
+    counter_set(&cut->stop, stop);
+    g_print("Recording scheduled to stop at running time %" GST_TIME_FORMAT ".\n", GST_TIME_ARGS(stop));
+    return TRUE;
+}
+
+GstClockTime record_cut_running_time(CustomData *data, gint64 real_time) {
+    if (!data->pipeline) return GST_CLOCK_TIME_NONE;
+    g_autoptr(GstClock) clock = gst_element_get_clock(data->pipeline);
+    if (!clock) return GST_CLOCK_TIME_NONE;
+
+    GstClockTime now = gst_clock_get_time(clock);
+    GstClockTime base_time = gst_element_get_base_time(data->pipeline);
+    gint64 running_time = (gint64)(now - base_time) + (real_time - g_get_real_time()) * GST_USECOND;
+    return (GstClockTime)MAX(running_time, 0);
+}
+
+GstClockTime record_cut_first_running_time(CustomData *data) {
+    return data->record_cut ? counter_get(&data->record_cut->first_running_time) : GST_CLOCK_TIME_NONE;
+}
+
+GstClockTime record_cut_first_pts(CustomData *data) {
+    return data->record_cut ? counter_get(&data->record_cut->first_pts) : GST_CLOCK_TIME_NONE;
+}
+
+gint64 record_cut_first_frame_time(CustomData *data) {
+    return data->record_cut ? (gint64)counter_get(&data->record_cut->first_frame_time) : 0;
+}
+
+void record_cut_free(CustomData *data) {
+    RecordCut *cut = g_steal_pointer(&data->record_cut);
+    if (!cut) return;
+
+    // pad 可能已经从 tee 释放，持有的引用保证移除探针是安全的
+    for (int i = 0; i < 2; i++) {
+        gst_pad_remove_probe(cut->pads[i], cut->probe_ids[i]);
+        gst_object_unref(cut->pads[i]);
+    }
+    g_free(cut);
+}
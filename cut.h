@@ -0,0 +1,45 @@
+#ifndef CUT_H
+#define CUT_H
+
+#include "config.h"
+
+/*
+ * Install the cut probes on the tee src pads that feed a new recording bin, before
+ * they are linked. Video buffers are passed from the first frame whose running time
+ * is at or after start, preceded by a force-key-unit event for the encoder; raw audio
+ * is trimmed to the same instant at sample accuracy.
+ * video_pad, audio_pad: Request pads of video_tee and audio_tee.
+ * start: Running time of the first frame, or GST_CLOCK_TIME_NONE for the next frame.
+ */
+void record_cut_attach(CustomData *data, GstPad *video_pad, GstPad *audio_pad, GstClockTime start);
+
+/*
+ * Stop the current recording at a running time. The last video frame is the one
+ * before stop and audio is trimmed to it; later buffers are dropped and each stream
+ * gets EOS and has its tee pad released on the main loop, as stop_recording() does.
+ * Returns: FALSE if no cut probes are installed (e.g. pre-roll mode).
+ */
+gboolean record_cut_schedule_stop(CustomData *data, GstClockTime stop);
+
+/*
+ * Convert a wall-clock instant (g_get_real_time() microseconds) to pipeline running
+ * time. Returns GST_CLOCK_TIME_NONE if the pipeline has no clock yet.
+ */
+GstClockTime record_cut_running_time(CustomData *data, gint64 real_time);
+
+/*
+ * Running time and PTS of the first video frame of the current recording, or
+ * GST_CLOCK_TIME_NONE while it has not passed the cut yet.
+ */
+GstClockTime record_cut_first_running_time(CustomData *data);
+GstClockTime record_cut_first_pts(CustomData *data);
+
+/*
+ * Monotonic time (g_get_monotonic_time()) at which the first video frame passed
+ * the cut, or 0 while it has not.
+ */
+gint64 record_cut_first_frame_time(CustomData *data);
+
+void record_cut_free(CustomData *data);
+
+#endif // CUT_H
@@ -0,0 +1,257 @@
+#include "utils.h"
+#include "config.h"
+#include "encctl.h"
+#include "recqueue.h"
+#include <gst/gst.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <iniparser.h>
+
+/* 一个可调节的编码器属性，格式为 "最小值:最大值:压力下的步长" */
+typedef struct {
+    gchar *property;
+    gint64 min;
+    gint64 max;
+    gint64 step;                        /* 符号表示压力下的调整方向，如 bitrate 为负 */
+    gint64 value;                       /* 当前值 */
+    gboolean usable;                    /* 编码器存在该属性且允许在 PLAYING 状态下修改 */
+} EncoderKnob;
+
+struct _EncoderController {
+    GArray *knobs;                      /* EncoderKnob，按压力下的调节顺序排列 */
+    gdouble high_watermark;
+    gdouble low_watermark;
+    guint headroom_ticks;               /* 连续多少个周期有余量才回调一级 */
+    guint timer_id;
+    gdouble interval;                   /* 采样周期 (秒) */
+
+    GstElement *encoder;
+
+    /* 由流线程无锁更新 */
+    guint64 in_frames;
+    guint64 out_frames;
+    guint64 out_bytes;
+
+    guint64 last_in_frames;
+    guint64 last_out_frames;
+    guint64 last_out_bytes;
+    guint calm_ticks;
+};
+
+static const char *reserved_keys[] = { "enable", "interval", "high", "low", "headroom-ticks" };
+
+static gboolean is_reserved_key(const char *key) {
+    for (guint i = 0; i < G_N_ELEMENTS(reserved_keys); i++) {
+        if (strcmp(key, reserved_keys[i]) == 0) return TRUE;
+    }
+    return FALSE;
+}
+
+// 辅助函数：把整数、枚举类型的属性读取为 gint64
+static gboolean get_property_as_int64(GstElement *element, GParamSpec *pspec, gint64 *out) {
+    GValue value = G_VALUE_INIT;
+    GType type = G_PARAM_SPEC_VALUE_TYPE(pspec);
+    gboolean ok = TRUE;
+
+    g_value_init(&value, type);
+    g_object_get_property(G_OBJECT(element), pspec->name, &value);
+
+    if (G_TYPE_IS_ENUM(type)) {
+        *out = g_value_get_enum(&value);
+    } else if (type == G_TYPE_INT) {
+        *out = g_value_get_int(&value);
+    } else if (type == G_TYPE_UINT) {
+        *out = g_value_get_uint(&value);
+    } else if (type == G_TYPE_INT64) {
+        *out = g_value_get_int64(&value);
+    } else if (type == G_TYPE_UINT64) {
+        *out = (gint64)g_value_get_uint64(&value);
+    } else if (type == G_TYPE_LONG) {
+        *out = g_value_get_long(&value);
+    } else if (type == G_TYPE_ULONG) {
+        *out = (gint64)g_value_get_ulong(&value);
+    } else {
+        ok = FALSE;
+    }
+    g_value_unset(&value);
+    return ok;
+}
+
+static GstPadProbeReturn encoder_in_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    counter_add(&((EncoderController *)user_data)->in_frames, 1);
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn encoder_out_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    EncoderController *ctl = (EncoderController *)user_data;
+    counter_add(&ctl->out_frames, 1);
+    counter_add(&ctl->out_bytes, gst_buffer_get_size(GST_PAD_PROBE_INFO_BUFFER(info)));
+    return GST_PAD_PROBE_OK;
+}
+
+// 辅助函数：把一个属性向 direction 方向 (+1 压力, -1 回调) 调整一级，到达边界时返回 FALSE
+static gboolean step_knob(EncoderController *ctl, EncoderKnob *knob, int direction) {
+    gint64 next = knob->value + direction * knob->step;
+    next = CLAMP(next, knob->min, knob->max);
+    if (!knob->usable || next == knob->value) {
+        return FALSE;
+    }
+
+    char value_str[32];
+    snprintf(value_str, sizeof(value_str), "%" G_GINT64_FORMAT, next);
+    set_element_property(ctl->encoder, knob->property, value_str);
+
+    g_print("Encoder control: %s %" G_GINT64_FORMAT " -> %" G_GINT64_FORMAT " (%s).\n",
+            knob->property, knob->value, next, direction > 0 ? "under pressure" : "headroom");
+    knob->value = next;
+    return TRUE;
+}
+
+static gboolean control_timeout(gpointer user_data) {
+    CustomData *data = (CustomData *)user_data;
+    EncoderController *ctl = data->encoder_control;
+    if (!ctl->encoder || !data->is_recording) return G_SOURCE_CONTINUE;
+
+    guint64 in_frames = counter_get(&ctl->in_frames);
+    guint64 out_frames = counter_get(&ctl->out_frames);
+    guint64 out_bytes = counter_get(&ctl->out_bytes);
+    gdouble in_fps = (in_frames - ctl->last_in_frames) / ctl->interval;
+    gdouble out_fps = (out_frames - ctl->last_out_frames) / ctl->interval;
+    gdouble out_kbps = (out_bytes - ctl->last_out_bytes) * 8.0 / 1000.0 / ctl->interval;
+    ctl->last_in_frames = in_frames;
+    ctl->last_out_frames = out_frames;
+    ctl->last_out_bytes = out_bytes;
+
+    gdouble fill = record_queue_guard_fill(data);
+    gboolean pressure = fill >= ctl->high_watermark || (in_fps > 0 && out_fps < in_fps * 0.95 && fill > ctl->low_watermark);
+    gboolean headroom = fill <= ctl->low_watermark && out_fps >= in_fps * 0.98;
+
+#ifdef DEBUG
+    g_print("Encoder control: queue %.0f%%, in %.1f fps, out %.1f fps, %.0f kbit/s.\n",
+            fill * 100.0, in_fps, out_fps, out_kbps);
+#endif
+
+    if (pressure) {
+        ctl->calm_ticks = 0;
+        // 按配置顺序，找到第一个还能继续降低开销的属性
+        for (guint i = 0; i < ctl->knobs->len; i++) {
+            if (step_knob(ctl, &g_array_index(ctl->knobs, EncoderKnob, i), 1)) {
+                g_print("Encoder control: queue %.0f%%, in %.1f fps, out %.1f fps, %.0f kbit/s.\n",
+                        fill * 100.0, in_fps, out_fps, out_kbps);
+                break;
+            }
+        }
+    } else if (headroom && ++ctl->calm_ticks >= ctl->headroom_ticks) {
+        ctl->calm_ticks = 0;
+        // 反向逐级恢复：最后被降低的属性最先恢复
+        for (guint i = ctl->knobs->len; i > 0; i--) {
+            EncoderKnob *knob = &g_array_index(ctl->knobs, EncoderKnob, i - 1);
+            if (step_knob(ctl, knob, -1)) break;
+        }
+    } else if (!headroom) {
+        ctl->calm_ticks = 0;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static void knob_clear(gpointer p) {
+    g_free(((EncoderKnob *)p)->property);
+}
+
+void encoder_control_init(CustomData *data) {
+    dictionary *dict = data->config_dict;
+    if (!iniparser_getboolean(dict, "encoder_control:enable", 0)) {
+        return;
+    }
+
+    EncoderController *ctl = g_new0(EncoderController, 1);
+    ctl->knobs = g_array_new(FALSE, TRUE, sizeof(EncoderKnob));
+    g_array_set_clear_func(ctl->knobs, knob_clear);
+    ctl->high_watermark = iniparser_getdouble(dict, "encoder_control:high", 0.5);
+    ctl->low_watermark = iniparser_getdouble(dict, "encoder_control:low", 0.1);
+    ctl->headroom_ticks = MAX(iniparser_getint(dict, "encoder_control:headroom-ticks", 10), 1);
+    int interval_ms = MAX(iniparser_getint(dict, "encoder_control:interval", 500), 50);
+    ctl->interval = interval_ms / 1000.0;
+
+    // 除保留键外，每个键都是一个编码器属性
+    int num_keys = iniparser_getsecnkeys(dict, "encoder_control");
+    const char **keys = g_newa(const char *, MAX(num_keys, 1));
+    if (num_keys > 0 && iniparser_getseckeys(dict, "encoder_control", keys)) {
+        for (int i = 0; i < num_keys; i++) {
+            const char *key_name = strchr(keys[i], ':');
+            if (!key_name || is_reserved_key(++key_name)) continue;
+
+            EncoderKnob knob = { 0 };
+            const char *value_str = iniparser_getstring(dict, keys[i], "");
+            if (sscanf(value_str, "%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT,
+                       &knob.min, &knob.max, &knob.step) != 3 || knob.min > knob.max || knob.step == 0) {
+                g_printerr("Warning: Invalid encoder_control entry %s=%s (expected min:max:step).\n", key_name, value_str);
+                continue;
+            }
+            knob.property = g_strdup(key_name);
+            g_array_append_val(ctl->knobs, knob);
+        }
+    }
+
+    if (ctl->knobs->len == 0) {
+        g_printerr("Warning: encoder_control is enabled but no properties are configured.\n");
+    }
+    ctl->timer_id = g_timeout_add(interval_ms, control_timeout, data);
+    data->encoder_control = ctl;
+}
+
+void encoder_control_attach(CustomData *data, GstElement *encoder) {
+    EncoderController *ctl = data->encoder_control;
+    if (!ctl || !encoder) return;
+
+    encoder_control_detach(data);
+    ctl->encoder = gst_object_ref(encoder);
+    ctl->last_in_frames = counter_get(&ctl->in_frames);
+    ctl->last_out_frames = counter_get(&ctl->out_frames);
+    ctl->last_out_bytes = counter_get(&ctl->out_bytes);
+    ctl->calm_ticks = 0;
+
+    for (guint i = 0; i < ctl->knobs->len; i++) {
+        EncoderKnob *knob = &g_array_index(ctl->knobs, EncoderKnob, i);
+        GParamSpec *pspec = g_object_class_find_property(G_OBJECT_GET_CLASS(encoder), knob->property);
+
+        knob->usable = pspec && (pspec->flags & GST_PARAM_MUTABLE_PLAYING) &&
+                       get_property_as_int64(encoder, pspec, &knob->value);
+        if (!knob->usable) {
+            g_printerr("Warning: %s has no integer property '%s' that can change while PLAYING. Not controlled.\n",
+                       GST_OBJECT_NAME(encoder), knob->property);
+            continue;
+        }
+        // 起始值超出范围时先拉回边界内
+        if (knob->value < knob->min || knob->value > knob->max) {
+            knob->value = CLAMP(knob->value, knob->min, knob->max);
+            char value_str[32];
+            snprintf(value_str, sizeof(value_str), "%" G_GINT64_FORMAT, knob->value);
+            set_element_property(encoder, knob->property, value_str);
+        }
+    }
+
+    g_autoptr(GstPad) sink_pad = gst_element_get_static_pad(encoder, "sink");
+    g_autoptr(GstPad) src_pad = gst_element_get_static_pad(encoder, "src");
+    if (sink_pad) gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, encoder_in_probe, ctl, NULL);
+    if (src_pad) gst_pad_add_probe(src_pad, GST_PAD_PROBE_TYPE_BUFFER, encoder_out_probe, ctl, NULL);
+}
+
+void encoder_control_detach(CustomData *data) {
+    EncoderController *ctl = data->encoder_control;
+    if (!ctl) return;
+    g_clear_object(&ctl->encoder);
+}
+
+void encoder_control_free(CustomData *data) {
+    EncoderController *ctl = g_steal_pointer(&data->encoder_control);
+    if (!ctl) return;
+
+    if (ctl->timer_id > 0) {
+        g_source_remove(ctl->timer_id);
+    }
+    g_clear_object(&ctl->encoder);
+    g_array_unref(ctl->knobs);
+    g_free(ctl);
+}
@@ -0,0 +1,26 @@
+#ifndef ENCCTL_H
+#define ENCCTL_H
+
+#include "config.h"
+
+/*
+ * Parse [encoder_control] and start the controller timer if enabled.
+ * data: Pointer to the CustomData structure.
+ */
+void encoder_control_init(CustomData *data);
+
+/*
+ * Start steering a recording video encoder: count its input/output and read the
+ * current value of every configured property.
+ * encoder: The record-video-encoder element.
+ */
+void encoder_control_attach(CustomData *data, GstElement *encoder);
+
+/*
+ * Stop steering the encoder of a recording that has been torn down.
+ */
+void encoder_control_detach(CustomData *data);
+
+void encoder_control_free(CustomData *data);
+
+#endif // ENCCTL_H
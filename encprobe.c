@@ -0,0 +1,178 @@
+#include "utils.h"
+#include "config.h"
+#include "encprobe.h"
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <iniparser.h>
+
+#define DEFAULT_CANDIDATES "vaapih264enc,vah264enc,vaapih265enc,vah265enc,vaapivp9enc,vavp9enc,x264enc,x265enc,vp9enc,svtav1enc"
+#define CACHE_GROUP "encoder-probe"
+
+// 辅助函数：计算候选编码器所在插件的指纹，插件增删或升级后缓存自动失效
+static gchar *registry_fingerprint(gchar **candidates, const char *caps_str, int frames) {
+    g_autoptr(GChecksum) checksum = g_checksum_new(G_CHECKSUM_SHA1);
+    g_checksum_update(checksum, (const guchar *)caps_str, -1);
+    g_checksum_update(checksum, (const guchar *)&frames, sizeof(frames));
+
+    for (int i = 0; candidates[i] != NULL; i++) {
+        g_checksum_update(checksum, (const guchar *)candidates[i], -1);
+
+        g_autoptr(GstPluginFeature) feature = gst_registry_lookup_feature(gst_registry_get(), candidates[i]);
+        if (!feature) continue;
+
+        g_autoptr(GstPlugin) plugin = gst_plugin_feature_get_plugin(feature);
+        if (!plugin) continue;
+
+        const gchar *filename = gst_plugin_get_filename(plugin);
+        const gchar *version = gst_plugin_get_version(plugin);
+        GStatBuf st;
+        gint64 mtime = (filename && g_stat(filename, &st) == 0) ? (gint64)st.st_mtime : 0;
+        g_autofree gchar *entry = g_strdup_printf("%s|%s|%" G_GINT64_FORMAT,
+                                                   filename ? filename : "", version ? version : "", mtime);
+        g_checksum_update(checksum, (const guchar *)entry, -1);
+    }
+    return g_strdup(g_checksum_get_string(checksum));
+}
+
+// 辅助函数：用合成画面测试一个编码器，返回实时倍率 (编码速度 / 帧率)，失败返回 0
+static gdouble probe_encoder(CustomData *data, const char *encoder_name, const char *caps_str, int frames) {
+    g_autoptr(GstCaps) caps = gst_caps_from_string(caps_str);
+    gint fps_n = 30, fps_d = 1;
+    if (caps && gst_caps_get_size(caps) > 0) {
+        gst_structure_get_fraction(gst_caps_get_structure(caps, 0), "framerate", &fps_n, &fps_d);
+    }
+
+    g_autofree gchar *description = g_strdup_printf(
+        "videotestsrc num-buffers=%d pattern=ball ! capsfilter name=probe-caps ! videoconvert ! "
+        "%s name=probe-encoder ! fakesink sync=false", frames, encoder_name);
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GstElement) pipeline = gst_parse_launch(description, &error);
+    if (!pipeline || error) {
+        g_printerr("Encoder probe: %s unavailable (%s).\n", encoder_name, error ? error->message : "unknown error");
+        return 0.0;
+    }
+
+    g_autoptr(GstElement) capsfilter = gst_bin_get_by_name(GST_BIN(pipeline), "probe-caps");
+    g_autoptr(GstElement) encoder = gst_bin_get_by_name(GST_BIN(pipeline), "probe-encoder");
+    g_object_set(G_OBJECT(capsfilter), "caps", caps, NULL);
+    configure_element_from_ini(encoder, data->config_dict, encoder_name);
+
+    gint64 start = g_get_monotonic_time();
+    gdouble realtime_factor = 0.0;
+    if (gst_element_set_state(pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE) {
+        // 最多等待素材时长的 10 倍，慢到这种程度的编码器已经没有意义
+        GstClockTime timeout = gst_util_uint64_scale(frames * 10, fps_d * GST_SECOND, fps_n);
+        g_autoptr(GstBus) bus = gst_element_get_bus(pipeline);
+        g_autoptr(GstMessage) msg = gst_bus_timed_pop_filtered(bus, timeout, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+
+        if (msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS) {
+            gdouble elapsed = (g_get_monotonic_time() - start) / (gdouble)G_USEC_PER_SEC;
+            gdouble duration = (gdouble)frames * fps_d / fps_n;
+            realtime_factor = duration / MAX(elapsed, 1e-6);
+        } else if (msg) {
+            g_autoptr(GError) err = NULL;
+            gst_message_parse_error(msg, &err, NULL);
+            g_printerr("Encoder probe: %s failed (%s).\n", encoder_name, err->message);
+        } else {
+            g_printerr("Encoder probe: %s timed out.\n", encoder_name);
+        }
+    }
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    return realtime_factor;
+}
+
+void encoder_probe_run(CustomData *data) {
+    dictionary *dict = data->config_dict;
+    const char *configured = iniparser_getstring(dict, "main:encoder", "x264enc");
+
+    g_free(data->video_encoder);
+    data->video_encoder = g_strdup(configured);
+    if (!iniparser_getboolean(dict, "encoder_probe:enable", 0)) {
+        return;
+    }
+
+    const char *caps_str = iniparser_getstring(dict, "capsfilter:caps", "video/x-raw, width=1920, height=1080, framerate=30/1");
+    const char *candidates_str = iniparser_getstring(dict, "encoder_probe:candidates", DEFAULT_CANDIDATES);
+    int frames = MAX(iniparser_getint(dict, "encoder_probe:frames", 120), 10);
+    gdouble margin = iniparser_getdouble(dict, "encoder_probe:margin", 1.1);
+
+    g_auto(GStrv) candidates = g_strsplit(candidates_str, ",", -1);
+    for (int i = 0; candidates[i] != NULL; i++) {
+        g_strstrip(candidates[i]);
+    }
+
+    // --- 1. 读取缓存 ---
+    g_autofree gchar *fingerprint = registry_fingerprint(candidates, caps_str, frames);
+    g_autofree gchar *cache_dir = g_build_filename(g_get_user_cache_dir(), "gst-capture", NULL);
+    g_autofree gchar *cache_file = g_build_filename(cache_dir, "encoder-probe.ini", NULL);
+    g_autoptr(GKeyFile) cache = g_key_file_new();
+
+    if (g_key_file_load_from_file(cache, cache_file, G_KEY_FILE_NONE, NULL)) {
+        g_autofree gchar *cached_key = g_key_file_get_string(cache, CACHE_GROUP, "fingerprint", NULL);
+        g_autofree gchar *cached_encoder = g_key_file_get_string(cache, CACHE_GROUP, "encoder", NULL);
+        if (cached_encoder && g_strcmp0(cached_key, fingerprint) == 0) {
+            g_print("Encoder probe: using cached choice %s.\n", cached_encoder);
+            g_free(data->video_encoder);
+            data->video_encoder = g_steal_pointer(&cached_encoder);
+            return;
+        }
+    }
+
+    // --- 2. 逐个测试候选编码器 ---
+    g_key_file_remove_group(cache, CACHE_GROUP, NULL);
+    const char *chosen = NULL;
+    const char *fastest = NULL;
+    gdouble fastest_factor = 0.0;
+
+    for (int i = 0; candidates[i] != NULL; i++) {
+        if (candidates[i][0] == '\0') continue;
+
+        g_autoptr(GstElementFactory) factory = gst_element_factory_find(candidates[i]);
+        if (!factory) {
+#ifdef DEBUG
+            g_print("Encoder probe: %s not installed.\n", candidates[i]);
+#endif
+            continue;
+        }
+
+        gdouble factor = probe_encoder(data, candidates[i], caps_str, frames);
+        g_print("Encoder probe: %s realtime factor %.2f.\n", candidates[i], factor);
+        g_key_file_set_double(cache, CACHE_GROUP, candidates[i], factor);
+
+        if (factor > fastest_factor) {
+            fastest_factor = factor;
+            fastest = candidates[i];
+        }
+        // 候选列表按偏好排序，第一个能跟上帧率的即为结果
+        if (factor >= margin) {
+            chosen = candidates[i];
+            break;
+        }
+    }
+
+    if (!chosen && fastest) {
+        g_printerr("Warning: No encoder sustains the capture frame rate. Using the fastest, %s (%.2fx).\n",
+                   fastest, fastest_factor);
+        chosen = fastest;
+    }
+    if (!chosen) {
+        g_printerr("Warning: Encoder probe found no usable encoder. Keeping %s.\n", configured);
+        return;
+    }
+
+    g_print("Encoder probe: selected %s.\n", chosen);
+    g_free(data->video_encoder);
+    data->video_encoder = g_strdup(chosen);
+
+    // --- 3. 写入缓存 ---
+    g_key_file_set_string(cache, CACHE_GROUP, "fingerprint", fingerprint);
+    g_key_file_set_string(cache, CACHE_GROUP, "encoder", chosen);
+    g_autoptr(GError) error = NULL;
+    if (g_mkdir_with_parents(cache_dir, 0755) != 0 || !g_key_file_save_to_file(cache, cache_file, &error)) {
+        g_printerr("Warning: Could not save encoder probe cache %s: %s\n", cache_file,
+                   error ? error->message : g_strerror(errno));
+    }
+}
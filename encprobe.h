@@ -0,0 +1,15 @@
+#ifndef ENCPROBE_H
+#define ENCPROBE_H
+
+#include "config.h"
+
+/*
+ * Pick the recording video encoder. Without [encoder_probe] enable=TRUE this is
+ * main:encoder. Otherwise each candidate factory encodes a short burst of synthetic
+ * frames at the [capsfilter] caps, and the first one whose realtime factor reaches
+ * the configured margin is used. Results are cached per plugin registry state.
+ * data: Pointer to the CustomData structure; data->video_encoder is set on return.
+ */
+void encoder_probe_run(CustomData *data);
+
+#endif // ENCPROBE_H
@@ -0,0 +1,557 @@
+#define _GNU_SOURCE
+#include "fastsink.h"
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define DIRECT_ALIGN 4096
+#define BATCH_COUNT 4
+
+#define DEFAULT_EXTENT (64 * 1024 * 1024)
+#define DEFAULT_BATCH_SIZE (4 * 1024 * 1024)
+#define DEFAULT_DIRECT FALSE
+#define DEFAULT_SYNC_INTERVAL 0
+
+enum {
+    PROP_0,
+    PROP_LOCATION,
+    PROP_EXTENT,
+    PROP_BATCH_SIZE,
+    PROP_DIRECT,
+    PROP_SYNC_INTERVAL,
+    PROP_STATS,
+};
+
+typedef struct {
+    guint8 *data;
+    gsize len;
+    guint64 offset;                     /* 写入文件的起始偏移 */
+} WriteBatch;
+
+/* 通知 I/O 线程退出的哨兵 */
+static WriteBatch stop_marker;
+
+struct _GstFastFileSink {
+    GstBaseSink parent;
+
+    /* 属性 */
+    gchar *location;
+    guint64 extent;
+    guint batch_size;
+    gboolean direct;
+    gint sync_interval;
+
+    /* 流线程使用 */
+    WriteBatch *batches;
+    WriteBatch *current;
+    gint64 current_since;               /* 当前 batch 写入第一个字节的时间 */
+    guint64 position;                   /* 下一个字节写入的文件偏移 */
+
+    /* I/O 线程使用 */
+    int fd;
+    int direct_fd;                      /* O_DIRECT 打开的同一个文件，未启用时为 -1 */
+    GThread *io_thread;
+    GAsyncQueue *pending;               /* 等待写入的 batch */
+    GAsyncQueue *free_batches;          /* 可以继续填充的 batch */
+    gboolean preallocate;
+    guint64 allocated;                  /* fallocate 已经预分配到的偏移 */
+    guint64 end;                        /* 已写入的最大偏移 */
+    gint64 last_sync;
+    gint io_error;                      /* 第一个写入错误的 errno */
+
+    GMutex lock;
+    GCond drained;
+    guint in_flight;
+
+    /* 统计，由 I/O 线程更新 */
+    gint64 start_time;
+    guint64 bytes_written;
+    guint64 writes;
+    guint64 latency_total;              /* 微秒 */
+    guint64 latency_max;
+    guint64 syncs;
+};
+
+G_DEFINE_TYPE(GstFastFileSink, gst_fast_file_sink, GST_TYPE_BASE_SINK)
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE("sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+// 辅助函数：pwrite 直到全部写完，处理 EINTR 和部分写入
+static gboolean pwrite_all(int fd, const guint8 *data, gsize len, guint64 offset) {
+    while (len > 0) {
+        ssize_t n = pwrite(fd, data, len, (off_t)offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return FALSE;
+        }
+        data += n;
+        len -= n;
+        offset += n;
+    }
+    return TRUE;
+}
+
+// I/O 线程：按 extent 预分配，然后写入一个 batch
+static void write_batch(GstFastFileSink *self, WriteBatch *batch) {
+    guint64 end = batch->offset + batch->len;
+
+    // KEEP_SIZE：文件大小始终等于已写入的数据，录制中途崩溃也不会留下一段空白
+    if (self->preallocate && end > self->allocated) {
+        guint64 target = (end / self->extent + 1) * self->extent;
+        if (fallocate(self->fd, FALLOC_FL_KEEP_SIZE, (off_t)self->allocated, (off_t)(target - self->allocated)) == 0) {
+            self->allocated = target;
+        } else {
+            GST_WARNING_OBJECT(self, "fallocate failed (%s), preallocation disabled", g_strerror(errno));
+            self->preallocate = FALSE;
+        }
+    }
+
+    gint64 start = g_get_monotonic_time();
+    gsize done = 0;
+    gboolean ok = TRUE;
+
+    // 对齐部分走 O_DIRECT，剩余不足一个块的尾部和回写头部等零散写入走页缓存
+    if (self->direct_fd >= 0 && batch->offset % DIRECT_ALIGN == 0) {
+        done = batch->len & ~(gsize)(DIRECT_ALIGN - 1);
+        ok = pwrite_all(self->direct_fd, batch->data, done, batch->offset);
+    }
+    if (ok && done < batch->len) {
+        ok = pwrite_all(self->fd, batch->data + done, batch->len - done, batch->offset + done);
+    }
+    if (!ok) {
+        g_atomic_int_set(&self->io_error, errno ? errno : EIO);
+        return;
+    }
+
+    if (self->sync_interval > 0 && (start - self->last_sync) / 1000 >= self->sync_interval) {
+        fdatasync(self->fd);
+        self->last_sync = g_get_monotonic_time();
+        self->syncs++;
+    }
+
+    guint64 latency = (guint64)(g_get_monotonic_time() - start);
+    self->end = MAX(self->end, end);
+    self->bytes_written += batch->len;
+    self->writes++;
+    self->latency_total += latency;
+    self->latency_max = MAX(self->latency_max, latency);
+}
+
+static gpointer io_thread_func(gpointer user_data) {
+    GstFastFileSink *self = GST_FAST_FILE_SINK(user_data);
+
+    for (;;) {
+        WriteBatch *batch = g_async_queue_pop(self->pending);
+        if (batch == &stop_marker) break;
+
+        if (g_atomic_int_get(&self->io_error) == 0) {
+            write_batch(self, batch);
+        }
+        batch->len = 0;
+        g_async_queue_push(self->free_batches, batch);
+
+        g_mutex_lock(&self->lock);
+        if (--self->in_flight == 0) {
+            g_cond_broadcast(&self->drained);
+        }
+        g_mutex_unlock(&self->lock);
+    }
+    return NULL;
+}
+
+// 辅助函数：把当前 batch 交给 I/O 线程
+static void submit_current(GstFastFileSink *self) {
+    WriteBatch *batch = g_steal_pointer(&self->current);
+    if (!batch) return;
+    if (batch->len == 0) {
+        g_async_queue_push(self->free_batches, batch);
+        return;
+    }
+
+    g_mutex_lock(&self->lock);
+    self->in_flight++;
+    g_mutex_unlock(&self->lock);
+    g_async_queue_push(self->pending, batch);
+}
+
+// 辅助函数：同步间隔到期时提交部分填充的 batch。启用 O_DIRECT 时把不足一个块的尾部复制到下一个 batch 开头，
+// 下一个 batch 从对齐的偏移开始 (这段尾部会重复写入一次)，后续的写入仍然可以走 O_DIRECT
+static void submit_partial(GstFastFileSink *self) {
+    WriteBatch *batch = self->current;
+    guint64 end = batch->offset + batch->len;
+    gsize tail = self->direct_fd >= 0 ? (gsize)(end % DIRECT_ALIGN) : 0;
+    if (tail > batch->len || end != self->position) tail = 0;
+    const guint8 *tail_data = batch->data + batch->len - tail;
+
+    submit_current(self);
+    if (tail == 0) return;
+
+    // 只有流线程从 free_batches 取 batch，在这之前刚提交的 batch 内容不会被覆盖 (可能取回的就是它)
+    self->current = g_async_queue_pop(self->free_batches);
+    memmove(self->current->data, tail_data, tail);
+    self->current->offset = end - tail;
+    self->current->len = tail;
+    self->current_since = g_get_monotonic_time();
+}
+
+// 辅助函数：提交当前 batch 并等待所有写入完成
+static void wait_drained(GstFastFileSink *self) {
+    submit_current(self);
+
+    g_mutex_lock(&self->lock);
+    while (self->in_flight > 0) {
+        g_cond_wait(&self->drained, &self->lock);
+    }
+    g_mutex_unlock(&self->lock);
+}
+
+static gboolean check_io_error(GstFastFileSink *self) {
+    int err = g_atomic_int_get(&self->io_error);
+    if (err != 0) {
+        GST_ELEMENT_ERROR(self, RESOURCE, WRITE, ("Could not write to file \"%s\".", self->location),
+                          ("%s", g_strerror(err)));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static GstFlowReturn gst_fast_file_sink_render(GstBaseSink *sink, GstBuffer *buffer) {
+    GstFastFileSink *self = GST_FAST_FILE_SINK(sink);
+    if (!check_io_error(self)) {
+        return GST_FLOW_ERROR;
+    }
+
+    GstMapInfo map;
+    if (!gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+        return GST_FLOW_ERROR;
+    }
+
+    const guint8 *src = map.data;
+    gsize remaining = map.size;
+    while (remaining > 0) {
+        // 与当前 batch 不连续 (复用器回写头部) 时先提交当前 batch
+        if (self->current && self->current->offset + self->current->len != self->position) {
+            submit_current(self);
+        }
+        if (!self->current) {
+            // 所有 batch 都在写入时在这里等待，内存占用有上限
+            self->current = g_async_queue_pop(self->free_batches);
+            self->current->offset = self->position;
+            self->current->len = 0;
+            self->current_since = g_get_monotonic_time();
+        }
+
+        gsize n = MIN(remaining, self->batch_size - self->current->len);
+        memcpy(self->current->data + self->current->len, src, n);
+        self->current->len += n;
+        self->position += n;
+        src += n;
+        remaining -= n;
+
+        if (self->current->len == self->batch_size) {
+            submit_current(self);
+        }
+    }
+
+    // 低码率时一个 batch 要很久才能填满：数据在内存中停留不超过一个同步间隔，崩溃时最多丢失一个间隔
+    if (self->current && self->sync_interval > 0 &&
+        (g_get_monotonic_time() - self->current_since) / 1000 >= self->sync_interval) {
+        submit_partial(self);
+    }
+
+    gst_buffer_unmap(buffer, &map);
+    return GST_FLOW_OK;
+}
+
+static gboolean gst_fast_file_sink_event(GstBaseSink *sink, GstEvent *event) {
+    GstFastFileSink *self = GST_FAST_FILE_SINK(sink);
+
+    switch (GST_EVENT_TYPE(event)) {
+        case GST_EVENT_SEGMENT: {
+            const GstSegment *segment;
+            gst_event_parse_segment(event, &segment);
+            // 字节格式的 segment 表示复用器要求从该偏移继续写 (例如 mp4mux 结束时回写 moov/mdat 大小)
+            if (segment->format == GST_FORMAT_BYTES) {
+                self->position = segment->start;
+            }
+            break;
+        }
+        case GST_EVENT_EOS:
+            wait_drained(self);
+            if (!check_io_error(self)) {
+                gst_event_unref(event);
+                return FALSE;
+            }
+            break;
+        default:
+            break;
+    }
+    return GST_BASE_SINK_CLASS(gst_fast_file_sink_parent_class)->event(sink, event);
+}
+
+static gboolean gst_fast_file_sink_query(GstBaseSink *sink, GstQuery *query) {
+    GstFastFileSink *self = GST_FAST_FILE_SINK(sink);
+
+    switch (GST_QUERY_TYPE(query)) {
+        case GST_QUERY_SEEKING: {
+            // 复用器依赖可定位的下游来回写文件头
+            GstFormat format;
+            gst_query_parse_seeking(query, &format, NULL, NULL, NULL);
+            gst_query_set_seeking(query, format, format == GST_FORMAT_BYTES || format == GST_FORMAT_DEFAULT, 0, -1);
+            return TRUE;
+        }
+        case GST_QUERY_POSITION: {
+            GstFormat format;
+            gst_query_parse_position(query, &format, NULL);
+            if (format == GST_FORMAT_BYTES || format == GST_FORMAT_DEFAULT) {
+                gst_query_set_position(query, GST_FORMAT_BYTES, self->position);
+                return TRUE;
+            }
+            return FALSE;
+        }
+        case GST_QUERY_FORMATS:
+            gst_query_set_formats(query, 2, GST_FORMAT_DEFAULT, GST_FORMAT_BYTES);
+            return TRUE;
+        case GST_QUERY_URI: {
+            g_autofree gchar *uri = self->location ? gst_filename_to_uri(self->location, NULL) : NULL;
+            gst_query_set_uri(query, uri);
+            return TRUE;
+        }
+        default:
+            return GST_BASE_SINK_CLASS(gst_fast_file_sink_parent_class)->query(sink, query);
+    }
+}
+
+static gboolean gst_fast_file_sink_start(GstBaseSink *sink) {
+    GstFastFileSink *self = GST_FAST_FILE_SINK(sink);
+
+    if (!self->location) {
+        GST_ELEMENT_ERROR(self, RESOURCE, NOT_FOUND, ("No file name specified for writing."), (NULL));
+        return FALSE;
+    }
+
+    self->fd = open(self->location, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (self->fd < 0) {
+        GST_ELEMENT_ERROR(self, RESOURCE, OPEN_WRITE, ("Could not open file \"%s\" for writing.", self->location),
+                          ("%s", g_strerror(errno)));
+        return FALSE;
+    }
+
+    self->direct_fd = -1;
+    if (self->direct) {
+        // tmpfs 等文件系统不支持 O_DIRECT，此时退回页缓存写入
+        self->direct_fd = open(self->location, O_WRONLY | O_DIRECT | O_CLOEXEC);
+        if (self->direct_fd < 0) {
+            g_printerr("Warning: O_DIRECT is not supported for %s (%s). Using buffered writes.\n",
+                       self->location, g_strerror(errno));
+        }
+    }
+
+    // O_DIRECT 要求缓冲区、长度和偏移都按块对齐
+    self->batch_size = GST_ROUND_UP_N(MAX(self->batch_size, DIRECT_ALIGN), DIRECT_ALIGN);
+    self->batches = g_new0(WriteBatch, BATCH_COUNT);
+    self->pending = g_async_queue_new();
+    self->free_batches = g_async_queue_new();
+    for (int i = 0; i < BATCH_COUNT; i++) {
+        if (posix_memalign((void **)&self->batches[i].data, DIRECT_ALIGN, self->batch_size) != 0) {
+            GST_ELEMENT_ERROR(self, RESOURCE, NO_SPACE_LEFT, ("Could not allocate write buffers."), (NULL));
+            return FALSE;
+        }
+        g_async_queue_push(self->free_batches, &self->batches[i]);
+    }
+
+    self->current = NULL;
+    self->position = 0;
+    self->preallocate = self->extent > 0;
+    self->allocated = 0;
+    self->end = 0;
+    self->in_flight = 0;
+    self->io_error = 0;
+    self->start_time = self->last_sync = g_get_monotonic_time();
+    self->bytes_written = self->writes = self->latency_total = self->latency_max = self->syncs = 0;
+    self->io_thread = g_thread_new("fastfilesink-io", io_thread_func, self);
+    return TRUE;
+}
+
+static gboolean gst_fast_file_sink_stop(GstBaseSink *sink) {
+    GstFastFileSink *self = GST_FAST_FILE_SINK(sink);
+
+    if (self->io_thread) {
+        wait_drained(self);
+        g_async_queue_push(self->pending, &stop_marker);
+        g_clear_pointer(&self->io_thread, g_thread_join);
+    }
+
+    if (self->fd >= 0) {
+        // 释放文件末尾之后多预分配的空间
+        if (self->allocated > self->end) {
+            fallocate(self->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                      (off_t)self->end, (off_t)(self->allocated - self->end));
+        }
+        if (self->sync_interval >= 0) {
+            fdatasync(self->fd);
+        }
+        close(self->fd);
+        self->fd = -1;
+
+        gdouble elapsed = MAX(g_get_monotonic_time() - self->start_time, 1) / (gdouble)G_USEC_PER_SEC;
+        g_print("%s: %.1f MB in %.1f s (%.1f MB/s), %" G_GUINT64_FORMAT " writes, write latency avg %.2f ms / max %.2f ms.\n",
+                GST_OBJECT_NAME(self), self->bytes_written / 1e6, elapsed, self->bytes_written / 1e6 / elapsed,
+                self->writes, self->writes ? self->latency_total / 1000.0 / self->writes : 0.0,
+                self->latency_max / 1000.0);
+    }
+    if (self->direct_fd >= 0) {
+        close(self->direct_fd);
+        self->direct_fd = -1;
+    }
+
+    if (self->batches) {
+        for (int i = 0; i < BATCH_COUNT; i++) {
+            free(self->batches[i].data);
+        }
+        g_clear_pointer(&self->batches, g_free);
+    }
+    g_clear_pointer(&self->pending, g_async_queue_unref);
+    g_clear_pointer(&self->free_batches, g_async_queue_unref);
+    self->current = NULL;
+    return TRUE;
+}
+
+static GstStructure *make_stats(GstFastFileSink *self) {
+    gdouble elapsed = MAX(g_get_monotonic_time() - self->start_time, 1) / (gdouble)G_USEC_PER_SEC;
+    return gst_structure_new("fastfilesink-stats",
+                             "bytes-written", G_TYPE_UINT64, self->bytes_written,
+                             "bytes-per-second", G_TYPE_DOUBLE, self->bytes_written / elapsed,
+                             "writes", G_TYPE_UINT64, self->writes,
+                             "syncs", G_TYPE_UINT64, self->syncs,
+                             "write-latency-avg", G_TYPE_UINT64,
+                             self->writes ? self->latency_total * GST_USECOND / self->writes : 0,
+                             "write-latency-max", G_TYPE_UINT64, self->latency_max * GST_USECOND,
+                             NULL);
+}
+
+static void gst_fast_file_sink_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec) {
+    GstFastFileSink *self = GST_FAST_FILE_SINK(object);
+
+    switch (prop_id) {
+        case PROP_LOCATION:
+            g_free(self->location);
+            self->location = g_value_dup_string(value);
+            break;
+        case PROP_EXTENT:
+            self->extent = g_value_get_uint64(value);
+            break;
+        case PROP_BATCH_SIZE:
+            self->batch_size = g_value_get_uint(value);
+            break;
+        case PROP_DIRECT:
+            self->direct = g_value_get_boolean(value);
+            break;
+        case PROP_SYNC_INTERVAL:
+            self->sync_interval = g_value_get_int(value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+}
+
+static void gst_fast_file_sink_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec) {
+    GstFastFileSink *self = GST_FAST_FILE_SINK(object);
+
+    switch (prop_id) {
+        case PROP_LOCATION:
+            g_value_set_string(value, self->location);
+            break;
+        case PROP_EXTENT:
+            g_value_set_uint64(value, self->extent);
+            break;
+        case PROP_BATCH_SIZE:
+            g_value_set_uint(value, self->batch_size);
+            break;
+        case PROP_DIRECT:
+            g_value_set_boolean(value, self->direct);
+            break;
+        case PROP_SYNC_INTERVAL:
+            g_value_set_int(value, self->sync_interval);
+            break;
+        case PROP_STATS:
+            g_value_take_boxed(value, make_stats(self));
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+}
+
+static void gst_fast_file_sink_finalize(GObject *object) {
+    GstFastFileSink *self = GST_FAST_FILE_SINK(object);
+
+    g_free(self->location);
+    g_mutex_clear(&self->lock);
+    g_cond_clear(&self->drained);
+    G_OBJECT_CLASS(gst_fast_file_sink_parent_class)->finalize(object);
+}
+
+static void gst_fast_file_sink_class_init(GstFastFileSinkClass *klass) {
+    GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+    GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+    GstBaseSinkClass *basesink_class = GST_BASE_SINK_CLASS(klass);
+
+    gobject_class->set_property = gst_fast_file_sink_set_property;
+    gobject_class->get_property = gst_fast_file_sink_get_property;
+    gobject_class->finalize = gst_fast_file_sink_finalize;
+
+    g_object_class_install_property(gobject_class, PROP_LOCATION,
+        g_param_spec_string("location", "File Location", "Location of the file to write",
+                            NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_EXTENT,
+        g_param_spec_uint64("extent", "Preallocation extent", "Preallocate the file in steps of this many bytes (0 = off)",
+                            0, G_MAXUINT64, DEFAULT_EXTENT, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_BATCH_SIZE,
+        g_param_spec_uint("batch-size", "Batch size", "Size of each write issued by the I/O thread, rounded up to 4096 bytes",
+                          DIRECT_ALIGN, G_MAXINT, DEFAULT_BATCH_SIZE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_DIRECT,
+        g_param_spec_boolean("direct", "Direct I/O", "Write aligned batches with O_DIRECT, bypassing the page cache",
+                             DEFAULT_DIRECT, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_SYNC_INTERVAL,
+        g_param_spec_int("sync-interval", "Sync interval",
+                         "fdatasync policy: milliseconds between syncs, 0 = only when closing, -1 = never",
+                         -1, G_MAXINT, DEFAULT_SYNC_INTERVAL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_STATS,
+        g_param_spec_boxed("stats", "Statistics", "Bytes written, throughput and write latency",
+                           GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+    gst_element_class_set_static_metadata(element_class, "Fast file sink", "Sink/File",
+                                          "Write stream to a file with preallocation and batched writes on an I/O thread",
+                                          "gst-capture");
+    gst_element_class_add_static_pad_template(element_class, &sink_template);
+
+    basesink_class->start = GST_DEBUG_FUNCPTR(gst_fast_file_sink_start);
+    basesink_class->stop = GST_DEBUG_FUNCPTR(gst_fast_file_sink_stop);
+    basesink_class->render = GST_DEBUG_FUNCPTR(gst_fast_file_sink_render);
+    basesink_class->event = GST_DEBUG_FUNCPTR(gst_fast_file_sink_event);
+    basesink_class->query = GST_DEBUG_FUNCPTR(gst_fast_file_sink_query);
+}
+
+static void gst_fast_file_sink_init(GstFastFileSink *self) {
+    self->extent = DEFAULT_EXTENT;
+    self->batch_size = DEFAULT_BATCH_SIZE;
+    self->direct = DEFAULT_DIRECT;
+    self->sync_interval = DEFAULT_SYNC_INTERVAL;
+    self->fd = -1;
+    self->direct_fd = -1;
+    g_mutex_init(&self->lock);
+    g_cond_init(&self->drained);
+
+    // 与 filesink 一致：不按时钟同步
+    gst_base_sink_set_sync(GST_BASE_SINK(self), FALSE);
+}
+
+gboolean fast_file_sink_register(void) {
+    return gst_element_register(NULL, "fastfilesink", GST_RANK_NONE, GST_TYPE_FAST_FILE_SINK);
+}
@@ -0,0 +1,30 @@
+#ifndef FASTSINK_H
+#define FASTSINK_H
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+
+G_BEGIN_DECLS
+
+/*
+ * fastfilesink: file sink for the recording tail. Muxer output is copied into large
+ * batches and written with pwrite() on a dedicated I/O thread, so the streaming thread
+ * never waits on the disk unless every batch is in flight. The file is preallocated
+ * with fallocate() in "extent" steps, aligned batches can bypass the page cache with
+ * "direct", and "sync-interval" selects the fdatasync policy; with a positive interval
+ * a partially filled batch is also handed to the I/O thread once it is that old, so
+ * low-bitrate data does not wait in memory for a full batch. Byte-position segments
+ * from the muxer (e.g. mp4mux rewriting its headers) are honoured.
+ */
+#define GST_TYPE_FAST_FILE_SINK (gst_fast_file_sink_get_type())
+G_DECLARE_FINAL_TYPE(GstFastFileSink, gst_fast_file_sink, GST, FAST_FILE_SINK, GstBaseSink)
+
+/*
+ * Register "fastfilesink" as an application-local element factory.
+ * Returns: TRUE if successful, FALSE otherwise.
+ */
+gboolean fast_file_sink_register(void);
+
+G_END_DECLS
+
+#endif // FASTSINK_H
@@ -0,0 +1,262 @@
+#include "utils.h"
+#include "config.h"
+#include "latency.h"
+#include <gst/gst.h>
+#include <iniparser.h>
+
+/*
+ * 对数-线性直方图 (HdrHistogram 的简化形式)，单位微秒：
+ * 0..63 每个值一个桶；之后每个 2 的幂区间分 32 个桶，相对误差约 3%
+ */
+#define HIST_LINEAR 64
+#define HIST_SUB 32
+#define HIST_SHIFTS 30
+#define HIST_BUCKETS (HIST_LINEAR + HIST_SHIFTS * HIST_SUB)
+
+typedef struct {
+    gchar *name;                        /* 元素名.pad 名 */
+    GstSegment segment;                 /* 只由该 pad 的流线程访问 */
+    guint64 buckets[HIST_BUCKETS];      /* 以下计数由流线程原子累加 */
+    guint64 count;
+    guint64 sum;
+    guint64 max;
+    guint64 no_ts;                      /* 没有有效时间戳或还没有时钟的 buffer */
+} LatencyPoint;
+
+struct _LatencyTracer {
+    CustomData *data;
+    GstElement *pipeline;
+    GstBus *bus;
+    gulong state_id;
+    GstClock *clock;                    /* 管道进入 PLAYING 时缓存，探针中不再取元素的对象锁 */
+    guint64 base_time;                  /* 同上，原子读写 */
+    GPtrArray *old_clocks;              /* 被替换的时钟，探针可能仍在使用，释放时再 unref */
+    GMutex lock;                        /* 保护 points/by_name，只在添加元素和输出时使用 */
+    GPtrArray *points;                  /* 按加入顺序 */
+    GHashTable *by_name;
+    gulong added_id;
+    guint report_id;
+};
+
+static guint hist_index(guint64 us) {
+    if (us < HIST_LINEAR) return (guint)us;
+    guint shift = g_bit_storage(us) - 6;
+    guint index = HIST_LINEAR + (shift - 1) * HIST_SUB + (guint)((us >> shift) - HIST_SUB);
+    return MIN(index, HIST_BUCKETS - 1);
+}
+
+// 辅助函数：桶的中间值
+static guint64 hist_value(guint index) {
+    if (index < HIST_LINEAR) return index;
+    guint k = index - HIST_LINEAR;
+    guint shift = k / HIST_SUB + 1;
+    guint64 low = (guint64)(k % HIST_SUB + HIST_SUB) << shift;
+    return low + ((1ull << shift) >> 1);
+}
+
+typedef struct {
+    LatencyTracer *lt;
+    LatencyPoint *point;
+} LatencyProbe;
+
+static GstPadProbeReturn latency_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    LatencyTracer *lt = ((LatencyProbe *)user_data)->lt;
+    LatencyPoint *point = ((LatencyProbe *)user_data)->point;
+
+    if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+        GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+        if (GST_EVENT_TYPE(event) == GST_EVENT_SEGMENT) {
+            gst_event_copy_segment(event, &point->segment);
+        }
+        return GST_PAD_PROBE_OK;
+    }
+
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    GstClockTime running_time = GST_CLOCK_TIME_NONE;
+    if (GST_BUFFER_PTS_IS_VALID(buffer) && point->segment.format == GST_FORMAT_TIME) {
+        running_time = gst_segment_to_running_time(&point->segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+    }
+    GstClock *clock = g_atomic_pointer_get(&lt->clock);
+    if (!clock || !GST_CLOCK_TIME_IS_VALID(running_time)) {
+        counter_add(&point->no_ts, 1);
+        return GST_PAD_PROBE_OK;
+    }
+
+    GstClockTime captured = counter_get(&lt->base_time) + running_time;
+    GstClockTime now = gst_clock_get_time(clock);
+    guint64 us = now > captured ? (now - captured) / GST_USECOND : 0;
+    counter_add(&point->buckets[hist_index(us)], 1);
+    counter_add(&point->count, 1);
+    counter_add(&point->sum, us);
+    counter_max(&point->max, us);
+    return GST_PAD_PROBE_OK;
+}
+
+static LatencyPoint *lookup_point(LatencyTracer *lt, const gchar *name) {
+    g_mutex_lock(&lt->lock);
+    LatencyPoint *point = g_hash_table_lookup(lt->by_name, name);
+    if (!point) {
+        point = g_new0(LatencyPoint, 1);
+        point->name = g_strdup(name);
+        gst_segment_init(&point->segment, GST_FORMAT_UNDEFINED);
+        g_ptr_array_add(lt->points, point);
+        g_hash_table_insert(lt->by_name, point->name, point);
+    }
+    g_mutex_unlock(&lt->lock);
+    return point;
+}
+
+// 辅助函数：在元素的输出上测量；sink 没有输出，在输入上测量
+static void attach_pads(LatencyTracer *lt, GstElement *element) {
+    gboolean is_sink = GST_OBJECT_FLAG_IS_SET(element, GST_ELEMENT_FLAG_SINK) && element->numsrcpads == 0;
+    g_autoptr(GstIterator) it = is_sink ? gst_element_iterate_sink_pads(element) : gst_element_iterate_src_pads(element);
+    GValue item = G_VALUE_INIT;
+    while (gst_iterator_next(it, &item) == GST_ITERATOR_OK) {
+        GstPad *pad = g_value_get_object(&item);
+        // tee 等元素的请求 pad 与输入相同，不单独测量
+        if (GST_PAD_TEMPLATE(pad) && GST_PAD_TEMPLATE_PRESENCE(GST_PAD_TEMPLATE(pad)) == GST_PAD_REQUEST) {
+            g_value_reset(&item);
+            continue;
+        }
+        g_autofree gchar *name = g_strdup_printf("%s.%s", GST_OBJECT_NAME(element), GST_OBJECT_NAME(pad));
+        LatencyProbe *probe = g_new(LatencyProbe, 1);
+        probe->lt = lt;
+        probe->point = lookup_point(lt, name);
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+                          latency_probe, probe, g_free);
+        g_value_reset(&item);
+    }
+    g_value_unset(&item);
+}
+
+// 初始化时遍历已有的元素；之后加入的元素 (包括随 bin 一起加入的子元素) 各自触发 deep-element-added
+static void attach_existing(LatencyTracer *lt, GstElement *element) {
+    g_autoptr(GstIterator) it = gst_bin_iterate_recurse(GST_BIN(element));
+    GValue item = G_VALUE_INIT;
+    while (gst_iterator_next(it, &item) == GST_ITERATOR_OK) {
+        GstElement *child = g_value_get_object(&item);
+        if (!GST_IS_BIN(child)) {
+            attach_pads(lt, child);
+        }
+        g_value_reset(&item);
+    }
+    g_value_unset(&item);
+}
+
+static void on_deep_element_added(GstBin *bin, GstBin *sub_bin, GstElement *element, gpointer user_data) {
+    if (!GST_IS_BIN(element)) {
+        attach_pads((LatencyTracer *)user_data, element);
+    }
+}
+
+// 管道每次进入 PLAYING 时更新缓存的时钟和 base time
+static void on_state_changed(GstBus *bus, GstMessage *msg, gpointer user_data) {
+    LatencyTracer *lt = (LatencyTracer *)user_data;
+    GstState new_state;
+    gst_message_parse_state_changed(msg, NULL, &new_state, NULL);
+    if (GST_MESSAGE_SRC(msg) != GST_OBJECT(lt->pipeline) || new_state != GST_STATE_PLAYING) {
+        return;
+    }
+
+    GstClock *clock = gst_element_get_clock(lt->pipeline);
+    counter_set(&lt->base_time, gst_element_get_base_time(lt->pipeline));
+    GstClock *old = g_atomic_pointer_exchange(&lt->clock, clock);
+    if (old) {
+        g_ptr_array_add(lt->old_clocks, old);
+    }
+}
+
+static gboolean report_timeout(gpointer user_data) {
+    latency_tracer_dump((CustomData *)user_data);
+    return G_SOURCE_CONTINUE;
+}
+
+void latency_tracer_init(CustomData *data) {
+    dictionary *dict = data->config_dict;
+    if (!data->pipeline || !iniparser_getboolean(dict, "latency:enable", 0)) {
+        return;
+    }
+
+    LatencyTracer *lt = g_new0(LatencyTracer, 1);
+    lt->data = data;
+    lt->pipeline = gst_object_ref(data->pipeline);
+    g_mutex_init(&lt->lock);
+    lt->points = g_ptr_array_new();
+    lt->by_name = g_hash_table_new(g_str_hash, g_str_equal);
+
+    lt->old_clocks = g_ptr_array_new_with_free_func(gst_object_unref);
+    attach_existing(lt, data->pipeline);
+    lt->added_id = g_signal_connect(lt->pipeline, "deep-element-added", G_CALLBACK(on_deep_element_added), lt);
+    // 主循环中处理总线消息 (signal watch 由 on_activate 添加)
+    lt->bus = gst_element_get_bus(lt->pipeline);
+    lt->state_id = g_signal_connect(lt->bus, "message::state-changed", G_CALLBACK(on_state_changed), lt);
+    int interval = iniparser_getint(dict, "latency:report", 0);
+    if (interval > 0) {
+        lt->report_id = g_timeout_add_seconds(interval, report_timeout, data);
+    }
+    data->latency_tracer = lt;
+    g_print("Latency tracer enabled on %u pad(s). Send SIGUSR2 to print the histograms.\n", lt->points->len);
+}
+
+void latency_tracer_dump(CustomData *data) {
+    LatencyTracer *lt = data->latency_tracer;
+    if (!lt) return;
+
+    g_print("Latency since capture (ms)           count      avg      p50      p99    p99.9      max   no-ts\n");
+    g_mutex_lock(&lt->lock);
+    for (guint i = 0; i < lt->points->len; i++) {
+        LatencyPoint *point = g_ptr_array_index(lt->points, i);
+        guint64 count = counter_get(&point->count);
+        guint64 no_ts = counter_get(&point->no_ts);
+        if (count == 0 && no_ts == 0) continue;
+
+        // 计数在输出过程中仍可能增加，按各桶之和计算百分位
+        static const gdouble quantiles[] = { 0.5, 0.99, 0.999 };
+        gdouble values[G_N_ELEMENTS(quantiles)] = { 0 };
+        guint64 total = 0;
+        for (guint b = 0; b < HIST_BUCKETS; b++) {
+            total += counter_get(&point->buckets[b]);
+        }
+        guint64 seen = 0;
+        guint q = 0;
+        for (guint b = 0; b < HIST_BUCKETS && q < G_N_ELEMENTS(quantiles); b++) {
+            seen += counter_get(&point->buckets[b]);
+            while (q < G_N_ELEMENTS(quantiles) && total > 0 && seen >= quantiles[q] * total) {
+                values[q++] = hist_value(b) / 1000.0;
+            }
+        }
+        gdouble avg = count > 0 ? counter_get(&point->sum) / 1000.0 / count : 0.0;
+        g_print("  %-32s %8" G_GUINT64_FORMAT " %8.2f %8.2f %8.2f %8.2f %8.2f %7" G_GUINT64_FORMAT "\n",
+                point->name, count, avg, values[0], values[1], values[2], counter_get(&point->max) / 1000.0, no_ts);
+    }
+    g_mutex_unlock(&lt->lock);
+}
+
+void latency_tracer_free(CustomData *data) {
+    LatencyTracer *lt = data->latency_tracer;
+    if (!lt) return;
+
+    latency_tracer_dump(data);
+    data->latency_tracer = NULL;
+    if (lt->report_id > 0) {
+        g_source_remove(lt->report_id);
+    }
+    g_signal_handler_disconnect(lt->pipeline, lt->added_id);
+    g_signal_handler_disconnect(lt->bus, lt->state_id);
+    gst_object_unref(lt->bus);
+    gst_object_unref(lt->pipeline);
+    if (lt->clock) {
+        gst_object_unref(lt->clock);
+    }
+    g_ptr_array_unref(lt->old_clocks);
+    // 管道已经停止，探针不会再被调用
+    for (guint i = 0; i < lt->points->len; i++) {
+        LatencyPoint *point = g_ptr_array_index(lt->points, i);
+        g_free(point->name);
+        g_free(point);
+    }
+    g_ptr_array_unref(lt->points);
+    g_hash_table_unref(lt->by_name);
+    g_mutex_clear(&lt->lock);
+    g_free(lt);
+}
@@ -0,0 +1,27 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "config.h"
+
+/*
+ * Start the built-in latency tracer when [latency] enable is set. Every element
+ * added to the pipeline, including each recording bin, gets a probe on its src
+ * pads (sink pads for sinks) that measures how long ago the buffer was captured:
+ * the capture stamp is the source PTS carried through as running time, compared
+ * with the pipeline clock. Values go into lock-free log-linear histograms, one
+ * per pad, which survive across recordings (pads are keyed by element/pad name).
+ * Call after initialize_gstreamer_pipeline().
+ */
+void latency_tracer_init(CustomData *data);
+
+/*
+ * Print count, p50/p99/p99.9 and max of every measuring point.
+ */
+void latency_tracer_dump(CustomData *data);
+
+/*
+ * Print a final dump and release the tracer. Call after the pipeline is stopped.
+ */
+void latency_tracer_free(CustomData *data);
+
+#endif // LATENCY_H
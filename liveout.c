@@ -0,0 +1,322 @@
+#include "utils.h"
+#include "config.h"
+#include "liveout.h"
+#include <gst/gst.h>
+#include <string.h>
+#include <iniparser.h>
+
+#define REMOVING_KEY "live-output-removing"
+
+#define LIVE_EOS_TIMEOUT 5
+
+/* 正在移除的输出：两个 tee pad 都断开、输出处理完 EOS 后在主线程中销毁 */
+typedef struct {
+    GstElement *output;
+    GstPad *tee_pads[2];
+    gint pending;
+    gboolean detached;                  /* tee pad 都已断开 (主线程) */
+    gboolean eos_seen;                  /* 输出已经发出 EOS 消息 (主线程) */
+    guint timeout_id;                   /* 输出迟迟不结束时强制移除 */
+} LiveRemoval;
+
+gboolean live_outputs_configured(CustomData *data) {
+    const char *outputs = iniparser_getstring(data->config_dict, "live:outputs", "");
+    return outputs && outputs[0] != '\0';
+}
+
+// 辅助函数：把 queue 链接到 mux 上指定名称的请求 pad (hlssink2 等)，没有则找一个兼容的 pad
+static gboolean link_queue_to_mux(GstElement *queue, GstElement *mux, const char *pad_name, GstCaps *caps) {
+    g_autoptr(GstPad) src_pad = gst_element_get_static_pad(queue, "src");
+    g_autoptr(GstPad) sink_pad = NULL;
+    if (gst_element_get_pad_template(mux, pad_name)) {
+        sink_pad = gst_element_request_pad_simple(mux, pad_name);
+    }
+    if (!sink_pad) {
+        sink_pad = gst_element_get_compatible_pad(mux, src_pad, caps);
+    }
+
+    // 编码格式已知时提前检查，避免不兼容的输出在协商时向总线报错
+    if (!sink_pad || (caps && !gst_pad_query_accept_caps(sink_pad, caps)) ||
+        gst_pad_link(src_pad, sink_pad) != GST_PAD_LINK_OK) {
+        if (sink_pad && GST_PAD_PAD_TEMPLATE(sink_pad) &&
+            GST_PAD_TEMPLATE_PRESENCE(GST_PAD_PAD_TEMPLATE(sink_pad)) == GST_PAD_REQUEST) {
+            gst_element_release_request_pad(mux, sink_pad);
+        }
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// 辅助函数：为输出添加一个 leaky 队列并创建幽灵垫
+static GstElement *add_output_queue(GstBin *output, const char *kind) {
+    char name[32];
+    snprintf(name, sizeof(name), "live-%s-queue", kind);
+    GstElement *queue = create_and_add_element("queue", name, output);
+    if (!queue) return NULL;
+
+    g_object_set(G_OBJECT(queue), "leaky", 2, "max-size-buffers", 0, "max-size-bytes", 0,
+                 "max-size-time", (guint64)2 * GST_SECOND, NULL);
+
+    g_autoptr(GstPad) queue_sink = gst_element_get_static_pad(queue, "sink");
+    snprintf(name, sizeof(name), "%ssink", kind);
+    gst_element_add_pad(GST_ELEMENT(output), gst_ghost_pad_new(name, queue_sink));
+    return queue;
+}
+
+// 辅助函数：获取 tee 输入端当前的 caps (录制尚未产生数据时为 NULL)
+static GstCaps *tee_current_caps(GstElement *tee) {
+    g_autoptr(GstPad) sink_pad = gst_element_get_static_pad(tee, "sink");
+    return sink_pad ? gst_pad_get_current_caps(sink_pad) : NULL;
+}
+
+// 辅助函数：按 [live_<name>] description 构建输出 bin
+static GstElement *build_output(CustomData *data, const char *name, GstElement *video_tee, GstElement *audio_tee) {
+    g_autofree gchar *key = g_strdup_printf("live_%s:description", name);
+    const char *description = iniparser_getstring(data->config_dict, key, NULL);
+    if (!description) {
+        g_printerr("Live output %s: missing %s.\n", name, key);
+        return NULL;
+    }
+
+    g_autoptr(GError) error = NULL;
+    GstElement *output = gst_parse_bin_from_description(description, FALSE, &error);
+    if (!output) {
+        g_printerr("Live output %s: %s\n", name, error ? error->message : "invalid description");
+        return NULL;
+    }
+    gst_object_ref_sink(output);
+    g_autofree gchar *bin_name = g_strdup_printf("live-%s", name);
+    gst_object_set_name(GST_OBJECT(output), bin_name);
+
+    g_autoptr(GstElement) mux = gst_bin_get_by_name(GST_BIN(output), "mux");
+    GstElement *video_queue = add_output_queue(GST_BIN(output), "video");
+    GstElement *audio_queue = add_output_queue(GST_BIN(output), "audio");
+    if (!mux || !video_queue || !audio_queue) {
+        g_printerr("Live output %s: the description needs an element named \"mux\".\n", name);
+        gst_object_unref(output);
+        return NULL;
+    }
+
+    g_autoptr(GstCaps) video_caps = tee_current_caps(video_tee);
+    g_autoptr(GstCaps) audio_caps = tee_current_caps(audio_tee);
+    if (!link_queue_to_mux(video_queue, mux, "video", video_caps)) {
+        g_printerr("Live output %s: %s does not accept the recording video.\n", name, GST_OBJECT_NAME(mux));
+        gst_object_unref(output);
+        return NULL;
+    }
+    // 只接收视频的输出 (例如 RTP 视频负载) 不需要音频
+    if (!link_queue_to_mux(audio_queue, mux, "audio", audio_caps)) {
+        g_print("Live output %s: %s takes no audio, sending video only.\n", name, GST_OBJECT_NAME(mux));
+        g_autoptr(GstPad) ghost = gst_element_get_static_pad(output, "audiosink");
+        gst_element_remove_pad(output, ghost);
+        gst_bin_remove(GST_BIN(output), audio_queue);
+    }
+    return output;
+}
+
+gboolean live_output_add(CustomData *data, const char *name) {
+    if (!data->recording_bin || !data->is_recording || data->is_stopping_recording) {
+        g_printerr("Live output %s: no recording is running.\n", name);
+        return FALSE;
+    }
+
+    GstBin *recording_bin = GST_BIN(data->recording_bin);
+    g_autofree gchar *bin_name = g_strdup_printf("live-%s", name);
+    g_autoptr(GstElement) existing = gst_bin_get_by_name(recording_bin, bin_name);
+    if (existing && !g_object_get_data(G_OBJECT(existing), REMOVING_KEY)) {
+        return TRUE;
+    }
+    if (existing) {
+        g_printerr("Live output %s is still being removed.\n", name);
+        return FALSE;
+    }
+
+    g_autoptr(GstElement) video_tee = gst_bin_get_by_name(recording_bin, LIVE_VIDEO_TEE);
+    g_autoptr(GstElement) audio_tee = gst_bin_get_by_name(recording_bin, LIVE_AUDIO_TEE);
+    if (!video_tee || !audio_tee) {
+        g_printerr("Live output %s: this recording was started without [live] outputs.\n", name);
+        return FALSE;
+    }
+
+    g_autoptr(GstElement) output = build_output(data, name, video_tee, audio_tee);
+    if (!output) {
+        return FALSE;
+    }
+
+    // 加入录制 bin 后先链接再同步状态，数据到达前输出已就绪
+    gst_bin_add(recording_bin, output);
+
+    g_autoptr(GstPad) video_ghost = gst_element_get_static_pad(output, "videosink");
+    g_autoptr(GstPad) audio_ghost = gst_element_get_static_pad(output, "audiosink");
+    g_autoptr(GstPad) video_tee_pad = gst_element_request_pad_simple(video_tee, "src_%u");
+    g_autoptr(GstPad) audio_tee_pad = audio_ghost ? gst_element_request_pad_simple(audio_tee, "src_%u") : NULL;
+
+    if (!video_tee_pad || gst_pad_link(video_tee_pad, video_ghost) != GST_PAD_LINK_OK ||
+        (audio_ghost && (!audio_tee_pad || gst_pad_link(audio_tee_pad, audio_ghost) != GST_PAD_LINK_OK))) {
+        g_printerr("Live output %s: failed to link to the recording tees.\n", name);
+        if (video_tee_pad) gst_element_release_request_pad(video_tee, video_tee_pad);
+        if (audio_tee_pad) gst_element_release_request_pad(audio_tee, audio_tee_pad);
+        gst_element_set_state(output, GST_STATE_NULL);
+        gst_bin_remove(recording_bin, output);
+        return FALSE;
+    }
+
+    gst_element_sync_state_with_parent(output);
+    g_print("Live output %s started.\n", name);
+    return TRUE;
+}
+
+// 主线程：释放 tee pad，停止并移除输出
+static gboolean finish_removal(gpointer user_data) {
+    LiveRemoval *removal = (LiveRemoval *)user_data;
+
+    for (int i = 0; i < 2; i++) {
+        if (!removal->tee_pads[i]) continue;
+        g_autoptr(GstElement) tee = gst_pad_get_parent_element(removal->tee_pads[i]);
+        if (tee) {
+            gst_element_release_request_pad(tee, removal->tee_pads[i]);
+        }
+        gst_object_unref(removal->tee_pads[i]);
+    }
+
+    gst_element_set_state(removal->output, GST_STATE_NULL);
+    g_autoptr(GstObject) parent = gst_object_get_parent(GST_OBJECT(removal->output));
+    if (parent) {
+        gst_bin_remove(GST_BIN(parent), removal->output);
+    }
+    g_print("Live output %s removed.\n", GST_OBJECT_NAME(removal->output) + strlen("live-"));
+    g_object_set_data(G_OBJECT(removal->output), REMOVING_KEY, NULL);
+
+    gst_object_unref(removal->output);
+    g_free(removal);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean on_removal_timeout(gpointer user_data) {
+    LiveRemoval *removal = (LiveRemoval *)user_data;
+    g_printerr("Live output %s did not finish within %d s after EOS. Removing it anyway.\n",
+               GST_OBJECT_NAME(removal->output) + strlen("live-"), LIVE_EOS_TIMEOUT);
+    removal->timeout_id = 0;
+    return finish_removal(removal);
+}
+
+// 主线程：tee pad 都已断开，等输出处理完 EOS (HLS 写完最后一个分片和 #EXT-X-ENDLIST) 再销毁
+static gboolean on_detached(gpointer user_data) {
+    LiveRemoval *removal = (LiveRemoval *)user_data;
+    removal->detached = TRUE;
+    if (removal->eos_seen) {
+        finish_removal(removal);
+    } else {
+        removal->timeout_id = g_timeout_add_seconds(LIVE_EOS_TIMEOUT, on_removal_timeout, removal);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+// 探针回调：tee pad 空闲时断开链接，并让输出以 EOS 结束
+static GstPadProbeReturn detach_pad_cb(GstPad *tee_pad, GstPadProbeInfo *info, gpointer user_data) {
+    LiveRemoval *removal = (LiveRemoval *)user_data;
+
+    g_autoptr(GstPad) ghost = gst_pad_get_peer(tee_pad);
+    if (ghost) {
+        gst_pad_unlink(tee_pad, ghost);
+        gst_pad_send_event(ghost, gst_event_new_eos());
+    }
+    if (g_atomic_int_dec_and_test(&removal->pending)) {
+        g_idle_add(on_detached, removal);
+    }
+    return GST_PAD_PROBE_REMOVE;
+}
+
+gboolean live_output_remove(CustomData *data, const char *name) {
+    if (!data->recording_bin) return FALSE;
+
+    g_autofree gchar *bin_name = g_strdup_printf("live-%s", name);
+    g_autoptr(GstElement) output = gst_bin_get_by_name(GST_BIN(data->recording_bin), bin_name);
+    if (!output || g_object_get_data(G_OBJECT(output), REMOVING_KEY)) {
+        return FALSE;
+    }
+    LiveRemoval *removal = g_new0(LiveRemoval, 1);
+    removal->output = gst_object_ref(output);
+    g_object_set_data(G_OBJECT(output), REMOVING_KEY, removal);
+
+    g_autoptr(GstPad) video_ghost = gst_element_get_static_pad(output, "videosink");
+    g_autoptr(GstPad) audio_ghost = gst_element_get_static_pad(output, "audiosink");
+    GstPad *ghosts[2] = { video_ghost, audio_ghost };
+    for (int i = 0; i < 2; i++) {
+        if (ghosts[i]) removal->tee_pads[i] = gst_pad_get_peer(ghosts[i]);
+        if (removal->tee_pads[i]) removal->pending++;
+    }
+
+    if (removal->pending == 0) {
+        finish_removal(removal);
+        return TRUE;
+    }
+    // 先统计好数量再安装探针，空闲的 pad 会在 gst_pad_add_probe 中立即回调
+    for (int i = 0; i < 2; i++) {
+        if (removal->tee_pads[i]) {
+            gst_pad_add_probe(removal->tee_pads[i], GST_PAD_PROBE_TYPE_IDLE, detach_pad_cb, removal, NULL);
+        }
+    }
+    return TRUE;
+}
+
+gboolean live_output_handle_error(CustomData *data, GstMessage *msg) {
+    if (!data->recording_bin) return FALSE;
+
+    // 向上查找错误来源所在的 live-<name> bin
+    for (GstObject *obj = GST_MESSAGE_SRC(msg); obj != NULL; obj = GST_OBJECT_PARENT(obj)) {
+        if (GST_OBJECT_PARENT(obj) == GST_OBJECT(data->recording_bin) &&
+            g_str_has_prefix(GST_OBJECT_NAME(obj), "live-") && GST_IS_BIN(obj)) {
+            const char *name = GST_OBJECT_NAME(obj) + strlen("live-");
+            g_printerr("Live output %s failed. Detaching it.\n", name);
+            live_output_remove(data, name);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+gboolean live_output_handle_eos(CustomData *data, GstMessage *msg) {
+    GstObject *src = GST_MESSAGE_SRC(msg);
+    if (!data->recording_bin || GST_OBJECT_PARENT(src) != GST_OBJECT(data->recording_bin) ||
+        !g_str_has_prefix(GST_OBJECT_NAME(src), "live-")) {
+        return FALSE;
+    }
+
+    LiveRemoval *removal = g_object_get_data(G_OBJECT(src), REMOVING_KEY);
+    if (removal && !removal->eos_seen) {
+        removal->eos_seen = TRUE;
+        if (removal->detached) {
+            if (removal->timeout_id > 0) {
+                g_source_remove(removal->timeout_id);
+            }
+            finish_removal(removal);
+        }
+    }
+    return TRUE;
+}
+
+void live_outputs_start(CustomData *data) {
+    if (!live_outputs_configured(data)) return;
+
+    g_auto(GStrv) names = g_strsplit(iniparser_getstring(data->config_dict, "live:outputs", ""), ",", -1);
+    for (int i = 0; names[i] != NULL; i++) {
+        const char *name = g_strstrip(names[i]);
+        if (name[0] != '\0') {
+            live_output_add(data, name);
+        }
+    }
+}
+
+void live_outputs_toggle(CustomData *data) {
+    if (!data->is_recording || !live_outputs_configured(data)) return;
+
+    gboolean removed = FALSE;
+    g_auto(GStrv) names = g_strsplit(iniparser_getstring(data->config_dict, "live:outputs", ""), ",", -1);
+    for (int i = 0; names[i] != NULL; i++) {
+        removed |= live_output_remove(data, g_strstrip(names[i]));
+    }
+    if (!removed) {
+        live_outputs_start(data);
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef LIVEOUT_H
+#define LIVEOUT_H
+
+#include "config.h"
+
+/* Tees inside recording-bin that carry the encoded streams to the file muxer and live outputs */
+#define LIVE_VIDEO_TEE "record-video-out"
+#define LIVE_AUDIO_TEE "record-audio-out"
+
+/*
+ * Returns: TRUE if [live] outputs lists at least one output, in which case the
+ * recording tail is built with LIVE_VIDEO_TEE/LIVE_AUDIO_TEE in front of the muxer.
+ */
+gboolean live_outputs_configured(CustomData *data);
+
+/*
+ * Attach every output listed in [live] outputs to the running recording.
+ * data: Pointer to the CustomData structure.
+ */
+void live_outputs_start(CustomData *data);
+
+/*
+ * Attach the output described by [live_<name>] description to the running recording.
+ * The description is a gst-launch fragment whose element named "mux" receives the
+ * encoded video and audio, each through its own leaky queue so that a slow consumer
+ * drops data instead of back-pressuring the file writer.
+ * name: Output name as listed in [live] outputs.
+ * Returns: TRUE if the output is attached (or already was), FALSE otherwise.
+ */
+gboolean live_output_add(CustomData *data, const char *name);
+
+/*
+ * Detach an output from the running recording. The tee pads are unlinked from an
+ * idle probe, the output receives EOS and is removed from the main loop once it
+ * has finished.
+ * Returns: TRUE if the output was attached and is being removed.
+ */
+gboolean live_output_remove(CustomData *data, const char *name);
+
+/*
+ * Finish removing a live output once its bin has posted EOS, i.e. every sink in
+ * it has finalized (HLS writes its last segment and #EXT-X-ENDLIST). Outputs that
+ * do not finish within a few seconds are removed anyway.
+ * msg: EOS forwarded from recording-bin.
+ * Returns: TRUE if the EOS came from a live output.
+ */
+gboolean live_output_handle_eos(CustomData *data, GstMessage *msg);
+
+/*
+ * Detach the live output that posted an error, e.g. a refused connection.
+ * msg: GST_MESSAGE_ERROR received on the pipeline bus.
+ * Returns: TRUE if the error came from a live output and was handled.
+ */
+gboolean live_output_handle_error(CustomData *data, GstMessage *msg);
+
+/*
+ * Remove all attached outputs, or attach all configured outputs if none is attached.
+ */
+void live_outputs_toggle(CustomData *data);
+
+#endif // LIVEOUT_H
@@ -1,6 +1,7 @@
 #include <gtk/gtk.h>
 #include <gst/gst.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <glib-unix.h>
 
@@ -10,9 +11,33 @@
 #include "utils.h"
 #include "config.h"
 #include "recorder.h"
+#include "preroll.h"
+#include "recqueue.h"
+#include "encctl.h"
+#include "encprobe.h"
+#include "codec.h"
+#include "liveout.h"
+#include "fastsink.h"
+#include "archive.h"
+#include "budget.h"
+#include "spillqueue.h"
+#include "rawdump.h"
+#include "transcode.h"
+#include "crashsafe.h"
+#include "cut.h"
+#include "control.h"
+#include "preview.h"
+#include "latency.h"
+#include "metrics.h"
+#include "threads.h"
 
 #define CONFIG_FILE "config.ini"
 
+/* 命令行选项 (--config/--record/--duration) */
+static gchar *config_file = NULL;
+static gboolean record_on_start = FALSE;
+static gint run_duration = 0;
+
 static void create_ui (CustomData *data);
 static gboolean on_bus_message(GstBus *bus, GstMessage *msg, CustomData *data);
 
@@ -23,7 +48,7 @@ static void cleanup_application_data(CustomData *data) {
     g_print("Cleaning up application resources.\n");
 #endif
     if (data->app && data->inhibit_cookie > 0) {
-        gtk_application_uninhibit(data->app, data->inhibit_cookie);
+        gtk_application_uninhibit(GTK_APPLICATION(data->app), data->inhibit_cookie);
         data->inhibit_cookie = 0;
 #ifdef DEBUG
         g_print("System inhibit request removed.\n");
@@ -36,6 +61,7 @@ static void cleanup_application_data(CustomData *data) {
     }
 
     data->record_icon = NULL; 
+    data->header_bar = NULL;
 
     g_autoptr(GstElement) recording_bin_temp = g_atomic_pointer_exchange(&data->recording_bin, NULL);
     if (recording_bin_temp) {
@@ -46,11 +72,27 @@ static void cleanup_application_data(CustomData *data) {
         g_free(data->recording_filename);
         data->recording_filename = NULL;
     }
+    g_clear_pointer(&data->video_encoder, g_free);
 
     g_autoptr(GstElement) pipeline_temp = g_atomic_pointer_exchange(&data->pipeline, NULL);
     if (pipeline_temp) {
         gst_element_set_state(pipeline_temp, GST_STATE_NULL);
     }
+
+    control_free(data);
+    metrics_free(data);
+    g_clear_pointer(&data->spare_recording_bin, gst_object_unref);
+    record_cut_free(data);
+    preview_latency_free(data);
+    latency_tracer_free(data);
+    thread_monitor_free(data);
+    preview_throttle_free(data);
+    preroll_branch_free(data);
+    record_queue_guard_free(data);
+    encoder_control_free(data);
+    record_budget_free(data);
+    transcode_free(data);
+    archive_free(data);
 }
 
 /* 辅助函数：用于安全地向管道发送 EOS 事件，启动退出流程 */
@@ -64,11 +106,18 @@ static gboolean send_eos_and_quit (gpointer user_data) {
   g_print("Sending EOS event to the pipeline.\n");
 #endif
 
-  if (data->is_recording) {
+  if (data->is_recording && !data->is_stopping_recording) {
 #ifdef DEBUG
       g_print("Recording active during quit request, initiating graceful stop.\n");
 #endif
       stop_recording(data);
+  }
+  if (data->is_recording && !data->main_window) {
+      // 无界面模式没有对话框阻塞在这里，等 cleanup_recording_async 收尾 (转码/迁移入队) 后再发送 EOS
+      data->quit_after_recording = TRUE;
+      return G_SOURCE_REMOVE;
+  }
+  if (data->is_recording && data->main_window) {
       data->dialog = gtk_message_dialog_new(GTK_WINDOW(data->main_window),
                                                  GTK_DIALOG_DESTROY_WITH_PARENT,
                                                  GTK_MESSAGE_INFO,
@@ -79,6 +128,7 @@ static gboolean send_eos_and_quit (gpointer user_data) {
   }
 
   if (data->pipeline) {
+      preroll_branch_prepare_eos(data);
       gst_element_send_event(data->pipeline, gst_event_new_eos());
   } else {
       g_application_quit(G_APPLICATION(data->app));
@@ -102,13 +152,8 @@ static void toggle_fullscreen(CustomData *data) {
     is_fullscreen = !is_fullscreen;
 }
 
-/* 按钮点击回调函数 */
-static void fullscreen_button_cb (GtkButton *button, CustomData *data) {
-    toggle_fullscreen(data);
-}
-
-/* 录制按钮点击回调函数 */
-static void record_button_cb (GtkButton *button, CustomData *data) {
+/* 开始或停止录制 (录制按钮和 SIGUSR1 共用) */
+static void toggle_recording(CustomData *data) {
     if (data->is_stopping_recording) {
 #ifdef DEBUG
         g_print("Recording is currently stopping/cleaning up. Please wait.\n");
@@ -117,15 +162,27 @@ static void record_button_cb (GtkButton *button, CustomData *data) {
     }
     if (data->is_recording) {
         stop_recording(data);
-        gtk_image_set_from_icon_name(GTK_IMAGE(data->record_icon), "media-record-symbolic", GTK_ICON_SIZE_SMALL_TOOLBAR);
+        if (data->record_icon) {
+            gtk_image_set_from_icon_name(GTK_IMAGE(data->record_icon), "media-record-symbolic", GTK_ICON_SIZE_SMALL_TOOLBAR);
+        }
     } else {
         start_recording(data);
-        if (data->is_recording) {
+        if (data->is_recording && data->record_icon) {
             gtk_image_set_from_icon_name(GTK_IMAGE(data->record_icon), "media-playback-stop-symbolic", GTK_ICON_SIZE_SMALL_TOOLBAR);
         }
     }
 }
 
+/* 按钮点击回调函数 */
+static void fullscreen_button_cb (GtkButton *button, CustomData *data) {
+    toggle_fullscreen(data);
+}
+
+/* 录制按钮点击回调函数 */
+static void record_button_cb (GtkButton *button, CustomData *data) {
+    toggle_recording(data);
+}
+
 /* 键盘事件回调函数 */
 static gboolean key_press_event_cb (GtkWidget *widget, GdkEvent *event, CustomData *data) {
   guint keyval;
@@ -143,6 +200,11 @@ static gboolean key_press_event_cb (GtkWidget *widget, GdkEvent *event, CustomDa
       /* 按下 F 键切换全屏模式 */
       toggle_fullscreen(data);
       return TRUE;
+    case GDK_KEY_l:
+    case GDK_KEY_L:
+      /* 按下 L 键在录制过程中接入/断开所有直播输出 */
+      live_outputs_toggle(data);
+      return TRUE;
     default:
       break;
   }
@@ -156,7 +218,7 @@ static void create_ui (CustomData *data) {
   GtkWidget *record_button;     /* 录制按钮 */
   GtkWidget *fullscreen_button; /* 全屏按钮 */
 
-  data->main_window = gtk_application_window_new (data->app);
+  data->main_window = gtk_application_window_new (GTK_APPLICATION(data->app));
   g_signal_connect (G_OBJECT (data->main_window), "delete-event", G_CALLBACK (on_delete_event), data);
   g_signal_connect (G_OBJECT (data->main_window), "key-press-event", G_CALLBACK (key_press_event_cb), data);
 
@@ -191,6 +253,7 @@ static void create_ui (CustomData *data) {
 
   /* 将 HeaderBar 设置为窗口的标题栏 */
   gtk_window_set_titlebar(GTK_WINDOW(data->main_window), header_bar);
+  data->header_bar = header_bar;
 
   /* 主布局 (垂直排列，只包含视频区域，HeaderBar由gtk_window_set_titlebar管理) */
   main_box = gtk_box_new (GTK_ORIENTATION_VERTICAL, 0);
@@ -212,10 +275,12 @@ static void create_ui (CustomData *data) {
   gtk_window_set_default_size (GTK_WINDOW (data->main_window), width, height);
   gtk_window_set_position (GTK_WINDOW (data->main_window), GTK_WIN_POS_CENTER);
 
+  preview_throttle_watch(data, data->main_window);
   gtk_widget_show_all (data->main_window);
+  preview_latency_watch(data);
 
   data->inhibit_cookie = gtk_application_inhibit(
-      data->app,
+      GTK_APPLICATION(data->app),
       GTK_WINDOW(data->main_window),
       GTK_APPLICATION_INHIBIT_SUSPEND | GTK_APPLICATION_INHIBIT_IDLE,
       "Video Playback Active"
@@ -232,6 +297,26 @@ static gboolean signal_handler(gpointer user_data) {
     return G_SOURCE_REMOVE; 
 }
 
+/* SIGUSR1：开始/停止录制，用于无界面模式 */
+static gboolean record_signal_handler(gpointer user_data) {
+    toggle_recording((CustomData *)user_data);
+    return G_SOURCE_CONTINUE;
+}
+
+/* SIGUSR2：输出延迟直方图和流线程 CPU 统计 */
+static gboolean latency_signal_handler(gpointer user_data) {
+    latency_tracer_dump((CustomData *)user_data);
+    thread_monitor_report((CustomData *)user_data);
+    return G_SOURCE_CONTINUE;
+}
+
+/* --duration 到期：与 SIGTERM 相同的退出流程 */
+static gboolean on_duration_elapsed(gpointer user_data) {
+    g_print("Run duration of %d s elapsed. Quitting.\n", run_duration);
+    send_eos_and_quit(user_data);
+    return G_SOURCE_REMOVE;
+}
+
 static gboolean on_bus_message(GstBus *bus, GstMessage *msg, CustomData *data) {
     switch (GST_MESSAGE_TYPE(msg)) {
         case GST_MESSAGE_ERROR: {
@@ -242,6 +327,11 @@ static gboolean on_bus_message(GstBus *bus, GstMessage *msg, CustomData *data) {
             g_printerr("Error received from element %s: %s\n", GST_OBJECT_NAME(msg->src), err->message);
             g_printerr("Debugging information: %s\n", debug_info ? debug_info : "none");
 
+            // 直播输出出错只断开该输出，不影响预览和录制文件
+            if (live_output_handle_error(data, msg)) {
+                break;
+            }
+
             cleanup_application_data(data); 
             g_application_quit(G_APPLICATION(data->app));
             break;
@@ -256,7 +346,24 @@ static gboolean on_bus_message(GstBus *bus, GstMessage *msg, CustomData *data) {
             break;
         }
 
+        case GST_MESSAGE_STATE_CHANGED: {
+            // --record：主管道第一次进入 PLAYING 时开始录制
+            GstState new_state;
+            gst_message_parse_state_changed(msg, NULL, &new_state, NULL);
+            if (record_on_start && GST_MESSAGE_SRC(msg) == GST_OBJECT(data->pipeline) && new_state == GST_STATE_PLAYING) {
+                record_on_start = FALSE;
+                toggle_recording(data);
+            }
+            break;
+        }
+
+        case GST_MESSAGE_QOS:
+            metrics_handle_message(data, msg);
+            break;
+
         case GST_MESSAGE_ELEMENT: {
+            recorder_handle_element_message(data, msg);
+
             if (gst_message_has_name(msg, "GstBinForwarded")) {
                 const GstStructure *s = gst_message_get_structure(msg);
                 const GValue *gv = gst_structure_get_value(s, "message");
@@ -266,9 +373,18 @@ static gboolean on_bus_message(GstBus *bus, GstMessage *msg, CustomData *data) {
                     forwarded_msg = (GstMessage *)g_value_get_boxed(gv);
                 }
 
+                if (forwarded_msg != NULL && GST_MESSAGE_TYPE(forwarded_msg) == GST_MESSAGE_ELEMENT) {
+                    recorder_handle_element_message(data, forwarded_msg);
+                }
+
                 if (forwarded_msg != NULL && GST_MESSAGE_TYPE(forwarded_msg) == GST_MESSAGE_EOS) {
+                    // 正在移除的直播输出处理完 EOS 后再销毁
+                    if (live_output_handle_eos(data, forwarded_msg)) {
+                        break;
+                    }
                     if (data->is_stopping_recording && 
-                        GST_ELEMENT_CAST(GST_OBJECT_PARENT(GST_MESSAGE_SRC(forwarded_msg))) == data->recording_bin) {
+                        GST_ELEMENT_CAST(GST_OBJECT_PARENT(GST_MESSAGE_SRC(forwarded_msg))) == data->recording_bin &&
+                        recorder_sink_eos(data, GST_MESSAGE_SRC(forwarded_msg))) {
 #ifdef DEBUG
                              g_print("Received forwarded EOS from recording sink. Initiating final cleanup via idle function.\n");
 #endif
@@ -284,25 +400,50 @@ static gboolean on_bus_message(GstBus *bus, GstMessage *msg, CustomData *data) {
     return TRUE;
 }
 
-static void on_activate(GtkApplication* app, gpointer user_data) {
+static void on_activate(GApplication* app, gpointer user_data) {
     CustomData *data = (CustomData *)user_data;
     data->app = app; // 保存 app 指针到数据结构
 
-    data->config_dict = iniparser_load(CONFIG_FILE);
+    data->config_dict = iniparser_load(config_file);
     if (!data->config_dict) {
-        g_printerr("Fatal error: Could not open or parse configuration file %s\n", CONFIG_FILE);
+        g_printerr("Fatal error: Could not open or parse configuration file %s\n", config_file);
         g_application_quit(G_APPLICATION(app));
         return;
     }
 
+    // 选择录制编码器 (可选的启动测试)
+    encoder_probe_run(data);
+    if (!codec_resolve_chain(data)) {
+        // 预览和直播输出不依赖录制链，只禁用录制
+        g_printerr("Warning: Failed to resolve a recording codec chain. Recording disabled.\n");
+        memset(&data->record_chain, 0, sizeof(data->record_chain));
+    }
+
     if (!initialize_gstreamer_pipeline(data)) {
         g_printerr("Failed to initialize GStreamer pipeline. Exiting.\n");
         cleanup_application_data(data);
         g_application_quit(G_APPLICATION(app));
         return;
     }
-
-    create_ui (data);
+    latency_tracer_init(data);
+    metrics_init(data);
+    thread_monitor_init(data);
+    archive_init(data);
+    transcode_init(data);
+    // 上次异常退出留下的分片录制文件
+    crash_safe_recover(data);
+    control_init(data);
+
+    if (data->headless) {
+        // 没有窗口维持 GApplication 运行，退出由信号、--duration 或管道 EOS 触发
+        g_application_hold(app);
+        g_print("Running headless. Send SIGUSR1 to start/stop recording.\n");
+    } else {
+        create_ui (data);
+    }
+    if (run_duration > 0) {
+        g_timeout_add_seconds(run_duration, on_duration_elapsed, data);
+    }
 
     g_autoptr(GstBus) bus = gst_element_get_bus (data->pipeline);
     gst_bus_add_signal_watch (bus);
@@ -317,21 +458,71 @@ static void on_activate(GtkApplication* app, gpointer user_data) {
     }
 }
 
+/* 命令行选项：在启动界面之前处理，返回非负值表示直接退出 */
+static gint on_handle_local_options(GApplication *app, GVariantDict *options, gpointer user_data) {
+    g_variant_dict_lookup(options, "config", "^ay", &config_file);
+    if (!config_file) {
+        config_file = g_strdup(CONFIG_FILE);
+    }
+    record_on_start = g_variant_dict_contains(options, "record");
+    g_variant_dict_lookup(options, "duration", "i", &run_duration);
+
+    if (g_variant_dict_contains(options, "benchmark-mux")) {
+        dictionary *dict = iniparser_load(config_file);
+        if (!dict) {
+            g_printerr("Fatal error: Could not open or parse configuration file %s\n", config_file);
+            return 1;
+        }
+        int status = crash_safe_benchmark(dict);
+        iniparser_freedict(dict);
+        return status;
+    }
+    return -1;
+}
+
 int main(int argc, char *argv[]) {
   CustomData data = {0};
   int status;
 
-  data.app = gtk_application_new("org.gstcapture", G_APPLICATION_DEFAULT_FLAGS);
+  // 无界面模式不能使用 GtkApplication (启动时需要显示器)，必须在创建实例之前确定
+  for (int i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "--headless") == 0) {
+          data.headless = TRUE;
+      }
+  }
+
+  if (data.headless) {
+      data.app = g_application_new("org.gstcapture", G_APPLICATION_NON_UNIQUE);
+  } else {
+      data.app = G_APPLICATION(gtk_application_new("org.gstcapture", G_APPLICATION_DEFAULT_FLAGS));
+  }
   g_signal_connect(data.app, "activate", G_CALLBACK(on_activate), &data);
+  g_application_add_main_option(data.app, "benchmark-mux", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE,
+                                "Measure crash-safe MP4 overhead against plain mp4mux and exit", NULL);
+  g_application_add_main_option(data.app, "headless", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE,
+                                "Run without window and GL preview (main:headless_sink), SIGUSR1 toggles recording", NULL);
+  g_application_add_main_option(data.app, "config", 'c', G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME,
+                                "Configuration file (default " CONFIG_FILE ")", "FILE");
+  g_application_add_main_option(data.app, "record", 'r', G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE,
+                                "Start recording as soon as the pipeline is playing", NULL);
+  g_application_add_main_option(data.app, "duration", 'd', G_OPTION_FLAG_NONE, G_OPTION_ARG_INT,
+                                "Stop recording and quit after this many seconds", "SECONDS");
+  g_signal_connect(data.app, "handle-local-options", G_CALLBACK(on_handle_local_options), &data);
 
   g_unix_signal_add(SIGINT, signal_handler, &data);
   g_unix_signal_add(SIGTERM, signal_handler, &data);
+  g_unix_signal_add(SIGUSR1, record_signal_handler, &data);
+  g_unix_signal_add(SIGUSR2, latency_signal_handler, &data);
 
   gst_init (&argc, &argv);
+  fast_file_sink_register();
+  spill_queue_register();
+  raw_dump_register();
 
-  status = g_application_run(G_APPLICATION(data.app), argc, argv);
+  status = g_application_run(data.app, argc, argv);
 
   g_object_unref(data.app);
+  g_free(config_file);
 
   return status;
 }
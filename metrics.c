@@ -0,0 +1,385 @@
+#include "utils.h"
+#include "config.h"
+#include "metrics.h"
+#include "recqueue.h"
+#include <gst/gst.h>
+#include <gio/gio.h>
+#include <gio/gunixsocketaddress.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <iniparser.h>
+
+typedef struct {
+    gchar *name;                        /* 元素名，跨录制保留 */
+    const char *kind;                   /* source / encoder / sink / queue */
+    guint64 buffers;                    /* 流线程原子累加 */
+    guint64 bytes;
+    guint64 overruns;                   /* 队列满 (leaky 队列即丢帧) */
+    guint64 dropped;                    /* QoS 消息报告的丢帧，主线程更新 */
+
+    /* 每秒由主循环计算 */
+    guint64 last_buffers;
+    guint64 last_bytes;
+    gdouble fps;
+    gdouble bitrate;
+} MetricPoint;
+
+struct _MetricsExporter {
+    CustomData *data;
+    GstElement *pipeline;
+    GSocketService *service;
+    gchar *socket_path;                 /* unix socket 模式下的路径，否则为 NULL */
+    GMutex lock;                        /* 保护 points/by_name，元素可能在流线程上加入 */
+    GPtrArray *points;                  /* 按加入顺序 */
+    GHashTable *by_name;
+    gulong added_id;
+    guint tick_id;
+    gint64 last_tick;
+};
+
+typedef struct {
+    CustomData *data;
+    MetricsExporter *ms;                /* 只与 data->metrics 比较，应答前可能已释放 */
+    GSocketConnection *connection;
+    gchar request[2048];
+} MetricsRequest;
+
+static MetricPoint *lookup_point(MetricsExporter *ms, const gchar *name, const char *kind) {
+    g_mutex_lock(&ms->lock);
+    MetricPoint *point = g_hash_table_lookup(ms->by_name, name);
+    if (!point) {
+        point = g_new0(MetricPoint, 1);
+        point->name = g_strdup(name);
+        point->kind = kind;
+        g_ptr_array_add(ms->points, point);
+        g_hash_table_insert(ms->by_name, point->name, point);
+    }
+    g_mutex_unlock(&ms->lock);
+    return point;
+}
+
+static GstPadProbeReturn count_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    MetricPoint *point = (MetricPoint *)user_data;
+    if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+        GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+        counter_add(&point->buffers, gst_buffer_list_length(list));
+        counter_add(&point->bytes, gst_buffer_list_calculate_size(list));
+    } else {
+        counter_add(&point->buffers, 1);
+        counter_add(&point->bytes, gst_buffer_get_size(GST_PAD_PROBE_INFO_BUFFER(info)));
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static void on_queue_overrun(GstElement *queue, gpointer user_data) {
+    counter_add(&((MetricPoint *)user_data)->overruns, 1);
+}
+
+// 辅助函数：源和编码器统计输出，sink 统计输入，队列只连接 overrun 信号
+static void attach_element(MetricsExporter *ms, GstElement *element) {
+    GstElementFactory *factory = gst_element_get_factory(element);
+    const char *klass = factory ? gst_element_factory_get_metadata(factory, GST_ELEMENT_METADATA_KLASS) : NULL;
+    const char *kind = NULL;
+    gboolean on_sink_pad = FALSE;
+
+    if (g_signal_lookup("overrun", G_OBJECT_TYPE(element)) != 0) {
+        g_signal_connect(element, "overrun", G_CALLBACK(on_queue_overrun), lookup_point(ms, GST_OBJECT_NAME(element), "queue"));
+        return;
+    }
+    if (GST_OBJECT_FLAG_IS_SET(element, GST_ELEMENT_FLAG_SOURCE)) {
+        kind = "source";
+    } else if (klass && strstr(klass, "Encoder")) {
+        kind = "encoder";
+    } else if (GST_OBJECT_FLAG_IS_SET(element, GST_ELEMENT_FLAG_SINK) && element->numsrcpads == 0) {
+        kind = "sink";
+        on_sink_pad = TRUE;
+    } else {
+        return;
+    }
+
+    MetricPoint *point = lookup_point(ms, GST_OBJECT_NAME(element), kind);
+    g_autoptr(GstIterator) it = on_sink_pad ? gst_element_iterate_sink_pads(element) : gst_element_iterate_src_pads(element);
+    GValue item = G_VALUE_INIT;
+    while (gst_iterator_next(it, &item) == GST_ITERATOR_OK) {
+        gst_pad_add_probe(g_value_get_object(&item), GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+                          count_probe, point, NULL);
+        g_value_reset(&item);
+    }
+    g_value_unset(&item);
+}
+
+// 初始化时遍历已有的元素；之后加入的元素 (包括随 bin 一起加入的子元素) 各自触发 deep-element-added
+static void attach_existing(MetricsExporter *ms, GstElement *element) {
+    g_autoptr(GstIterator) it = gst_bin_iterate_recurse(GST_BIN(element));
+    GValue item = G_VALUE_INIT;
+    while (gst_iterator_next(it, &item) == GST_ITERATOR_OK) {
+        GstElement *child = g_value_get_object(&item);
+        if (!GST_IS_BIN(child)) {
+            attach_element(ms, child);
+        }
+        g_value_reset(&item);
+    }
+    g_value_unset(&item);
+}
+
+static void on_deep_element_added(GstBin *bin, GstBin *sub_bin, GstElement *element, gpointer user_data) {
+    if (!GST_IS_BIN(element)) {
+        attach_element((MetricsExporter *)user_data, element);
+    }
+}
+
+// 定时回调：由计数差值计算帧率和码率
+static gboolean metrics_tick(gpointer user_data) {
+    MetricsExporter *ms = (MetricsExporter *)user_data;
+    gint64 now = g_get_monotonic_time();
+    gdouble seconds = (now - ms->last_tick) / 1e6;
+    ms->last_tick = now;
+    if (seconds <= 0) return G_SOURCE_CONTINUE;
+
+    g_mutex_lock(&ms->lock);
+    for (guint i = 0; i < ms->points->len; i++) {
+        MetricPoint *point = g_ptr_array_index(ms->points, i);
+        guint64 buffers = counter_get(&point->buffers);
+        guint64 bytes = counter_get(&point->bytes);
+        point->fps = (buffers - point->last_buffers) / seconds;
+        point->bitrate = (bytes - point->last_bytes) * 8.0 / seconds;
+        point->last_buffers = buffers;
+        point->last_bytes = bytes;
+    }
+    g_mutex_unlock(&ms->lock);
+    return G_SOURCE_CONTINUE;
+}
+
+void metrics_handle_message(CustomData *data, GstMessage *msg) {
+    MetricsExporter *ms = data->metrics;
+    if (!ms || GST_MESSAGE_TYPE(msg) != GST_MESSAGE_QOS || !GST_IS_ELEMENT(GST_MESSAGE_SRC(msg))) return;
+
+    GstFormat format;
+    guint64 processed, dropped;
+    gst_message_parse_qos_stats(msg, &format, &processed, &dropped);
+    if (format != GST_FORMAT_BUFFERS || dropped == (guint64)-1) return;
+
+    // sink 报告的是累计值，源 (例如 v4l2src 检测到丢帧) 每次报告一段
+    GstElement *element = GST_ELEMENT(GST_MESSAGE_SRC(msg));
+    MetricPoint *point = lookup_point(ms, GST_OBJECT_NAME(element), GST_OBJECT_FLAG_IS_SET(element, GST_ELEMENT_FLAG_SINK) ? "sink" : "source");
+    if (GST_OBJECT_FLAG_IS_SET(element, GST_ELEMENT_FLAG_SINK)) {
+        point->dropped = MAX(point->dropped, dropped);
+    } else {
+        point->dropped += dropped;
+    }
+}
+
+// 辅助函数：Prometheus 标签值转义
+static gchar *label(const char *value) {
+    GString *s = g_string_new(NULL);
+    for (const char *p = value; *p; p++) {
+        if (*p == '\\' || *p == '"') g_string_append_c(s, '\\');
+        if (*p == '\n') { g_string_append(s, "\\n"); continue; }
+        g_string_append_c(s, *p);
+    }
+    return g_string_free(s, FALSE);
+}
+
+static void append_header(GString *out, const char *name, const char *type, const char *help) {
+    g_string_append_printf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// 辅助函数：在抓取时读取队列水位，不在流线程上轮询属性
+static void append_queue_levels(MetricsExporter *ms, GString *out) {
+    append_header(out, "gst_capture_queue_level_buffers", "gauge", "Buffers currently queued.");
+    g_autoptr(GString) bytes = g_string_new(NULL);
+    g_autoptr(GString) seconds = g_string_new(NULL);
+    g_autoptr(GString) fill = g_string_new(NULL);
+
+    g_autoptr(GstIterator) it = gst_bin_iterate_recurse(GST_BIN(ms->pipeline));
+    GValue item = G_VALUE_INIT;
+    while (gst_iterator_next(it, &item) == GST_ITERATOR_OK) {
+        GstElement *element = g_value_get_object(&item);
+        GObjectClass *klass = G_OBJECT_GET_CLASS(element);
+        g_autofree gchar *name = label(GST_OBJECT_NAME(element));
+
+        if (g_object_class_find_property(klass, "current-level-buffers")) {
+            guint level_buffers = 0, level_bytes = 0, max_buffers = 0, max_bytes = 0;
+            guint64 level_time = 0, max_time = 0;
+            g_object_get(element, "current-level-buffers", &level_buffers, "current-level-bytes", &level_bytes,
+                         "current-level-time", &level_time, "max-size-buffers", &max_buffers,
+                         "max-size-bytes", &max_bytes, "max-size-time", &max_time, NULL);
+            gdouble ratio = 0.0;
+            if (max_buffers > 0) ratio = MAX(ratio, (gdouble)level_buffers / max_buffers);
+            if (max_bytes > 0) ratio = MAX(ratio, (gdouble)level_bytes / max_bytes);
+            if (max_time > 0) ratio = MAX(ratio, (gdouble)level_time / max_time);
+            g_string_append_printf(out, "gst_capture_queue_level_buffers{queue=\"%s\"} %u\n", name, level_buffers);
+            g_string_append_printf(bytes, "gst_capture_queue_level_bytes{queue=\"%s\"} %u\n", name, level_bytes);
+            g_string_append_printf(seconds, "gst_capture_queue_level_seconds{queue=\"%s\"} %.6f\n", name, (gdouble)level_time / GST_SECOND);
+            g_string_append_printf(fill, "gst_capture_queue_fill_ratio{queue=\"%s\"} %.4f\n", name, ratio);
+        } else if (g_object_class_find_property(klass, "current-spill")) {
+            // spillqueue：内存部分相对 max-memory，溢出部分也计入字节数
+            guint64 memory = 0, spill = 0, max_memory = 0;
+            g_object_get(element, "current-memory", &memory, "current-spill", &spill, "max-memory", &max_memory, NULL);
+            g_string_append_printf(bytes, "gst_capture_queue_level_bytes{queue=\"%s\"} %" G_GUINT64_FORMAT "\n", name, memory + spill);
+            g_string_append_printf(fill, "gst_capture_queue_fill_ratio{queue=\"%s\"} %.4f\n", name,
+                                   max_memory > 0 ? (gdouble)memory / max_memory : 0.0);
+        }
+        g_value_reset(&item);
+    }
+    g_value_unset(&item);
+
+    append_header(out, "gst_capture_queue_level_bytes", "gauge", "Bytes currently queued.");
+    g_string_append(out, bytes->str);
+    append_header(out, "gst_capture_queue_level_seconds", "gauge", "Duration currently queued.");
+    g_string_append(out, seconds->str);
+    append_header(out, "gst_capture_queue_fill_ratio", "gauge", "Fill level relative to the queue limits.");
+    g_string_append(out, fill->str);
+}
+
+static gchar *render_metrics(MetricsExporter *ms) {
+    CustomData *data = ms->data;
+    GString *out = g_string_new(NULL);
+
+    append_header(out, "gst_capture_recording", "gauge", "1 while a recording is active.");
+    g_string_append_printf(out, "gst_capture_recording %d\n", data->is_recording ? 1 : 0);
+    append_header(out, "gst_capture_recording_stopping", "gauge", "1 while a recording is being finalized.");
+    g_string_append_printf(out, "gst_capture_recording_stopping %d\n", data->is_stopping_recording ? 1 : 0);
+    append_header(out, "gst_capture_recording_seconds", "gauge", "Duration of the current recording.");
+    g_string_append_printf(out, "gst_capture_recording_seconds %.3f\n",
+                           data->is_recording ? (g_get_monotonic_time() - data->record_start_time) / 1e6 : 0.0);
+    append_header(out, "gst_capture_record_queue_lag_seconds", "gauge", "Age of the oldest frame in the recording queue.");
+    g_string_append_printf(out, "gst_capture_record_queue_lag_seconds %.6f\n", (gdouble)record_queue_guard_lag(data) / GST_SECOND);
+
+    static const struct { const char *name, *type, *help; } series[] = {
+        { "gst_capture_buffers_total", "counter", "Buffers leaving a source/encoder or reaching a sink." },
+        { "gst_capture_bytes_total", "counter", "Bytes leaving a source/encoder or reaching a sink." },
+        { "gst_capture_fps", "gauge", "Buffers per second over the last second." },
+        { "gst_capture_bitrate_bps", "gauge", "Bits per second over the last second." },
+        { "gst_capture_dropped_total", "counter", "Buffers dropped as reported by QoS messages." },
+        { "gst_capture_queue_overruns_total", "counter", "Times a queue was full (a dropped buffer for leaky queues)." },
+    };
+    g_mutex_lock(&ms->lock);
+    for (guint s = 0; s < G_N_ELEMENTS(series); s++) {
+        append_header(out, series[s].name, series[s].type, series[s].help);
+        for (guint i = 0; i < ms->points->len; i++) {
+            MetricPoint *point = g_ptr_array_index(ms->points, i);
+            gboolean is_queue = g_strcmp0(point->kind, "queue") == 0;
+            if ((s == 5) != is_queue) continue;
+
+            g_autofree gchar *name = label(point->name);
+            switch (s) {
+            case 0: g_string_append_printf(out, "%s{element=\"%s\",kind=\"%s\"} %" G_GUINT64_FORMAT "\n", series[s].name, name, point->kind, counter_get(&point->buffers)); break;
+            case 1: g_string_append_printf(out, "%s{element=\"%s\",kind=\"%s\"} %" G_GUINT64_FORMAT "\n", series[s].name, name, point->kind, counter_get(&point->bytes)); break;
+            case 2: g_string_append_printf(out, "%s{element=\"%s\",kind=\"%s\"} %.2f\n", series[s].name, name, point->kind, point->fps); break;
+            case 3: g_string_append_printf(out, "%s{element=\"%s\",kind=\"%s\"} %.0f\n", series[s].name, name, point->kind, point->bitrate); break;
+            case 4: g_string_append_printf(out, "%s{element=\"%s\",kind=\"%s\"} %" G_GUINT64_FORMAT "\n", series[s].name, name, point->kind, point->dropped); break;
+            case 5: g_string_append_printf(out, "%s{queue=\"%s\"} %" G_GUINT64_FORMAT "\n", series[s].name, name, counter_get(&point->overruns)); break;
+            }
+        }
+    }
+    g_mutex_unlock(&ms->lock);
+
+    append_queue_levels(ms, out);
+    return g_string_free(out, FALSE);
+}
+
+// 读到请求后直接应答，不区分路径
+static void on_request_read(GObject *source, GAsyncResult *result, gpointer user_data) {
+    MetricsRequest *req = (MetricsRequest *)user_data;
+    gssize n = g_input_stream_read_finish(G_INPUT_STREAM(source), result, NULL);
+
+    if (n > 0 && req->data->metrics == req->ms) {
+        g_autofree gchar *body = render_metrics(req->ms);
+        g_autofree gchar *response = g_strdup_printf("HTTP/1.0 200 OK\r\n"
+                                                     "Content-Type: text/plain; version=0.0.4\r\n"
+                                                     "Content-Length: %zu\r\n"
+                                                     "Connection: close\r\n\r\n%s", strlen(body), body);
+        GOutputStream *out = g_io_stream_get_output_stream(G_IO_STREAM(req->connection));
+        g_output_stream_write_all(out, response, strlen(response), NULL, NULL, NULL);
+    }
+    g_io_stream_close(G_IO_STREAM(req->connection), NULL, NULL);
+    g_object_unref(req->connection);
+    g_free(req);
+}
+
+static gboolean on_incoming(GSocketService *service, GSocketConnection *connection, GObject *source_object, gpointer user_data) {
+    MetricsRequest *req = g_new0(MetricsRequest, 1);
+    req->ms = (MetricsExporter *)user_data;
+    req->data = req->ms->data;
+    req->connection = g_object_ref(connection);
+    g_input_stream_read_async(g_io_stream_get_input_stream(G_IO_STREAM(connection)), req->request, sizeof(req->request) - 1,
+                              G_PRIORITY_LOW, NULL, on_request_read, req);
+    return TRUE;
+}
+
+void metrics_init(CustomData *data) {
+    dictionary *dict = data->config_dict;
+    if (!data->pipeline || !iniparser_getboolean(dict, "metrics:enable", 0)) {
+        return;
+    }
+
+    const char *socket_path = iniparser_getstring(dict, "metrics:socket", NULL);
+    int port = iniparser_getint(dict, "metrics:port", 9464);
+    g_autoptr(GSocketAddress) address = NULL;
+    if (socket_path && *socket_path) {
+        g_unlink(socket_path);
+        address = g_unix_socket_address_new(socket_path);
+    } else {
+        // 只监听本机
+        address = g_inet_socket_address_new_from_string("127.0.0.1", port);
+    }
+
+    GSocketService *service = g_socket_service_new();
+    g_autoptr(GError) error = NULL;
+    if (!address || !g_socket_listener_add_address(G_SOCKET_LISTENER(service), address, G_SOCKET_TYPE_STREAM,
+                                                   G_SOCKET_PROTOCOL_DEFAULT, NULL, NULL, &error)) {
+        g_printerr("Warning: Could not start the metrics endpoint: %s\n", error ? error->message : "invalid address");
+        g_object_unref(service);
+        return;
+    }
+
+    MetricsExporter *ms = g_new0(MetricsExporter, 1);
+    ms->data = data;
+    ms->pipeline = gst_object_ref(data->pipeline);
+    ms->service = service;
+    ms->socket_path = socket_path && *socket_path ? g_strdup(socket_path) : NULL;
+    g_mutex_init(&ms->lock);
+    ms->points = g_ptr_array_new();
+    ms->by_name = g_hash_table_new(g_str_hash, g_str_equal);
+    ms->last_tick = g_get_monotonic_time();
+
+    attach_existing(ms, data->pipeline);
+    ms->added_id = g_signal_connect(ms->pipeline, "deep-element-added", G_CALLBACK(on_deep_element_added), ms);
+    ms->tick_id = g_timeout_add_seconds(1, metrics_tick, ms);
+    g_signal_connect(service, "incoming", G_CALLBACK(on_incoming), ms);
+    g_socket_service_start(service);
+
+    data->metrics = ms;
+    if (ms->socket_path) {
+        g_print("Metrics available on unix socket %s.\n", ms->socket_path);
+    } else {
+        g_print("Metrics available at http://127.0.0.1:%d/metrics.\n", port);
+    }
+}
+
+void metrics_free(CustomData *data) {
+    MetricsExporter *ms = g_steal_pointer(&data->metrics);
+    if (!ms) return;
+
+    g_socket_service_stop(ms->service);
+    g_socket_listener_close(G_SOCKET_LISTENER(ms->service));
+    g_object_unref(ms->service);
+    g_source_remove(ms->tick_id);
+    g_signal_handler_disconnect(ms->pipeline, ms->added_id);
+    gst_object_unref(ms->pipeline);
+    if (ms->socket_path) {
+        g_unlink(ms->socket_path);
+        g_free(ms->socket_path);
+    }
+    // 管道已经停止，探针和 overrun 回调不会再被调用
+    for (guint i = 0; i < ms->points->len; i++) {
+        MetricPoint *point = g_ptr_array_index(ms->points, i);
+        g_free(point->name);
+        g_free(point);
+    }
+    g_ptr_array_unref(ms->points);
+    g_hash_table_unref(ms->by_name);
+    g_mutex_clear(&ms->lock);
+    g_free(ms);
+}
@@ -0,0 +1,26 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "config.h"
+
+/*
+ * Serve live metrics in Prometheus text format when [metrics] enable is set, over
+ * HTTP on 127.0.0.1:[metrics] port or on the unix socket [metrics] socket.
+ * Sources, encoders and sinks (including those of each recording bin) count
+ * buffers and bytes in pad probes with atomic adds; fps and bit rates are derived
+ * once a second on the main loop. Drops come from QoS messages and queue overrun
+ * signals, and queue fill levels are read only when a scrape arrives.
+ * Call after initialize_gstreamer_pipeline().
+ */
+void metrics_init(CustomData *data);
+
+/*
+ * Account for QoS messages (dropped buffers in sources and sinks).
+ * data: Pointer to the CustomData structure.
+ * msg: Message received on the pipeline bus.
+ */
+void metrics_handle_message(CustomData *data, GstMessage *msg);
+
+void metrics_free(CustomData *data);
+
+#endif // METRICS_H
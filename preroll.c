@@ -0,0 +1,456 @@
+#include "utils.h"
+#include "config.h"
+#include "recorder.h"
+#include "preroll.h"
+#include "recqueue.h"
+#include "encctl.h"
+#include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/video/video.h>
+#include <stdio.h>
+#include <string.h>
+#include <iniparser.h>
+
+#define PREROLL_DRAIN_TIMEOUT 5
+#define PREROLL_DRAIN_EVENT "preroll-drain"
+
+struct _PrerollBranch {
+    GMutex lock;                        /* 保护以下所有字段，appsink 回调在各自的流线程中运行 */
+
+    GQueue video;                       /* 视频 GstSample 环形缓冲，队首总是关键帧 */
+    GQueue audio;                       /* 音频 GstSample 环形缓冲 */
+    guint video_gops;                   /* 环中完整/不完整 GOP 的数量 */
+    gsize ring_bytes;                   /* 环中缓冲的总字节数 */
+
+    gboolean ring_enabled;              /* persistent 模式下 seconds=0 时不保留环形缓冲 */
+    GstClockTime keep_time;             /* [preroll] seconds */
+    gsize max_bytes;                    /* [preroll] max-bytes，0 表示不限 */
+
+    GstElement *video_src;              /* 录制尾部的 appsrc，未录制时为 NULL */
+    GstElement *audio_src;
+    GstClockTime base_time;             /* 写入文件的时间戳偏移 (首个关键帧的 DTS/PTS) */
+    gboolean waiting_keyframe;          /* 录制已开始但还没有收到关键帧 */
+
+    GstElement *video_valve;            /* 无环形缓冲时，编码器输出第一帧后关闭阀门，空闲期间让编码器休息 */
+    GstElement *audio_valve;
+    GstElement *video_encoder;          /* 打开阀门时向其请求关键帧 */
+
+    GstElement *video_queue;            /* 停止录制时向其注入排空标记 */
+    GstElement *audio_queue;
+    guint drain_timeout;                /* 排空标记迟迟不到达时强制结束尾部 */
+    gboolean eos_pending;               /* 管道即将发送 EOS，阀门保持打开让 EOS 到达 appsink */
+};
+
+static GstClockTime sample_decode_time(GstSample *sample) {
+    GstBuffer *buf = gst_sample_get_buffer(sample);
+    return GST_BUFFER_DTS_IS_VALID(buf) ? GST_BUFFER_DTS(buf) : GST_BUFFER_PTS(buf);
+}
+
+static gboolean sample_is_keyframe(GstSample *sample) {
+    return !GST_BUFFER_FLAG_IS_SET(gst_sample_get_buffer(sample), GST_BUFFER_FLAG_DELTA_UNIT);
+}
+
+static gsize sample_size(GstSample *sample) {
+    return gst_buffer_get_size(gst_sample_get_buffer(sample));
+}
+
+// 辅助函数：把时间戳平移 base 后推送到 appsrc (只复制 buffer 元数据，不复制数据)
+static void push_shifted(GstElement *src, GstSample *sample, GstClockTime base) {
+    GstBuffer *buf = gst_buffer_copy(gst_sample_get_buffer(sample));
+
+    if (GST_BUFFER_PTS_IS_VALID(buf)) {
+        GST_BUFFER_PTS(buf) = GST_BUFFER_PTS(buf) > base ? GST_BUFFER_PTS(buf) - base : 0;
+    }
+    if (GST_BUFFER_DTS_IS_VALID(buf)) {
+        GST_BUFFER_DTS(buf) = GST_BUFFER_DTS(buf) > base ? GST_BUFFER_DTS(buf) - base : 0;
+    }
+
+    g_autoptr(GstSample) shifted = gst_sample_new(buf, gst_sample_get_caps(sample), NULL, NULL);
+    gst_buffer_unref(buf);
+    gst_app_src_push_sample(GST_APP_SRC(src), shifted);
+}
+
+// 辅助函数：丢弃队首的一个完整 GOP
+static void drop_head_gop(PrerollBranch *pb) {
+    GstSample *sample = g_queue_pop_head(&pb->video);
+    while (sample) {
+        pb->ring_bytes -= sample_size(sample);
+        gst_sample_unref(sample);
+
+        GstSample *next = g_queue_peek_head(&pb->video);
+        if (!next || sample_is_keyframe(next)) break;
+        sample = g_queue_pop_head(&pb->video);
+    }
+    pb->video_gops--;
+}
+
+// 辅助函数：查找环中第二个 GOP 的起始关键帧
+static GstSample *second_gop_head(PrerollBranch *pb) {
+    for (GList *l = pb->video.head ? pb->video.head->next : NULL; l; l = l->next) {
+        if (sample_is_keyframe(l->data)) return l->data;
+    }
+    return NULL;
+}
+
+// 辅助函数：按时长/字节上限修剪环形缓冲，只在 GOP 边界丢弃
+static void trim_ring(PrerollBranch *pb, GstClockTime newest) {
+    while (pb->video_gops > 1) {
+        GstSample *next_gop = second_gop_head(pb);
+        gboolean too_old = next_gop && GST_CLOCK_TIME_IS_VALID(newest) &&
+                           newest >= sample_decode_time(next_gop) + pb->keep_time;
+        gboolean too_big = pb->max_bytes > 0 && pb->ring_bytes > pb->max_bytes;
+        if (!too_old && !too_big) break;
+        drop_head_gop(pb);
+    }
+
+    // 音频只保留与视频环对齐的部分
+    GstSample *video_head = g_queue_peek_head(&pb->video);
+    GstClockTime audio_start = video_head ? GST_BUFFER_PTS(gst_sample_get_buffer(video_head)) :
+                               (GST_CLOCK_TIME_IS_VALID(newest) && newest > pb->keep_time ? newest - pb->keep_time : 0);
+    GstSample *audio_head;
+    while ((audio_head = g_queue_peek_head(&pb->audio)) != NULL &&
+           GST_BUFFER_PTS(gst_sample_get_buffer(audio_head)) < audio_start) {
+        pb->ring_bytes -= sample_size(audio_head);
+        gst_sample_unref(g_queue_pop_head(&pb->audio));
+    }
+}
+
+static void push_video_live(PrerollBranch *pb, GstSample *sample) {
+    if (pb->waiting_keyframe) {
+        if (!sample_is_keyframe(sample)) return;
+        pb->base_time = sample_decode_time(sample);
+        pb->waiting_keyframe = FALSE;
+    }
+    push_shifted(pb->video_src, sample, pb->base_time);
+}
+
+static void push_audio_live(PrerollBranch *pb, GstSample *sample) {
+    // 视频首个关键帧之前的音频不写入文件
+    if (pb->waiting_keyframe || GST_BUFFER_PTS(gst_sample_get_buffer(sample)) < pb->base_time) return;
+    push_shifted(pb->audio_src, sample, pb->base_time);
+}
+
+static GstFlowReturn on_video_sample(GstAppSink *appsink, gpointer user_data) {
+    PrerollBranch *pb = (PrerollBranch *)user_data;
+    GstSample *sample = gst_app_sink_pull_sample(appsink);
+    if (!sample) return GST_FLOW_EOS;
+
+    g_mutex_lock(&pb->lock);
+    if (sample_is_keyframe(sample)) {
+        pb->video_gops++;
+    }
+    // 环必须从关键帧开始
+    if (pb->ring_enabled && pb->video_gops > 0) {
+        g_queue_push_tail(&pb->video, gst_sample_ref(sample));
+        pb->ring_bytes += sample_size(sample);
+        trim_ring(pb, sample_decode_time(sample));
+    }
+    if (pb->video_src) {
+        push_video_live(pb, sample);
+    }
+    g_mutex_unlock(&pb->lock);
+
+    gst_sample_unref(sample);
+    return GST_FLOW_OK;
+}
+
+static GstFlowReturn on_audio_sample(GstAppSink *appsink, gpointer user_data) {
+    PrerollBranch *pb = (PrerollBranch *)user_data;
+    GstSample *sample = gst_app_sink_pull_sample(appsink);
+    if (!sample) return GST_FLOW_EOS;
+
+    g_mutex_lock(&pb->lock);
+    if (pb->ring_enabled) {
+        g_queue_push_tail(&pb->audio, gst_sample_ref(sample));
+        pb->ring_bytes += sample_size(sample);
+        trim_ring(pb, GST_BUFFER_PTS(gst_sample_get_buffer(sample)));
+    }
+    if (pb->audio_src) {
+        push_audio_live(pb, sample);
+    }
+    g_mutex_unlock(&pb->lock);
+
+    gst_sample_unref(sample);
+    return GST_FLOW_OK;
+}
+
+// 辅助函数：编码器输出第一帧后关闭阀门 (录制已经开始时保持打开)
+static void close_valve_if_idle(PrerollBranch *pb, GstElement *valve) {
+    g_mutex_lock(&pb->lock);
+    if (!pb->video_src && !pb->eos_pending) {
+        g_object_set(G_OBJECT(valve), "drop", TRUE, NULL);
+    }
+    g_mutex_unlock(&pb->lock);
+}
+
+static GstPadProbeReturn video_warmup_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    PrerollBranch *pb = (PrerollBranch *)user_data;
+    close_valve_if_idle(pb, pb->video_valve);
+    return GST_PAD_PROBE_REMOVE;
+}
+
+static GstPadProbeReturn audio_warmup_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    PrerollBranch *pb = (PrerollBranch *)user_data;
+    close_valve_if_idle(pb, pb->audio_valve);
+    return GST_PAD_PROBE_REMOVE;
+}
+
+// 辅助函数：排空标记到达后结束对应的 appsrc，编码器前瞻中的帧此时已经写入录制
+static void finish_drain(PrerollBranch *pb, GstElement **src, GstElement *valve) {
+    g_mutex_lock(&pb->lock);
+    g_autoptr(GstElement) done = g_steal_pointer(src);
+    if (done && valve && !pb->eos_pending) {
+        g_object_set(G_OBJECT(valve), "drop", TRUE, NULL);
+    }
+    if (!pb->video_src && !pb->audio_src && pb->drain_timeout) {
+        g_source_remove(pb->drain_timeout);
+        pb->drain_timeout = 0;
+    }
+    g_mutex_unlock(&pb->lock);
+
+    if (done) gst_app_src_end_of_stream(GST_APP_SRC(done));
+}
+
+static GstPadProbeReturn video_drain_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    PrerollBranch *pb = (PrerollBranch *)user_data;
+    if (!gst_event_has_name(GST_PAD_PROBE_INFO_EVENT(info), PREROLL_DRAIN_EVENT)) return GST_PAD_PROBE_OK;
+    finish_drain(pb, &pb->video_src, pb->video_valve);
+    return GST_PAD_PROBE_DROP;
+}
+
+static GstPadProbeReturn audio_drain_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    PrerollBranch *pb = (PrerollBranch *)user_data;
+    if (!gst_event_has_name(GST_PAD_PROBE_INFO_EVENT(info), PREROLL_DRAIN_EVENT)) return GST_PAD_PROBE_OK;
+    finish_drain(pb, &pb->audio_src, pb->audio_valve);
+    return GST_PAD_PROBE_DROP;
+}
+
+static gboolean drain_timeout(gpointer user_data) {
+    PrerollBranch *pb = (PrerollBranch *)user_data;
+    g_mutex_lock(&pb->lock);
+    pb->drain_timeout = 0;
+    g_mutex_unlock(&pb->lock);
+
+    g_printerr("Pre-roll encoders did not drain within %d s, ending the recording now.\n", PREROLL_DRAIN_TIMEOUT);
+    finish_drain(pb, &pb->video_src, pb->video_valve);
+    finish_drain(pb, &pb->audio_src, pb->audio_valve);
+    return G_SOURCE_REMOVE;
+}
+
+// 辅助函数：在 tee 后面创建 queue -> [编码器 -> 解析器] -> appsink 常驻分支
+static gboolean build_branch(CustomData *data, GstElement *tee, const char *prefix,
+                             const char *encoder_name, const char *parser_name,
+                             GstAppSinkCallbacks *callbacks) {
+    GstBin *bin = GST_BIN(data->pipeline);
+    dictionary *dict = data->config_dict;
+    char name[64];
+
+    GstElement *valve = NULL;
+    if (!data->preroll->ring_enabled) {
+        snprintf(name, sizeof(name), "record-%s-valve", prefix);
+        valve = create_and_add_element("valve", name, bin);
+        if (!valve) return FALSE;
+        // 阀门先打开，让 caps 和第一批帧到达编码器完成初始化，第一帧编码输出后再关闭
+        g_object_set(G_OBJECT(valve), "drop", FALSE, NULL);
+        // 关闭期间仍然放行 EOS 等粘性事件 (GStreamer 1.20 起支持)
+        if (g_object_class_find_property(G_OBJECT_GET_CLASS(valve), "drop-mode")) {
+            gst_util_set_object_arg(G_OBJECT(valve), "drop-mode", "forward-sticky-events");
+        }
+    }
+    snprintf(name, sizeof(name), "record-%s-queue", prefix);
+    GstElement *queue = record_queue_make(data, name, strcmp(prefix, "video") == 0);
+    if (queue) gst_bin_add(bin, queue);
+    snprintf(name, sizeof(name), "record-%s-encoder", prefix);
+    GstElement *encoder = create_and_add_element(encoder_name, name, bin);
+    GstElement *parser = NULL;
+    if (parser_name) {
+        snprintf(name, sizeof(name), "record-%s-parser", prefix);
+        parser = create_and_add_element(parser_name, name, bin);
+    }
+    snprintf(name, sizeof(name), "preroll-%s-sink", prefix);
+    GstElement *appsink = create_and_add_element("appsink", name, bin);
+
+    if (!queue || !encoder || (parser_name && !parser) || !appsink) {
+        return FALSE;
+    }
+
+    configure_element_from_ini(queue, dict, "queue_record");
+    record_queue_guard_attach(data, queue, strcmp(prefix, "video") == 0);
+    configure_element_from_ini(encoder, dict, encoder_name);
+    g_object_set(G_OBJECT(appsink), "sync", FALSE, "async", FALSE, "enable-last-sample", FALSE, NULL);
+    gst_app_sink_set_callbacks(GST_APP_SINK(appsink), callbacks, data->preroll, NULL);
+
+    GstElement *last = parser ? parser : encoder;
+    if ((valve && !gst_element_link_many(tee, valve, queue, NULL)) ||
+        (!valve && !gst_element_link(tee, queue)) ||
+        !gst_element_link(queue, encoder) ||
+        (parser && !gst_element_link(encoder, parser)) ||
+        !gst_element_link(last, appsink)) {
+        g_printerr("Failed to link pre-roll %s branch.\n", prefix);
+        return FALSE;
+    }
+#ifdef DEBUG
+    g_print("Pre-roll %s branch linked: %s -> %s.\n", prefix, GST_OBJECT_NAME(tee), GST_OBJECT_NAME(appsink));
+#endif
+    gboolean is_video = strcmp(prefix, "video") == 0;
+    if (is_video) {
+        data->preroll->video_valve = valve;
+        data->preroll->video_encoder = encoder;
+        data->preroll->video_queue = queue;
+        encoder_control_attach(data, encoder);
+    } else {
+        data->preroll->audio_valve = valve;
+        data->preroll->audio_queue = queue;
+    }
+    g_autoptr(GstPad) appsink_sink = gst_element_get_static_pad(appsink, "sink");
+    gst_pad_add_probe(appsink_sink, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, is_video ? video_drain_probe : audio_drain_probe,
+                      data->preroll, NULL);
+    if (valve) {
+        g_autoptr(GstPad) last_src = gst_element_get_static_pad(last, "src");
+        gst_pad_add_probe(last_src, GST_PAD_PROBE_TYPE_BUFFER, is_video ? video_warmup_probe : audio_warmup_probe,
+                          data->preroll, NULL);
+    }
+    return TRUE;
+}
+
+gboolean preroll_branch_enabled(CustomData *data) {
+    return data->preroll != NULL;
+}
+
+gboolean preroll_branch_init(CustomData *data) {
+    dictionary *dict = data->config_dict;
+    int seconds = iniparser_getint(dict, "preroll:seconds", 0);
+    const char *record_mode = iniparser_getstring(dict, "main:record_mode", "ondemand");
+    if (seconds <= 0 && g_strcmp0(record_mode, "persistent") != 0) {
+        return TRUE;
+    }
+
+    if (!data->video_tee || !data->audio_tee) {
+        g_printerr("Pre-roll requires both video_tee and audio_tee. Disabled.\n");
+        return TRUE;
+    }
+    if (!data->record_chain.muxer) {
+        g_printerr("Pre-roll requires a recording codec chain. Disabled.\n");
+        return TRUE;
+    }
+
+    PrerollBranch *pb = g_new0(PrerollBranch, 1);
+    g_mutex_init(&pb->lock);
+    g_queue_init(&pb->video);
+    g_queue_init(&pb->audio);
+    pb->ring_enabled = seconds > 0;
+    pb->keep_time = (GstClockTime)MAX(seconds, 0) * GST_SECOND;
+    pb->max_bytes = get_ini_size(dict, "preroll:max-bytes", 0);
+    data->preroll = pb;
+
+    const RecordChain *chain = &data->record_chain;
+
+    static GstAppSinkCallbacks video_callbacks = { .new_sample = on_video_sample };
+    static GstAppSinkCallbacks audio_callbacks = { .new_sample = on_audio_sample };
+
+    if (!build_branch(data, data->video_tee, "video", chain->video_encoder, chain->video_parser, &video_callbacks) ||
+        !build_branch(data, data->audio_tee, "audio", chain->audio_encoder, NULL, &audio_callbacks)) {
+        return FALSE;
+    }
+
+    if (pb->ring_enabled) {
+        g_print("Pre-roll enabled: keeping %d s (max %" G_GSIZE_FORMAT " bytes) of encoded %s.\n",
+                seconds, pb->max_bytes, chain->video_encoder);
+    } else {
+        g_print("Persistent recording branch enabled: %s initialized, then idle behind a valve.\n", chain->video_encoder);
+    }
+    return TRUE;
+}
+
+gboolean preroll_branch_start(CustomData *data, GstElement *video_src, GstElement *audio_src) {
+    PrerollBranch *pb = data->preroll;
+    if (!pb) return FALSE;
+
+    g_mutex_lock(&pb->lock);
+    pb->video_src = gst_object_ref(video_src);
+    pb->audio_src = gst_object_ref(audio_src);
+    pb->waiting_keyframe = TRUE;
+
+    // 环非空时队首一定是关键帧，从这里开始写入
+    GstSample *head = g_queue_peek_head(&pb->video);
+    if (head) {
+        pb->base_time = sample_decode_time(head);
+        pb->waiting_keyframe = FALSE;
+
+        for (GList *l = pb->video.head; l; l = l->next) {
+            push_shifted(pb->video_src, l->data, pb->base_time);
+        }
+        for (GList *l = pb->audio.head; l; l = l->next) {
+            push_audio_live(pb, l->data);
+        }
+        g_print("Pre-roll flushed %u video / %u audio buffers (%.2f s).\n",
+                pb->video.length, pb->audio.length,
+                (double)(sample_decode_time(g_queue_peek_tail(&pb->video)) - pb->base_time) / GST_SECOND);
+    }
+    g_mutex_unlock(&pb->lock);
+
+    // 打开阀门，并要求编码器立即输出关键帧，避免等待下一个 GOP
+    if (pb->video_valve) {
+        g_object_set(G_OBJECT(pb->audio_valve), "drop", FALSE, NULL);
+        g_object_set(G_OBJECT(pb->video_valve), "drop", FALSE, NULL);
+
+        g_autoptr(GstPad) encoder_src = gst_element_get_static_pad(pb->video_encoder, "src");
+        if (encoder_src) {
+            gst_pad_send_event(encoder_src, gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
+        }
+    }
+
+    return TRUE;
+}
+
+void preroll_branch_stop(CustomData *data) {
+    PrerollBranch *pb = data->preroll;
+    if (!pb) return;
+
+    // 编码器前瞻/重排序中还有已进入分支的帧：在队列入口注入串行的排空标记，
+    // 标记之前的帧仍然写入录制，标记到达 appsink 时才结束 appsrc 并关闭阀门
+    g_mutex_lock(&pb->lock);
+    if (pb->video_src || pb->audio_src) {
+        if (pb->drain_timeout) g_source_remove(pb->drain_timeout);
+        pb->drain_timeout = g_timeout_add_seconds(PREROLL_DRAIN_TIMEOUT, drain_timeout, pb);
+    }
+    g_mutex_unlock(&pb->lock);
+
+    GstElement *queues[] = { pb->video_queue, pb->audio_queue };
+    for (guint i = 0; i < G_N_ELEMENTS(queues); i++) {
+        g_autoptr(GstPad) sink = gst_element_get_static_pad(queues[i], "sink");
+        gst_pad_send_event(sink, gst_event_new_custom(GST_EVENT_CUSTOM_DOWNSTREAM,
+                                                      gst_structure_new_empty(PREROLL_DRAIN_EVENT)));
+    }
+}
+
+void preroll_branch_prepare_eos(CustomData *data) {
+    PrerollBranch *pb = data->preroll;
+    if (!pb) return;
+
+    // 关闭的阀门会丢弃管道 EOS，常驻 appsink 收不到 EOS 程序就无法退出
+    g_mutex_lock(&pb->lock);
+    pb->eos_pending = TRUE;
+    if (pb->video_valve) {
+        g_object_set(G_OBJECT(pb->video_valve), "drop", FALSE, NULL);
+        g_object_set(G_OBJECT(pb->audio_valve), "drop", FALSE, NULL);
+    }
+    g_mutex_unlock(&pb->lock);
+}
+
+void preroll_branch_free(CustomData *data) {
+    PrerollBranch *pb = g_steal_pointer(&data->preroll);
+    if (!pb) return;
+
+    g_mutex_lock(&pb->lock);
+    if (pb->drain_timeout) g_source_remove(pb->drain_timeout);
+    g_queue_clear_full(&pb->video, (GDestroyNotify)gst_sample_unref);
+    g_queue_clear_full(&pb->audio, (GDestroyNotify)gst_sample_unref);
+    g_clear_object(&pb->video_src);
+    g_clear_object(&pb->audio_src);
+    g_mutex_unlock(&pb->lock);
+
+    g_mutex_clear(&pb->lock);
+    g_free(pb);
+}
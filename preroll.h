@@ -0,0 +1,51 @@
+#ifndef PREROLL_H
+#define PREROLL_H
+
+#include "config.h"
+
+/*
+ * Build the always-on encode branch (queue -> encoder -> parser -> appsink) on
+ * video_tee/audio_tee when [preroll] is enabled, keeping the newest encoded GOPs
+ * in a ring bounded by [preroll] seconds and max-bytes. With main:record_mode=persistent
+ * and no ring, the valve lets frames through until the encoder has produced its
+ * first output (so caps are negotiated and the encoder is initialized), then
+ * closes until a recording starts.
+ * data: Pointer to the CustomData structure.
+ * Returns: TRUE if pre-roll is disabled or the branch was built, FALSE on error.
+ */
+gboolean preroll_branch_init(CustomData *data);
+
+/*
+ * Returns: TRUE if recordings are fed from the pre-roll branch.
+ */
+gboolean preroll_branch_enabled(CustomData *data);
+
+/*
+ * Flush the ring into the recording tail appsrcs, then keep feeding live samples.
+ * video_src/audio_src: appsrc elements of the recording tail.
+ * Returns: TRUE if successful, FALSE otherwise.
+ */
+gboolean preroll_branch_start(CustomData *data, GstElement *video_src, GstElement *audio_src);
+
+/*
+ * Detach the recording tail and send EOS into its appsrcs. Frames already inside
+ * the branch (queue, encoder lookahead/reorder, parser) are drained into the
+ * recording first: a serialized marker event follows them through the branch and
+ * each appsrc is ended when the marker reaches its appsink (or after a timeout
+ * if no frames arrive to push it out).
+ */
+void preroll_branch_stop(CustomData *data);
+
+/*
+ * Reopen the valves for good before EOS is sent to the pipeline, so the EOS
+ * reaches the resident appsinks. Valves drop EOS while closed unless they
+ * support drop-mode=forward-sticky-events.
+ */
+void preroll_branch_prepare_eos(CustomData *data);
+
+/*
+ * Release the ring and all buffered samples.
+ */
+void preroll_branch_free(CustomData *data);
+
+#endif // PREROLL_H
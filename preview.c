@@ -0,0 +1,266 @@
+#include "utils.h"
+#include "config.h"
+#include "preview.h"
+#include <gst/gst.h>
+#include <stdio.h>
+#include <iniparser.h>
+
+struct _PreviewThrottle {
+    GtkWidget *window;                  /* 弱引用，窗口销毁后为 NULL */
+    GstPad *pad;                        /* video_tee 上连接预览分支的 pad */
+    gulong probe_id;                    /* 不可见时安装的探针，可见时为 0 */
+    GstClockTime interval;              /* 不可见时两帧之间的最小间隔，NONE 表示完全停止 */
+    GstClockTime last_pts;              /* 只由流线程访问 */
+
+    gboolean iconified;
+    gboolean mapped;
+    gboolean obscured;
+};
+
+struct _PreviewLatency {
+    GstElement *sink;
+    GstElement *mailbox;                /* present=mailbox 时的单帧 leaky 队列，否则为 NULL */
+    GdkFrameClock *frame_clock;
+    gulong paint_id;
+    GstClockTime last_pts;
+    FILE *log;                          /* 每帧一行 CSV，未配置时为 NULL */
+    guint report_id;
+
+    guint64 mailbox_drops;              /* 流线程累加 */
+    gint64 refresh_us;                  /* 显示器刷新间隔 */
+    guint64 frames;                     /* 本次报告周期的统计 */
+    guint64 within_refresh;
+    gint64 sum_us;
+    gint64 max_us;
+    guint64 total_frames;
+    guint64 total_within_refresh;
+};
+
+// 探针回调：按 interval 抽帧，其余帧在进入缩放/上传之前丢弃
+static GstPadProbeReturn throttle_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    PreviewThrottle *pt = (PreviewThrottle *)user_data;
+    if (pt->interval == GST_CLOCK_TIME_NONE) return GST_PAD_PROBE_DROP;
+
+    GstClockTime pts = GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info));
+    if (GST_CLOCK_TIME_IS_VALID(pts) && GST_CLOCK_TIME_IS_VALID(pt->last_pts) &&
+        pts >= pt->last_pts && pts - pt->last_pts < pt->interval) {
+        return GST_PAD_PROBE_DROP;
+    }
+    pt->last_pts = pts;
+    return GST_PAD_PROBE_OK;
+}
+
+static void update_throttle(PreviewThrottle *pt) {
+    gboolean hidden = pt->iconified || !pt->mapped || pt->obscured;
+
+    if (hidden && !pt->probe_id) {
+        pt->last_pts = GST_CLOCK_TIME_NONE;
+        pt->probe_id = gst_pad_add_probe(pt->pad, GST_PAD_PROBE_TYPE_BUFFER, throttle_probe, pt, NULL);
+#ifdef DEBUG
+        g_print("Preview hidden, throttling the preview branch.\n");
+#endif
+    } else if (!hidden && pt->probe_id) {
+        gst_pad_remove_probe(pt->pad, pt->probe_id);
+        pt->probe_id = 0;
+#ifdef DEBUG
+        g_print("Preview visible, restoring full rate.\n");
+#endif
+    }
+}
+
+static gboolean on_window_state_event(GtkWidget *widget, GdkEventWindowState *event, gpointer user_data) {
+    PreviewThrottle *pt = (PreviewThrottle *)user_data;
+    pt->iconified = (event->new_window_state & (GDK_WINDOW_STATE_ICONIFIED | GDK_WINDOW_STATE_WITHDRAWN)) != 0;
+    update_throttle(pt);
+    return FALSE;
+}
+
+static gboolean on_map_event(GtkWidget *widget, GdkEvent *event, gpointer user_data) {
+    PreviewThrottle *pt = (PreviewThrottle *)user_data;
+    pt->mapped = event->type == GDK_MAP;
+    update_throttle(pt);
+    return FALSE;
+}
+
+// X11 下窗口被完全遮挡时收到；Wayland 不发送，窗口视为可见
+static gboolean on_visibility_notify_event(GtkWidget *widget, GdkEventVisibility *event, gpointer user_data) {
+    PreviewThrottle *pt = (PreviewThrottle *)user_data;
+    pt->obscured = event->state == GDK_VISIBILITY_FULLY_OBSCURED;
+    update_throttle(pt);
+    return FALSE;
+}
+
+void preview_throttle_init(CustomData *data) {
+    if (data->headless || !data->video_tee) {
+        return;
+    }
+
+    // 此时 video_tee 只有预览分支一个 src pad
+    GstPad *pad = NULL;
+    g_autoptr(GstIterator) it = gst_element_iterate_src_pads(data->video_tee);
+    GValue item = G_VALUE_INIT;
+    if (gst_iterator_next(it, &item) == GST_ITERATOR_OK) {
+        pad = gst_object_ref(g_value_get_object(&item));
+        g_value_unset(&item);
+    }
+    if (!pad) {
+        return;
+    }
+
+    PreviewThrottle *pt = g_new0(PreviewThrottle, 1);
+    pt->pad = pad;
+    pt->mapped = TRUE;
+    gint fps = iniparser_getint(data->config_dict, "preview:hidden_fps", 1);
+    pt->interval = fps > 0 ? GST_SECOND / fps : GST_CLOCK_TIME_NONE;
+    data->preview_throttle = pt;
+}
+
+void preview_throttle_watch(CustomData *data, GtkWidget *window) {
+    PreviewThrottle *pt = data->preview_throttle;
+    if (!pt || !iniparser_getboolean(data->config_dict, "preview:throttle", 1)) {
+        return;
+    }
+
+    pt->window = window;
+    g_object_add_weak_pointer(G_OBJECT(window), (gpointer *)&pt->window);
+    gtk_widget_add_events(window, GDK_VISIBILITY_NOTIFY_MASK | GDK_STRUCTURE_MASK);
+    g_signal_connect(window, "window-state-event", G_CALLBACK(on_window_state_event), pt);
+    g_signal_connect(window, "map-event", G_CALLBACK(on_map_event), pt);
+    g_signal_connect(window, "unmap-event", G_CALLBACK(on_map_event), pt);
+    g_signal_connect(window, "visibility-notify-event", G_CALLBACK(on_visibility_notify_event), pt);
+}
+
+static void on_mailbox_overrun(GstElement *queue, gpointer user_data) {
+    counter_add(&((PreviewLatency *)user_data)->mailbox_drops, 1);
+}
+
+static void latency_report(PreviewLatency *pl) {
+    if (pl->frames == 0) return;
+    g_print("Preview latency: %" G_GUINT64_FORMAT " frame(s), avg %.1f ms, max %.1f ms, %.1f%% within one refresh (%.1f ms), mailbox dropped %" G_GUINT64_FORMAT ".\n",
+            pl->frames, pl->sum_us / 1000.0 / pl->frames, pl->max_us / 1000.0,
+            100.0 * pl->within_refresh / pl->frames, pl->refresh_us / 1000.0, counter_get(&pl->mailbox_drops));
+    pl->frames = pl->within_refresh = 0;
+    pl->sum_us = pl->max_us = 0;
+}
+
+static gboolean latency_report_timeout(gpointer user_data) {
+    latency_report((PreviewLatency *)user_data);
+    return G_SOURCE_CONTINUE;
+}
+
+// 帧时钟回调：每次绘制之后检查 sink 最近交给控件的帧，每帧只统计一次
+static void on_after_paint(GdkFrameClock *frame_clock, gpointer user_data) {
+    CustomData *data = (CustomData *)user_data;
+    PreviewLatency *pl = data->preview_latency;
+    if (!pl || !data->pipeline) return;
+
+    g_autoptr(GstSample) sample = NULL;
+    g_object_get(pl->sink, "last-sample", &sample, NULL);
+    GstBuffer *buffer = sample ? gst_sample_get_buffer(sample) : NULL;
+    if (!buffer || !GST_BUFFER_PTS_IS_VALID(buffer) || GST_BUFFER_PTS(buffer) == pl->last_pts) return;
+    pl->last_pts = GST_BUFFER_PTS(buffer);
+
+    GstClockTime running_time = gst_segment_to_running_time(gst_sample_get_segment(sample), GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+    g_autoptr(GstClock) clock = gst_element_get_clock(data->pipeline);
+    if (!clock || !GST_CLOCK_TIME_IS_VALID(running_time)) return;
+
+    // 管道时钟可能是声卡时钟，先算出帧的年龄，再加上距离预计上屏的时间 (单调时钟)
+    GdkFrameTimings *timings = gdk_frame_clock_get_current_timings(frame_clock);
+    gint64 present_us = timings ? gdk_frame_timings_get_predicted_presentation_time(timings) : 0;
+    if (present_us == 0) present_us = gdk_frame_clock_get_frame_time(frame_clock);
+    GstClockTime captured = gst_element_get_base_time(data->pipeline) + running_time;
+    gint64 latency_us = ((gint64)gst_clock_get_time(clock) - (gint64)captured) / 1000 + (present_us - g_get_monotonic_time());
+
+    gdk_frame_clock_get_refresh_info(frame_clock, 0, &pl->refresh_us, NULL);
+    pl->frames++;
+    pl->total_frames++;
+    pl->sum_us += latency_us;
+    pl->max_us = MAX(pl->max_us, latency_us);
+    if (latency_us <= pl->refresh_us) {
+        pl->within_refresh++;
+        pl->total_within_refresh++;
+    }
+    if (pl->log) {
+        fprintf(pl->log, "%" G_GUINT64_FORMAT ",%" G_GINT64_FORMAT ",%" G_GINT64_FORMAT ",%" G_GINT64_FORMAT "\n",
+                (guint64)pl->last_pts, present_us, latency_us, pl->refresh_us);
+    }
+}
+
+void preview_latency_watch(CustomData *data) {
+    dictionary *dict = data->config_dict;
+    if (!data->videosink || !data->sink_widget || !iniparser_getboolean(dict, "preview:latency", 0)) {
+        return;
+    }
+    GdkFrameClock *frame_clock = gtk_widget_get_frame_clock(data->sink_widget);
+    if (!frame_clock) {
+        g_printerr("Warning: Preview widget has no frame clock. Latency is not measured.\n");
+        return;
+    }
+
+    PreviewLatency *pl = g_new0(PreviewLatency, 1);
+    pl->sink = gst_object_ref(data->videosink);
+    pl->frame_clock = g_object_ref(frame_clock);
+    pl->last_pts = GST_CLOCK_TIME_NONE;
+    pl->refresh_us = 16667;
+
+    const char *log_path = iniparser_getstring(dict, "preview:latency_log", NULL);
+    if (log_path && *log_path) {
+        pl->log = fopen(log_path, "a");
+        if (pl->log) {
+            fprintf(pl->log, "pts_ns,present_us,latency_us,refresh_us\n");
+        } else {
+            g_printerr("Warning: Could not open preview latency log %s\n", log_path);
+        }
+    }
+
+    pl->mailbox = gst_bin_get_by_name(GST_BIN(data->pipeline), "preview-mailbox");
+    if (pl->mailbox) {
+        g_signal_connect(pl->mailbox, "overrun", G_CALLBACK(on_mailbox_overrun), pl);
+    }
+    int interval = iniparser_getint(dict, "preview:latency_report", 10);
+    if (interval > 0) {
+        pl->report_id = g_timeout_add_seconds(interval, latency_report_timeout, pl);
+    }
+    data->preview_latency = pl;
+    pl->paint_id = g_signal_connect(frame_clock, "after-paint", G_CALLBACK(on_after_paint), data);
+}
+
+void preview_latency_free(CustomData *data) {
+    PreviewLatency *pl = g_steal_pointer(&data->preview_latency);
+    if (!pl) return;
+
+    g_signal_handler_disconnect(pl->frame_clock, pl->paint_id);
+    if (pl->report_id > 0) {
+        g_source_remove(pl->report_id);
+    }
+    latency_report(pl);
+    if (pl->total_frames > 0) {
+        g_print("Preview latency total: %" G_GUINT64_FORMAT " frame(s), %.1f%% within one refresh.\n",
+                pl->total_frames, 100.0 * pl->total_within_refresh / pl->total_frames);
+    }
+    if (pl->mailbox) {
+        g_signal_handlers_disconnect_by_data(pl->mailbox, pl);
+        gst_object_unref(pl->mailbox);
+    }
+    if (pl->log) {
+        fclose(pl->log);
+    }
+    g_object_unref(pl->frame_clock);
+    gst_object_unref(pl->sink);
+    g_free(pl);
+}
+
+void preview_throttle_free(CustomData *data) {
+    PreviewThrottle *pt = g_steal_pointer(&data->preview_throttle);
+    if (!pt) return;
+
+    if (pt->window) {
+        g_signal_handlers_disconnect_by_data(pt->window, pt);
+        g_object_remove_weak_pointer(G_OBJECT(pt->window), (gpointer *)&pt->window);
+    }
+    if (pt->probe_id) {
+        gst_pad_remove_probe(pt->pad, pt->probe_id);
+    }
+    gst_object_unref(pt->pad);
+    g_free(pt);
+}
@@ -0,0 +1,37 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include "config.h"
+
+/*
+ * Take the video_tee src pad that feeds the preview branch. Call once the video
+ * pipeline is built and before any other branch requests a pad from video_tee.
+ * Does nothing in headless mode.
+ */
+void preview_throttle_init(CustomData *data);
+
+/*
+ * Watch the state of the main window. While it is minimized, unmapped (e.g. on
+ * another workspace) or fully obscured, a probe on the preview pad passes only
+ * [preview] hidden_fps frames per second (0 stops the preview); the recording
+ * branches are not affected. The probe is removed as soon as the window is
+ * visible again, so the next frame is shown at full rate.
+ */
+void preview_throttle_watch(CustomData *data, GtkWidget *window);
+
+void preview_throttle_free(CustomData *data);
+
+/*
+ * Measure capture-to-present latency of every new preview frame when [preview]
+ * latency is set: the frame's capture time (pipeline base time + running time)
+ * is compared with the predicted presentation time of the GTK frame clock tick
+ * that painted it. Call after the sink widget is realized. Statistics are printed
+ * every latency_report seconds and at exit; latency_log appends one CSV line per
+ * frame. With [preview] present=mailbox, frames dropped by the one-frame mailbox
+ * queue are counted too.
+ */
+void preview_latency_watch(CustomData *data);
+
+void preview_latency_free(CustomData *data);
+
+#endif // PREVIEW_H
@@ -0,0 +1,622 @@
+#define _GNU_SOURCE
+#include "rawdump.h"
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+#include <gst/base/gstbasesrc.h>
+#include <gst/video/video.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#define RAW_ALIGN 4096
+#define RAW_MAGIC "GSTRAWD1"
+#define RAW_VERSION 1
+#define RAW_RECORD_MAGIC 0x52415752     /* "RWAR" */
+#define RAW_RECORD_HEADER 64
+
+#define DEFAULT_EXTENT (256 * 1024 * 1024)
+
+/* 文件头，位于偏移 0，占用第一个对齐块 */
+typedef struct {
+    gchar magic[8];
+    guint32 version;
+    guint32 align;
+    guint64 data_end;                   /* 最后一条记录之后的偏移，0 表示文件未正常结束 */
+    guint64 index_offset;
+    guint64 index_count;
+} RawFileHeader;
+
+typedef enum {
+    RAW_RECORD_BUFFER = 1,
+    RAW_RECORD_CAPS = 2,
+} RawRecordType;
+
+/* 记录头，数据紧随其后，整条记录按 RAW_ALIGN 对齐 */
+typedef struct {
+    guint32 magic;
+    guint32 type;
+    guint64 pts;
+    guint64 dts;
+    guint64 duration;
+    guint64 size;
+    guint64 caps_offset;                /* 该 buffer 使用的 caps 记录的偏移 */
+    guint32 flags;
+    guint32 reserved;
+} RawRecord;
+
+/* 索引项，文件结束时追加在最后一条记录之后 */
+typedef struct {
+    guint64 pts;
+    guint64 offset;
+    guint64 size;
+    guint64 caps_offset;
+} RawIndexEntry;
+
+G_STATIC_ASSERT(sizeof(RawFileHeader) <= RAW_ALIGN);
+G_STATIC_ASSERT(sizeof(RawRecord) <= RAW_RECORD_HEADER);
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE("sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE("src", GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+static inline guint64 record_span(guint64 size) {
+    return GST_ROUND_UP_N(RAW_RECORD_HEADER + size, RAW_ALIGN);
+}
+
+/* ------------------------------------------------------------------------- */
+/* rawdumpsink                                                               */
+/* ------------------------------------------------------------------------- */
+
+enum {
+    SINK_PROP_0,
+    SINK_PROP_LOCATION,
+    SINK_PROP_EXTENT,
+};
+
+struct _GstRawDumpSink {
+    GstBaseSink parent;
+
+    /* 属性 */
+    gchar *location;
+    guint64 extent;
+
+    int fd;
+    guint8 *map;
+    guint64 mapped;                     /* 已预分配并映射的字节数 */
+    guint64 position;                   /* 下一条记录的偏移 */
+    guint64 caps_offset;                /* 当前 caps 记录的偏移 */
+    GstVideoInfo video_info;            /* 原始视频按该默认布局写入 (与 caps 记录一致) */
+    gboolean is_video;
+    GArray *index;
+
+    /* 统计 */
+    gint64 start_time;
+    guint64 frames;
+    guint64 bytes;
+};
+
+G_DEFINE_TYPE(GstRawDumpSink, gst_raw_dump_sink, GST_TYPE_BASE_SINK)
+
+// 辅助函数：保证 [0, end) 已预分配并映射，不足时按 extent 扩展
+static gboolean sink_reserve(GstRawDumpSink *self, guint64 end) {
+    if (end <= self->mapped) return TRUE;
+
+    guint64 step = MAX(self->extent, RAW_ALIGN);
+    guint64 size = GST_ROUND_UP_N(MAX(end, self->mapped + step), RAW_ALIGN);
+    // 先分配磁盘空间再扩大映射，空间不足时在这里报错而不是在写入映射时收到 SIGBUS
+    if (fallocate(self->fd, 0, (off_t)self->mapped, (off_t)(size - self->mapped)) != 0) {
+        if (errno != EOPNOTSUPP || ftruncate(self->fd, (off_t)size) != 0) {
+            GST_ELEMENT_ERROR(self, RESOURCE, NO_SPACE_LEFT, ("Could not preallocate raw dump \"%s\".", self->location),
+                              ("%s", g_strerror(errno)));
+            return FALSE;
+        }
+    }
+
+    guint8 *map = self->map ? mremap(self->map, self->mapped, size, MREMAP_MAYMOVE)
+                            : mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, self->fd, 0);
+    if (map == MAP_FAILED) {
+        GST_ELEMENT_ERROR(self, RESOURCE, WRITE, ("Could not map raw dump \"%s\".", self->location),
+                          ("%s", g_strerror(errno)));
+        return FALSE;
+    }
+    self->map = map;
+    self->mapped = size;
+    return TRUE;
+}
+
+// 辅助函数：追加一条记录，返回数据区指针
+static guint8 *sink_append(GstRawDumpSink *self, RawRecord *record) {
+    if (!sink_reserve(self, self->position + record_span(record->size))) {
+        return NULL;
+    }
+    record->magic = RAW_RECORD_MAGIC;
+    memcpy(self->map + self->position, record, sizeof(RawRecord));
+    return self->map + self->position + RAW_RECORD_HEADER;
+}
+
+static gboolean gst_raw_dump_sink_set_caps(GstBaseSink *sink, GstCaps *caps) {
+    GstRawDumpSink *self = GST_RAW_DUMP_SINK(sink);
+    // 写入的是映射后的系统内存数据，去掉 memory:VASurface/DMABuf 等特性，否则 rawdumpsrc 给出的 caps 无法协商
+    g_autoptr(GstCaps) plain = gst_caps_copy(caps);
+    for (guint i = 0; i < gst_caps_get_size(plain); i++) {
+        gst_caps_set_features(plain, i, NULL);
+    }
+    g_autofree gchar *caps_str = gst_caps_to_string(plain);
+    self->is_video = gst_video_info_from_caps(&self->video_info, plain);
+
+    RawRecord record = { .type = RAW_RECORD_CAPS, .size = strlen(caps_str) + 1 };
+    guint8 *dest = sink_append(self, &record);
+    if (!dest) return FALSE;
+
+    memcpy(dest, caps_str, record.size);
+    self->caps_offset = self->position;
+    self->position += record_span(record.size);
+    return TRUE;
+}
+
+// 辅助函数：按 GstVideoMeta 的行跨度/平面偏移读取源帧，逐平面复制为 caps 描述的默认布局
+static gboolean copy_video_frame(GstRawDumpSink *self, GstBuffer *buffer, guint8 *dest) {
+    GstVideoFrame src_frame, dest_frame;
+    if (!gst_video_frame_map(&src_frame, &self->video_info, buffer, GST_MAP_READ)) {
+        return FALSE;
+    }
+
+    g_autoptr(GstBuffer) wrapped = gst_buffer_new_wrapped_full(0, dest, self->video_info.size, 0,
+                                                               self->video_info.size, NULL, NULL);
+    gboolean ok = gst_video_frame_map(&dest_frame, &self->video_info, wrapped, GST_MAP_WRITE);
+    if (ok) {
+        ok = gst_video_frame_copy(&dest_frame, &src_frame);
+        gst_video_frame_unmap(&dest_frame);
+    }
+    gst_video_frame_unmap(&src_frame);
+    return ok;
+}
+
+static GstFlowReturn gst_raw_dump_sink_render(GstBaseSink *sink, GstBuffer *buffer) {
+    GstRawDumpSink *self = GST_RAW_DUMP_SINK(sink);
+    if (self->caps_offset == 0) {
+        GST_ELEMENT_ERROR(self, CORE, NEGOTIATION, ("Raw dump received a buffer before caps."), (NULL));
+        return GST_FLOW_NOT_NEGOTIATED;
+    }
+
+    RawRecord record = {
+        .type = RAW_RECORD_BUFFER,
+        .pts = GST_BUFFER_PTS(buffer),
+        .dts = GST_BUFFER_DTS(buffer),
+        .duration = GST_BUFFER_DURATION(buffer),
+        .size = self->is_video ? self->video_info.size : gst_buffer_get_size(buffer),
+        .caps_offset = self->caps_offset,
+        .flags = GST_BUFFER_FLAGS(buffer),
+    };
+    guint8 *dest = sink_append(self, &record);
+    if (!dest) return GST_FLOW_ERROR;
+
+    // 唯一的一次复制：从映射的采集 buffer 写入映射的文件 (省去 write() 的用户态缓冲和第二次复制)
+    if (!self->is_video) {
+        gst_buffer_extract(buffer, 0, dest, record.size);
+    } else if (!copy_video_frame(self, buffer, dest)) {
+        GST_ELEMENT_ERROR(self, STREAM, FAILED, ("Could not map video frame."), (NULL));
+        return GST_FLOW_ERROR;
+    }
+
+    RawIndexEntry entry = { record.pts, self->position, record.size, self->caps_offset };
+    g_array_append_val(self->index, entry);
+    self->position += record_span(record.size);
+    self->frames++;
+    self->bytes += record.size;
+    return GST_FLOW_OK;
+}
+
+static gboolean gst_raw_dump_sink_start(GstBaseSink *sink) {
+    GstRawDumpSink *self = GST_RAW_DUMP_SINK(sink);
+
+    if (!self->location) {
+        GST_ELEMENT_ERROR(self, RESOURCE, NOT_FOUND, ("No file name specified for writing."), (NULL));
+        return FALSE;
+    }
+    self->fd = open(self->location, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (self->fd < 0) {
+        GST_ELEMENT_ERROR(self, RESOURCE, OPEN_WRITE, ("Could not open file \"%s\" for writing.", self->location),
+                          ("%s", g_strerror(errno)));
+        return FALSE;
+    }
+
+    self->map = NULL;
+    self->mapped = 0;
+    if (!sink_reserve(self, RAW_ALIGN)) {
+        return FALSE;
+    }
+
+    // data_end 为 0 的文件头：异常退出时读取端按记录扫描
+    RawFileHeader header = { .version = RAW_VERSION, .align = RAW_ALIGN };
+    memcpy(header.magic, RAW_MAGIC, sizeof(header.magic));
+    memcpy(self->map, &header, sizeof(header));
+
+    self->position = RAW_ALIGN;
+    self->caps_offset = 0;
+    self->is_video = FALSE;
+    self->index = g_array_new(FALSE, FALSE, sizeof(RawIndexEntry));
+    self->start_time = g_get_monotonic_time();
+    self->frames = self->bytes = 0;
+    return TRUE;
+}
+
+static gboolean gst_raw_dump_sink_stop(GstBaseSink *sink) {
+    GstRawDumpSink *self = GST_RAW_DUMP_SINK(sink);
+
+    if (self->map) {
+        // 追加索引并更新文件头，然后截掉多预分配的空间
+        gsize index_size = self->index->len * sizeof(RawIndexEntry);
+        guint64 index_offset = self->position;
+        if (sink_reserve(self, index_offset + index_size)) {
+            memcpy(self->map + index_offset, self->index->data, index_size);
+            RawFileHeader *header = (RawFileHeader *)self->map;
+            header->index_offset = index_offset;
+            header->index_count = self->index->len;
+            header->data_end = index_offset;
+            msync(self->map, self->mapped, MS_SYNC);
+            if (ftruncate(self->fd, (off_t)(index_offset + index_size)) != 0) {
+                g_printerr("Warning: Could not truncate %s: %s\n", self->location, g_strerror(errno));
+            }
+        }
+        munmap(self->map, self->mapped);
+        self->map = NULL;
+        self->mapped = 0;
+
+        gdouble elapsed = MAX(g_get_monotonic_time() - self->start_time, 1) / (gdouble)G_USEC_PER_SEC;
+        g_print("%s: %" G_GUINT64_FORMAT " frames, %.1f MB in %.1f s (%.1f MB/s).\n", GST_OBJECT_NAME(self),
+                self->frames, self->bytes / 1e6, elapsed, self->bytes / 1e6 / elapsed);
+    }
+    if (self->fd >= 0) {
+        close(self->fd);
+        self->fd = -1;
+    }
+    g_clear_pointer(&self->index, g_array_unref);
+    return TRUE;
+}
+
+static gboolean gst_raw_dump_sink_propose_allocation(GstBaseSink *sink, GstQuery *query) {
+    // 行跨度/平面偏移由 render 处理，上游可以直接给出带填充的 buffer
+    gst_query_add_allocation_meta(query, GST_VIDEO_META_API_TYPE, NULL);
+    return TRUE;
+}
+
+static gboolean gst_raw_dump_sink_query(GstBaseSink *sink, GstQuery *query) {
+    GstRawDumpSink *self = GST_RAW_DUMP_SINK(sink);
+
+    if (GST_QUERY_TYPE(query) == GST_QUERY_URI) {
+        g_autofree gchar *uri = self->location ? gst_filename_to_uri(self->location, NULL) : NULL;
+        gst_query_set_uri(query, uri);
+        return TRUE;
+    }
+    return GST_BASE_SINK_CLASS(gst_raw_dump_sink_parent_class)->query(sink, query);
+}
+
+static void gst_raw_dump_sink_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec) {
+    GstRawDumpSink *self = GST_RAW_DUMP_SINK(object);
+
+    switch (prop_id) {
+        case SINK_PROP_LOCATION:
+            g_free(self->location);
+            self->location = g_value_dup_string(value);
+            break;
+        case SINK_PROP_EXTENT:
+            self->extent = g_value_get_uint64(value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+}
+
+static void gst_raw_dump_sink_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec) {
+    GstRawDumpSink *self = GST_RAW_DUMP_SINK(object);
+
+    switch (prop_id) {
+        case SINK_PROP_LOCATION:
+            g_value_set_string(value, self->location);
+            break;
+        case SINK_PROP_EXTENT:
+            g_value_set_uint64(value, self->extent);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+}
+
+static void gst_raw_dump_sink_finalize(GObject *object) {
+    GstRawDumpSink *self = GST_RAW_DUMP_SINK(object);
+
+    g_free(self->location);
+    G_OBJECT_CLASS(gst_raw_dump_sink_parent_class)->finalize(object);
+}
+
+static void gst_raw_dump_sink_class_init(GstRawDumpSinkClass *klass) {
+    GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+    GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+    GstBaseSinkClass *basesink_class = GST_BASE_SINK_CLASS(klass);
+
+    gobject_class->set_property = gst_raw_dump_sink_set_property;
+    gobject_class->get_property = gst_raw_dump_sink_get_property;
+    gobject_class->finalize = gst_raw_dump_sink_finalize;
+
+    g_object_class_install_property(gobject_class, SINK_PROP_LOCATION,
+        g_param_spec_string("location", "File Location", "Location of the raw dump to write",
+                            NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, SINK_PROP_EXTENT,
+        g_param_spec_uint64("extent", "Preallocation extent", "Preallocate and map the file in steps of this many bytes",
+                            RAW_ALIGN, G_MAXUINT64, DEFAULT_EXTENT, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+    gst_element_class_set_static_metadata(element_class, "Raw dump sink", "Sink/File",
+                                          "Write unencoded buffers with timestamps and caps to an indexed, memory-mapped file",
+                                          "gst-capture");
+    gst_element_class_add_static_pad_template(element_class, &sink_template);
+
+    basesink_class->start = GST_DEBUG_FUNCPTR(gst_raw_dump_sink_start);
+    basesink_class->stop = GST_DEBUG_FUNCPTR(gst_raw_dump_sink_stop);
+    basesink_class->set_caps = GST_DEBUG_FUNCPTR(gst_raw_dump_sink_set_caps);
+    basesink_class->render = GST_DEBUG_FUNCPTR(gst_raw_dump_sink_render);
+    basesink_class->propose_allocation = GST_DEBUG_FUNCPTR(gst_raw_dump_sink_propose_allocation);
+    basesink_class->query = GST_DEBUG_FUNCPTR(gst_raw_dump_sink_query);
+}
+
+static void gst_raw_dump_sink_init(GstRawDumpSink *self) {
+    self->extent = DEFAULT_EXTENT;
+    self->fd = -1;
+    gst_base_sink_set_sync(GST_BASE_SINK(self), FALSE);
+}
+
+/* ------------------------------------------------------------------------- */
+/* rawdumpsrc                                                                */
+/* ------------------------------------------------------------------------- */
+
+enum {
+    SRC_PROP_0,
+    SRC_PROP_LOCATION,
+};
+
+struct _GstRawDumpSrc {
+    GstBaseSrc parent;
+
+    gchar *location;
+
+    int fd;
+    const guint8 *map;
+    guint64 size;
+    guint64 data_end;
+    const RawIndexEntry *index;         /* 文件未正常结束时为 NULL */
+    guint64 index_count;
+
+    guint64 position;                   /* 下一条记录的偏移 */
+    guint64 caps_offset;                /* 已设置到 src pad 的 caps 记录 */
+};
+
+G_DEFINE_TYPE(GstRawDumpSrc, gst_raw_dump_src, GST_TYPE_BASE_SRC)
+
+// 辅助函数：读取并校验 offset 处的记录头
+static const RawRecord *src_record(GstRawDumpSrc *self, guint64 offset) {
+    if (offset + RAW_RECORD_HEADER > self->data_end) return NULL;
+    const RawRecord *record = (const RawRecord *)(self->map + offset);
+    if (record->magic != RAW_RECORD_MAGIC || offset + RAW_RECORD_HEADER + record->size > self->data_end) {
+        return NULL;
+    }
+    return record;
+}
+
+static gboolean src_apply_caps(GstRawDumpSrc *self, guint64 offset) {
+    const RawRecord *record = src_record(self, offset);
+    if (!record || record->type != RAW_RECORD_CAPS) return FALSE;
+
+    const gchar *caps_str = (const gchar *)(self->map + offset + RAW_RECORD_HEADER);
+    if (record->size == 0 || caps_str[record->size - 1] != '\0') return FALSE;
+    g_autoptr(GstCaps) caps = gst_caps_from_string(caps_str);
+    if (!caps || !gst_base_src_set_caps(GST_BASE_SRC(self), caps)) return FALSE;
+
+    self->caps_offset = offset;
+    return TRUE;
+}
+
+static GstFlowReturn gst_raw_dump_src_create(GstBaseSrc *src, guint64 offset, guint size, GstBuffer **buf) {
+    GstRawDumpSrc *self = GST_RAW_DUMP_SRC(src);
+
+    for (;;) {
+        const RawRecord *record = src_record(self, self->position);
+        if (!record) return GST_FLOW_EOS;      // 正常结尾，或未结束文件中第一条无效记录
+        guint64 record_offset = self->position;
+        self->position += record_span(record->size);
+
+        if (record->type == RAW_RECORD_CAPS) {
+            if (!src_apply_caps(self, record_offset)) return GST_FLOW_NOT_NEGOTIATED;
+            continue;
+        }
+        if (record->type != RAW_RECORD_BUFFER) continue;
+
+        // 定位后第一个 buffer 可能引用不同的 caps
+        if (record->caps_offset != self->caps_offset && !src_apply_caps(self, record->caps_offset)) {
+            return GST_FLOW_NOT_NEGOTIATED;
+        }
+
+        GstBuffer *buffer = gst_buffer_new_allocate(NULL, record->size, NULL);
+        if (!buffer) return GST_FLOW_ERROR;
+        gst_buffer_fill(buffer, 0, self->map + record_offset + RAW_RECORD_HEADER, record->size);
+        GST_BUFFER_PTS(buffer) = record->pts;
+        GST_BUFFER_DTS(buffer) = record->dts;
+        GST_BUFFER_DURATION(buffer) = record->duration;
+        GST_BUFFER_FLAGS(buffer) = record->flags & ~(GST_BUFFER_FLAG_DISCONT);
+        *buf = buffer;
+        return GST_FLOW_OK;
+    }
+}
+
+static gboolean gst_raw_dump_src_is_seekable(GstBaseSrc *src) {
+    return GST_RAW_DUMP_SRC(src)->index != NULL;
+}
+
+static gboolean gst_raw_dump_src_do_seek(GstBaseSrc *src, GstSegment *segment) {
+    GstRawDumpSrc *self = GST_RAW_DUMP_SRC(src);
+    if (!self->index || self->index_count == 0) {
+        return segment->start == 0;
+    }
+
+    // 二分查找第一个 PTS 不小于 segment->start 的 buffer
+    guint64 lo = 0, hi = self->index_count;
+    while (lo < hi) {
+        guint64 mid = lo + (hi - lo) / 2;
+        if (GST_CLOCK_TIME_IS_VALID(self->index[mid].pts) && self->index[mid].pts < segment->start) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    self->position = lo < self->index_count ? self->index[lo].offset : self->data_end;
+    segment->time = segment->start;
+    return TRUE;
+}
+
+static gboolean gst_raw_dump_src_query(GstBaseSrc *src, GstQuery *query) {
+    GstRawDumpSrc *self = GST_RAW_DUMP_SRC(src);
+
+    if (GST_QUERY_TYPE(query) == GST_QUERY_DURATION && self->index && self->index_count > 0) {
+        GstFormat format;
+        gst_query_parse_duration(query, &format, NULL);
+        if (format == GST_FORMAT_TIME && GST_CLOCK_TIME_IS_VALID(self->index[self->index_count - 1].pts)) {
+            gst_query_set_duration(query, format, self->index[self->index_count - 1].pts);
+            return TRUE;
+        }
+    }
+    return GST_BASE_SRC_CLASS(gst_raw_dump_src_parent_class)->query(src, query);
+}
+
+static gboolean gst_raw_dump_src_start(GstBaseSrc *src) {
+    GstRawDumpSrc *self = GST_RAW_DUMP_SRC(src);
+
+    if (!self->location) {
+        GST_ELEMENT_ERROR(self, RESOURCE, NOT_FOUND, ("No file name specified for reading."), (NULL));
+        return FALSE;
+    }
+    self->fd = open(self->location, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (self->fd < 0 || fstat(self->fd, &st) != 0) {
+        GST_ELEMENT_ERROR(self, RESOURCE, OPEN_READ, ("Could not open file \"%s\" for reading.", self->location),
+                          ("%s", g_strerror(errno)));
+        return FALSE;
+    }
+    self->size = (guint64)st.st_size;
+
+    const guint8 *map = self->size >= RAW_ALIGN
+                            ? mmap(NULL, self->size, PROT_READ, MAP_SHARED, self->fd, 0) : MAP_FAILED;
+    const RawFileHeader *header = map != MAP_FAILED ? (const RawFileHeader *)map : NULL;
+    if (!header || memcmp(header->magic, RAW_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != RAW_VERSION || header->align != RAW_ALIGN) {
+        if (map != MAP_FAILED) munmap((void *)map, self->size);
+        GST_ELEMENT_ERROR(self, STREAM, WRONG_TYPE, ("\"%s\" is not a raw dump.", self->location), (NULL));
+        return FALSE;
+    }
+    self->map = map;
+    madvise((void *)self->map, self->size, MADV_SEQUENTIAL);
+
+    // 正常结束的文件带索引；否则扫描到第一条无效记录为止
+    self->index = NULL;
+    self->index_count = 0;
+    self->data_end = self->size;
+    if (header->data_end > 0 && header->data_end <= self->size &&
+        header->index_offset + header->index_count * sizeof(RawIndexEntry) <= self->size) {
+        self->data_end = header->data_end;
+        self->index = (const RawIndexEntry *)(self->map + header->index_offset);
+        self->index_count = header->index_count;
+    } else {
+        g_printerr("Warning: %s was not finalized. Reading without index.\n", self->location);
+    }
+
+    self->position = RAW_ALIGN;
+    self->caps_offset = 0;
+    return TRUE;
+}
+
+static gboolean gst_raw_dump_src_stop(GstBaseSrc *src) {
+    GstRawDumpSrc *self = GST_RAW_DUMP_SRC(src);
+
+    if (self->map) {
+        munmap((void *)self->map, self->size);
+        self->map = NULL;
+    }
+    if (self->fd >= 0) {
+        close(self->fd);
+        self->fd = -1;
+    }
+    self->index = NULL;
+    return TRUE;
+}
+
+static void gst_raw_dump_src_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec) {
+    GstRawDumpSrc *self = GST_RAW_DUMP_SRC(object);
+
+    switch (prop_id) {
+        case SRC_PROP_LOCATION:
+            g_free(self->location);
+            self->location = g_value_dup_string(value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+}
+
+static void gst_raw_dump_src_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec) {
+    GstRawDumpSrc *self = GST_RAW_DUMP_SRC(object);
+
+    switch (prop_id) {
+        case SRC_PROP_LOCATION:
+            g_value_set_string(value, self->location);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+}
+
+static void gst_raw_dump_src_finalize(GObject *object) {
+    GstRawDumpSrc *self = GST_RAW_DUMP_SRC(object);
+
+    g_free(self->location);
+    G_OBJECT_CLASS(gst_raw_dump_src_parent_class)->finalize(object);
+}
+
+static void gst_raw_dump_src_class_init(GstRawDumpSrcClass *klass) {
+    GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+    GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+    GstBaseSrcClass *basesrc_class = GST_BASE_SRC_CLASS(klass);
+
+    gobject_class->set_property = gst_raw_dump_src_set_property;
+    gobject_class->get_property = gst_raw_dump_src_get_property;
+    gobject_class->finalize = gst_raw_dump_src_finalize;
+
+    g_object_class_install_property(gobject_class, SRC_PROP_LOCATION,
+        g_param_spec_string("location", "File Location", "Location of the raw dump to read",
+                            NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+    gst_element_class_set_static_metadata(element_class, "Raw dump source", "Source/File",
+                                          "Read buffers back from a raw dump with their timestamps and caps",
+                                          "gst-capture");
+    gst_element_class_add_static_pad_template(element_class, &src_template);
+
+    basesrc_class->start = GST_DEBUG_FUNCPTR(gst_raw_dump_src_start);
+    basesrc_class->stop = GST_DEBUG_FUNCPTR(gst_raw_dump_src_stop);
+    basesrc_class->create = GST_DEBUG_FUNCPTR(gst_raw_dump_src_create);
+    basesrc_class->is_seekable = GST_DEBUG_FUNCPTR(gst_raw_dump_src_is_seekable);
+    basesrc_class->do_seek = GST_DEBUG_FUNCPTR(gst_raw_dump_src_do_seek);
+    basesrc_class->query = GST_DEBUG_FUNCPTR(gst_raw_dump_src_query);
+}
+
+static void gst_raw_dump_src_init(GstRawDumpSrc *self) {
+    self->fd = -1;
+    gst_base_src_set_format(GST_BASE_SRC(self), GST_FORMAT_TIME);
+}
+
+gboolean raw_dump_register(void) {
+    return gst_element_register(NULL, "rawdumpsink", GST_RANK_NONE, GST_TYPE_RAW_DUMP_SINK) &&
+           gst_element_register(NULL, "rawdumpsrc", GST_RANK_NONE, GST_TYPE_RAW_DUMP_SRC);
+}
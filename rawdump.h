@@ -0,0 +1,44 @@
+#ifndef RAWDUMP_H
+#define RAWDUMP_H
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+#include <gst/base/gstbasesrc.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Raw dump container: unencoded buffers are copied into a file that is preallocated
+ * with fallocate() and written through a growing mmap. Every record starts on a
+ * 4096-byte boundary with a small header (type, PTS/DTS/duration, size, flags and the
+ * offset of the caps record in effect), so constant-size video frames land at a fixed
+ * stride. Caps changes are stored as records of their own. On close an index of
+ * (PTS, offset, size, caps offset) is appended and referenced from the file header;
+ * a file that was never finalized is read by scanning the records.
+ *
+ * Raw video is stored in the default layout of its caps: frames carrying a
+ * GstVideoMeta with padded strides or plane offsets are repacked plane by plane
+ * while copying into the file.
+ *
+ * rawdumpsink writes one stream per file. rawdumpsrc reads it back with the original
+ * timestamps and caps (seekable in time when the index is present), e.g. to encode
+ * a dump offline.
+ */
+#define GST_TYPE_RAW_DUMP_SINK (gst_raw_dump_sink_get_type())
+G_DECLARE_FINAL_TYPE(GstRawDumpSink, gst_raw_dump_sink, GST, RAW_DUMP_SINK, GstBaseSink)
+
+#define GST_TYPE_RAW_DUMP_SRC (gst_raw_dump_src_get_type())
+G_DECLARE_FINAL_TYPE(GstRawDumpSrc, gst_raw_dump_src, GST, RAW_DUMP_SRC, GstBaseSrc)
+
+/* File name suffix of raw dumps */
+#define RAW_DUMP_EXTENSION ".graw"
+
+/*
+ * Register "rawdumpsink" and "rawdumpsrc" as application-local element factories.
+ * Returns: TRUE if successful, FALSE otherwise.
+ */
+gboolean raw_dump_register(void);
+
+G_END_DECLS
+
+#endif // RAWDUMP_H
@@ -1,13 +1,27 @@
 #include "utils.h"
 #include "config.h"
 #include "recorder.h"
+#include "preroll.h"
+#include "recqueue.h"
+#include "encctl.h"
+#include "liveout.h"
+#include "archive.h"
+#include "budget.h"
+#include "rawdump.h"
+#include "transcode.h"
+#include "crashsafe.h"
+#include "cut.h"
 #include <gst/gst.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <time.h>
 #include <stdio.h>
+#include <string.h>
 #include <iniparser.h>
 
+/* 标记录制文件 sink，只有它们的 EOS 计入 record_sinks_pending */
+#define RECORD_FILE_SINK "record-file-sink"
+
 gboolean cleanup_recording_async(gpointer user_data) {
     CustomData *data = (CustomData *)user_data;
 
@@ -21,8 +35,40 @@ gboolean cleanup_recording_async(gpointer user_data) {
 #ifdef DEBUG
     g_print("Executing asynchronous recording cleanup...\n");
 #endif
+    // 分段文件在 splitmuxsink-fragment-closed 时已加入转码/迁移队列，这里收集其余文件 sink 的文件名
+    // 代理文件本身已经是小文件，不再转码
+    g_autoptr(GPtrArray) finished = g_ptr_array_new_with_free_func(g_free);
+    g_autoptr(GPtrArray) proxies = g_ptr_array_new_with_free_func(g_free);
+    {
+        g_autoptr(GstIterator) it = gst_bin_iterate_elements(GST_BIN(recording_bin_temp));
+        GValue item = G_VALUE_INIT;
+        while (gst_iterator_next(it, &item) == GST_ITERATOR_OK) {
+            GstElement *element = g_value_get_object(&item);
+            gchar *location = NULL;
+            if (g_object_get_data(G_OBJECT(element), RECORD_FILE_SINK) &&
+                g_object_class_find_property(G_OBJECT_GET_CLASS(element), "location") &&
+                !g_str_has_prefix(GST_OBJECT_NAME(element), "record-splitmuxsink")) {
+                g_object_get(G_OBJECT(element), "location", &location, NULL);
+            }
+            if (location) {
+                g_ptr_array_add(g_str_has_prefix(GST_OBJECT_NAME(element), "proxy-") ? proxies : finished, location);
+            }
+            g_value_reset(&item);
+        }
+        g_value_unset(&item);
+    }
+
     // --- 1. 将整个 Bin 状态设置为 GST_STATE_NULL ---
     gst_element_set_state(recording_bin_temp, GST_STATE_NULL);
+    record_cut_free(data);
+
+    // 文件 sink 已关闭，交给后台转码 (未启用时直接迁移)
+    for (guint i = 0; i < finished->len; i++) {
+        transcode_enqueue(data, g_ptr_array_index(finished, i));
+    }
+    for (guint i = 0; i < proxies->len; i++) {
+        archive_enqueue(data, g_ptr_array_index(proxies, i));
+    }
 
     if (data->pipeline) {
          g_autoptr(GstObject) parent = gst_object_get_parent(GST_OBJECT(recording_bin_temp));
@@ -31,6 +77,18 @@ gboolean cleanup_recording_async(gpointer user_data) {
          }
     }
 
+    if (data->record_stop_time > 0) {
+        g_print("Recording stop latency: %.1f ms (EOS to finalized file).\n",
+                (g_get_monotonic_time() - data->record_stop_time) / 1000.0);
+        data->record_stop_time = 0;
+    }
+
+    record_queue_guard_report(data);
+    // 常驻分支的编码器在录制之间保留，按需模式的编码器随 bin 一起销毁
+    if (!preroll_branch_enabled(data)) {
+        encoder_control_detach(data);
+    }
+
     // --- 2. 清理其他标志和字符串 ---
     if (data->recording_filename) {
         g_free(data->recording_filename);
@@ -46,9 +104,63 @@ gboolean cleanup_recording_async(gpointer user_data) {
         gtk_widget_destroy(data->dialog);
         data->dialog = NULL;
     }
+
+    // 无界面模式的退出请求：录制已经收尾，现在结束主管道
+    if (data->quit_after_recording) {
+        data->quit_after_recording = FALSE;
+        data->restart_recording = FALSE;
+        if (data->pipeline) {
+            preroll_branch_prepare_eos(data);
+            gst_element_send_event(data->pipeline, gst_event_new_eos());
+        }
+        return G_SOURCE_REMOVE;
+    }
+
+    recorder_prepare_tail(data);
+
+    // 预算轮换：旧文件已经关闭，立即开始下一个文件
+    if (data->restart_recording) {
+        data->restart_recording = FALSE;
+        if (!start_recording(data) && data->record_icon) {
+            gtk_image_set_from_icon_name(GTK_IMAGE(data->record_icon), "media-record-symbolic", GTK_ICON_SIZE_SMALL_TOOLBAR);
+        }
+    }
     return G_SOURCE_REMOVE; 
 }
 
+void recorder_handle_element_message(CustomData *data, GstMessage *msg) {
+    // 每个分段关闭后即可转码或迁移，无需等待录制结束
+    if (gst_message_has_name(msg, "splitmuxsink-fragment-closed")) {
+        transcode_enqueue(data, gst_structure_get_string(gst_message_get_structure(msg), "location"));
+        return;
+    }
+    if (!data->is_recording || !gst_message_has_name(msg, "splitmuxsink-fragment-opened")) {
+        return;
+    }
+
+    // 分段切换后，recording_filename 指向当前正在写入的文件
+    const gchar *location = gst_structure_get_string(gst_message_get_structure(msg), "location");
+    if (location && g_strcmp0(location, data->recording_filename) != 0) {
+        g_free(data->recording_filename);
+        data->recording_filename = g_strdup(location);
+        g_print("Recording segment: %s\n", location);
+    }
+}
+
+gboolean recorder_sink_eos(CustomData *data, GstObject *sink) {
+    // 只统计写文件的 sink，直播输出的 EOS 不影响录制结束
+    if (!g_object_get_data(G_OBJECT(sink), RECORD_FILE_SINK)) {
+        return FALSE;
+    }
+    if (data->record_sinks_pending > 0) {
+        data->record_sinks_pending--;
+    }
+#ifdef DEBUG
+    g_print("Recording sink finished, %u remaining.\n", data->record_sinks_pending);
+#endif
+    return data->record_sinks_pending == 0;
+}
+
 // 辅助函数：停止录制并清理分支 (新实现)
 gboolean stop_recording(CustomData *data) {
     if (!data->is_recording || !data->pipeline || !data->recording_bin) {
@@ -60,6 +172,13 @@ gboolean stop_recording(CustomData *data) {
 
     g_print("Stopping recording...\n");
     data->is_stopping_recording = TRUE;
+    data->record_stop_time = g_get_monotonic_time();
+
+    // 预录模式：编码分支常驻，只需让 appsrc 结束尾部
+    if (preroll_branch_enabled(data)) {
+        preroll_branch_stop(data);
+        return TRUE;
+    }
 
     g_autoptr(GstPad) v_bin_sink_pad = gst_element_get_static_pad(data->recording_bin, "videosink");
     g_autoptr(GstPad) a_bin_sink_pad = gst_element_get_static_pad(data->recording_bin, "audiosink");
@@ -84,40 +203,460 @@ gboolean stop_recording(CustomData *data) {
     return TRUE;
 }
 
+gboolean stop_recording_at(CustomData *data, GstClockTime stop) {
+    if (!data->is_recording || data->is_stopping_recording) {
+        return FALSE;
+    }
+    // 预录模式没有 tee 上的探针，或者结束点已经过去：立即停止
+    GstClockTime now = record_cut_running_time(data, g_get_real_time());
+    if (!GST_CLOCK_TIME_IS_VALID(stop) || (GST_CLOCK_TIME_IS_VALID(now) && stop <= now) ||
+        !record_cut_schedule_stop(data, stop)) {
+        if (GST_CLOCK_TIME_IS_VALID(stop) && !data->record_cut) {
+            g_printerr("Warning: Scheduled stop is not available with pre-roll. Stopping now.\n");
+        }
+        return stop_recording(data);
+    }
+    return TRUE;
+}
+
+// 辅助函数：生成录制文件名 YYYYMMDD-HHmmss 并确保录制目录存在
+static gchar *make_recording_filename(CustomData *data, const char *extension) {
+    const char *record_path = iniparser_getstring(data->config_dict, "main:record_path", "/tmp");
+
+    // 尝试创建目录（包括父目录）
+    if (g_mkdir_with_parents(record_path, 0755) == -1 && errno != EEXIST) {
+        g_printerr("Failed to create recording directory: %s\n", record_path);
+        return NULL;
+    }
+
+    // 生成当前时间戳 YYYYMMDD-HHmmss
+    time_t rawtime;
+    struct tm *info;
+    char timestamp[80];
+    time(&rawtime);
+    info = localtime(&rawtime);
+    strftime(timestamp, sizeof(timestamp), "%Y%m%d-%H%M%S", info);
+
+    g_autofree char *filename_with_ext = g_strdup_printf("%s%s", timestamp, extension);
+    return g_build_filename(record_path, filename_with_ext, NULL);
+}
+
+// 探针回调：首个视频 buffer 到达 muxer 时输出启动延迟
+static GstPadProbeReturn first_buffer_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    CustomData *data = (CustomData *)user_data;
+    g_print("Recording start latency: %.1f ms (first video buffer reached the muxer).\n",
+            (g_get_monotonic_time() - data->record_start_time) / 1000.0);
+    return GST_PAD_PROBE_REMOVE;
+}
+
+// 辅助函数：创建写文件的 sink (main:record_sink，默认为带预分配和独立 I/O 线程的 fastfilesink)
+// bin 为 NULL 时只创建不加入 (交给 splitmuxsink)
+static GstElement *make_record_sink(CustomData *data, const char *name, GstBin *bin) {
+    const char *factory = iniparser_getstring(data->config_dict, "main:record_sink", "fastfilesink");
+    GstElement *sink = bin ? create_and_add_element(factory, name, bin) : gst_element_factory_make(factory, name);
+    if (!sink) {
+        g_printerr("Failed to create record sink %s.\n", factory);
+        return NULL;
+    }
+    configure_element_from_ini(sink, data->config_dict, factory);
+    return sink;
+}
+
+// 辅助函数：在 bin 中创建 muxer 和 filesink，并把视频/音频上游链接到 muxer
+static gboolean link_file_tail(CustomData *data, GstBin *bin, const RecordChain *chain,
+                               GstElement *video_upstream, GstElement *audio_upstream) {
+    GstElement *muxer = create_and_add_element(chain->muxer, "record-muxer", bin);
+    GstElement *filesink = make_record_sink(data, "record-filesink", bin);
+    if (!muxer || !filesink) {
+        return FALSE;
+    }
+    configure_element_from_ini(muxer, data->config_dict, chain->muxer);
+    crash_safe_apply(data, muxer, filesink);
+    g_object_set_data(G_OBJECT(filesink), RECORD_FILE_SINK, GINT_TO_POINTER(TRUE));
+    record_budget_attach(data, muxer);
+
+    if (!gst_element_link(video_upstream, muxer) ||
+        !gst_element_link_many(audio_upstream, muxer, filesink, NULL)) { // filesink 直接连到 muxer
+        g_printerr("Failed to link recording elements inside the bin.\n");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// 辅助函数：分段模式下用 splitmuxsink 代替 muxer + filesink，在关键帧处无缝切换文件
+static gboolean link_segmented_tail(CustomData *data, GstBin *bin, const RecordChain *chain,
+                                    GstElement *video_upstream, GstElement *audio_upstream,
+                                    guint64 segment_time, guint64 segment_size) {
+    GstElement *muxer = gst_element_factory_make(chain->muxer, "record-muxer");
+    GstElement *splitmux = create_and_add_element("splitmuxsink", "record-splitmuxsink", bin);
+    if (!muxer || !splitmux) {
+        if (muxer) gst_object_unref(muxer);
+        return FALSE;
+    }
+    configure_element_from_ini(muxer, data->config_dict, chain->muxer);
+    configure_element_from_ini(splitmux, data->config_dict, "splitmuxsink");
+    g_object_set_data(G_OBJECT(splitmux), RECORD_FILE_SINK, GINT_TO_POINTER(TRUE));
+    record_budget_attach(data, muxer);
+
+    // 每个分段文件同样由 main:record_sink 写入
+    GstElement *sink = make_record_sink(data, "record-segment-sink", NULL);
+    if (!sink) {
+        gst_object_unref(muxer);
+        return FALSE;
+    }
+    crash_safe_apply(data, muxer, sink);
+    g_object_set(G_OBJECT(splitmux), "sink", sink, NULL);
+
+    // 按时长切分时主动请求关键帧，使分段时长更准确 (splitmuxsink 只在仅按时长切分时支持)
+    g_object_set(G_OBJECT(splitmux),
+                 "muxer", muxer,
+                 "max-size-time", segment_time,
+                 "max-size-bytes", segment_size,
+                 "send-keyframe-requests", segment_time > 0 && segment_size == 0,
+                 NULL);
+
+    // splitmuxsink 的请求 pad 模板都是 ANY，必须显式请求，不能依赖 gst_element_link 自动选择
+    g_autoptr(GstPad) video_sink_pad = gst_element_request_pad_simple(splitmux, "video");
+    g_autoptr(GstPad) audio_sink_pad = gst_element_request_pad_simple(splitmux, "audio_%u");
+    g_autoptr(GstPad) video_src_pad = gst_element_get_static_pad(video_upstream, "src");
+    g_autoptr(GstPad) audio_src_pad = gst_element_get_static_pad(audio_upstream, "src");
+
+    if (!video_sink_pad || !audio_sink_pad || !video_src_pad || !audio_src_pad ||
+        gst_pad_link(video_src_pad, video_sink_pad) != GST_PAD_LINK_OK ||
+        gst_pad_link(audio_src_pad, audio_sink_pad) != GST_PAD_LINK_OK) {
+        g_printerr("Failed to link recording elements to splitmuxsink.\n");
+        return FALSE;
+    }
+#ifdef DEBUG
+    g_print("Segmented recording: max %" G_GUINT64_FORMAT " s / %" G_GUINT64_FORMAT " bytes per file.\n",
+            segment_time / GST_SECOND, segment_size);
+#endif
+    return TRUE;
+}
+
+// 辅助函数：在编码器和复用器之间插入 tee -> queue，供直播输出在录制过程中接入/断开
+static GstElement *link_live_fanout(GstBin *bin, GstElement *upstream, const char *tee_name, const char *queue_name) {
+    GstElement *tee = create_and_add_element("tee", tee_name, bin);
+    GstElement *queue = create_and_add_element("queue", queue_name, bin);
+    if (!tee || !queue || !gst_element_link_many(upstream, tee, queue, NULL)) {
+        g_printerr("Failed to link live output tee %s.\n", tee_name);
+        return NULL;
+    }
+    return queue;
+}
+
+// 辅助函数：根据 [main] segment_time/segment_size 选择录制尾部并链接
+static gboolean link_record_tail(CustomData *data, GstBin *bin, const RecordChain *chain,
+                                 GstElement *video_upstream, GstElement *audio_upstream) {
+    guint64 segment_time = (guint64)MAX(iniparser_getint(data->config_dict, "main:segment_time", 0), 0) * GST_SECOND;
+    guint64 segment_size = get_ini_size(data->config_dict, "main:segment_size", 0);
+    gboolean linked;
+    GstElement *first_video = video_upstream;
+
+    if (live_outputs_configured(data)) {
+        video_upstream = link_live_fanout(bin, video_upstream, LIVE_VIDEO_TEE, "record-video-live-queue");
+        audio_upstream = link_live_fanout(bin, audio_upstream, LIVE_AUDIO_TEE, "record-audio-live-queue");
+        if (!video_upstream || !audio_upstream) {
+            return FALSE;
+        }
+    }
+
+    if (segment_time > 0 || segment_size > 0) {
+        linked = link_segmented_tail(data, bin, chain, video_upstream, audio_upstream, segment_time, segment_size);
+    } else {
+        linked = link_file_tail(data, bin, chain, video_upstream, audio_upstream);
+    }
+    if (!linked) {
+        return FALSE;
+    }
+
+    g_autoptr(GstPad) video_pad = gst_element_get_static_pad(first_video, "src");
+    if (video_pad) {
+        gst_pad_add_probe(video_pad, GST_PAD_PROBE_TYPE_BUFFER, first_buffer_probe, data, NULL);
+    }
+    return TRUE;
+}
+
+// 辅助函数：生成文件名并设置到录制尾部的 filesink (分段模式下为带序号的文件名模板)
+static gboolean set_record_location(CustomData *data, GstElement *bin, const char *extension) {
+    // 主文件与代理文件共用同一个时间戳
+    g_autofree gchar *base = make_recording_filename(data, "");
+    if (!base) {
+        return FALSE;
+    }
+
+    g_autoptr(GstElement) proxy_filesink = gst_bin_get_by_name(GST_BIN(bin), "proxy-filesink");
+    if (proxy_filesink) {
+        const char *proxy_suffix = iniparser_getstring(data->config_dict, "proxy:suffix", "-proxy");
+        g_autofree gchar *proxy_location = g_strdup_printf("%s%s%s", base, proxy_suffix, extension);
+        g_print("Saving proxy recording to: %s\n", proxy_location);
+        g_object_set(G_OBJECT(proxy_filesink), "location", proxy_location, NULL);
+    }
+
+    g_autoptr(GstElement) splitmux = gst_bin_get_by_name(GST_BIN(bin), "record-splitmuxsink");
+    if (splitmux) {
+        // YYYYMMDD-HHmmss-000.mp4, YYYYMMDD-HHmmss-001.mp4 ...
+        data->recording_filename = g_strdup_printf("%s-%%03d%s", base, extension);
+        g_print("Saving segmented recording to: %s\n", data->recording_filename);
+        g_object_set(G_OBJECT(splitmux), "location", data->recording_filename, NULL);
+        return TRUE;
+    }
+
+    data->recording_filename = g_strdup_printf("%s%s", base, extension);
+
+    g_autoptr(GstElement) filesink = gst_bin_get_by_name(GST_BIN(bin), "record-filesink");
+    if (!filesink) {
+        return FALSE;
+    }
+    g_print("Saving recording to: %s\n", data->recording_filename);
+    g_object_set(G_OBJECT(filesink), "location", data->recording_filename, NULL);
+    return TRUE;
+}
+
+// 辅助函数：构建低分辨率代理分支 tee -> queue -> scaler -> videorate -> capsfilter -> encoder -> parser -> muxer -> filesink
+// 音频直接复用主文件已编码的音频，代理文件与主文件同一个 bin、同一组 tee，因此起始时间一致，同一个 EOS 结束两个文件
+static gboolean link_proxy_branch(CustomData *data, GstBin *bin, const RecordChain *chain,
+                                  GstElement *video_tee, GstElement *audio_tee) {
+    dictionary *dict = data->config_dict;
+    const char *scaler_name = iniparser_getstring(dict, "proxy:scaler", "videoscale");
+    const char *caps_str = iniparser_getstring(dict, "proxy:caps", "video/x-raw, width=640, height=360, framerate=15/1");
+
+    GstElement *video_queue = create_and_add_element("queue", "proxy-video-queue", bin);
+    GstElement *scaler = create_and_add_element(scaler_name, "proxy-scaler", bin);
+    GstElement *rate = create_and_add_element("videorate", "proxy-videorate", bin);
+    GstElement *capsfilter = create_and_add_element("capsfilter", "proxy-capsfilter", bin);
+    GstElement *encoder = create_and_add_element(chain->video_encoder, "proxy-video-encoder", bin);
+    GstElement *parser = chain->video_parser ? create_and_add_element(chain->video_parser, "proxy-video-parser", bin) : NULL;
+    GstElement *audio_queue = create_and_add_element("queue", "proxy-audio-queue", bin);
+    GstElement *muxer = create_and_add_element(chain->muxer, "proxy-muxer", bin);
+    GstElement *filesink = make_record_sink(data, "proxy-filesink", bin);
+
+    if (!video_queue || !scaler || !rate || !capsfilter || !encoder || (chain->video_parser && !parser) ||
+        !audio_queue || !muxer || !filesink) {
+        g_printerr("One or more proxy recording elements could not be created.\n");
+        return FALSE;
+    }
+
+    g_autoptr(GstCaps) caps = gst_caps_from_string(caps_str);
+    if (!caps) {
+        g_printerr("Invalid proxy:caps '%s'.\n", caps_str);
+        return FALSE;
+    }
+    g_object_set(G_OBJECT(capsfilter), "caps", caps, NULL);
+
+    // 代理分支同样不能阻塞主文件：沿用录制队列配置并强制为 leaky
+    configure_element_from_ini(video_queue, dict, "queue_record");
+    configure_element_from_ini(audio_queue, dict, "queue_record");
+    g_object_set(G_OBJECT(video_queue), "leaky", 2, NULL);
+    g_object_set(G_OBJECT(audio_queue), "leaky", 2, NULL);
+    // 先继承主编码器配置，再用 [encoder_proxy] 覆盖 (例如更低的码率)
+    configure_element_from_ini(encoder, dict, chain->video_encoder);
+    configure_element_from_ini(encoder, dict, "encoder_proxy");
+    configure_element_from_ini(muxer, dict, chain->muxer);
+    crash_safe_apply(data, muxer, filesink);
+    g_object_set_data(G_OBJECT(filesink), RECORD_FILE_SINK, GINT_TO_POINTER(TRUE));
+    record_budget_attach(data, muxer);
+
+    GstElement *video_last = parser ? parser : encoder;
+    if (!gst_element_link_many(video_tee, video_queue, scaler, rate, capsfilter, encoder, NULL) ||
+        (parser && !gst_element_link(encoder, parser)) ||
+        !gst_element_link(video_last, muxer) ||
+        !gst_element_link_many(audio_tee, audio_queue, muxer, filesink, NULL)) {
+        g_printerr("Failed to link proxy recording elements inside the bin.\n");
+        return FALSE;
+    }
+#ifdef DEBUG
+    g_print("Proxy recording branch linked: %s @ %s.\n", chain->video_encoder, caps_str);
+#endif
+    return TRUE;
+}
+
+// 辅助函数：原始数据模式 (main:record_format=raw)，不经过编码器
+// queue -> rawdumpsink，视频与音频各写一个 .graw 文件，之后可用 rawdumpsrc 离线编码
+static gboolean link_raw_dump(CustomData *data, GstBin *bin, GstElement **video_input, GstElement **audio_input) {
+    dictionary *dict = data->config_dict;
+    GstElement *video_queue = record_queue_make(data, "record-video-queue", TRUE);
+    if (video_queue) gst_bin_add(bin, video_queue);
+    GstElement *audio_queue = create_and_add_element("queue", "record-audio-queue", bin);
+    GstElement *video_sink = create_and_add_element("rawdumpsink", "record-video-dump", bin);
+    GstElement *audio_sink = create_and_add_element("rawdumpsink", "record-audio-dump", bin);
+    if (!video_queue || !audio_queue || !video_sink || !audio_sink) {
+        g_printerr("One or more raw recording elements could not be created.\n");
+        return FALSE;
+    }
+
+    configure_element_from_ini(video_queue, dict, "queue_record");
+    configure_element_from_ini(audio_queue, dict, "queue_record");
+    record_queue_guard_attach(data, video_queue, TRUE);
+    record_queue_guard_attach(data, audio_queue, FALSE);
+    configure_element_from_ini(video_sink, dict, "rawdumpsink");
+    configure_element_from_ini(audio_sink, dict, "rawdumpsink");
+    g_object_set_data(G_OBJECT(video_sink), RECORD_FILE_SINK, GINT_TO_POINTER(TRUE));
+    g_object_set_data(G_OBJECT(audio_sink), RECORD_FILE_SINK, GINT_TO_POINTER(TRUE));
+    // 没有复用器，按写入 dump 的原始数据量计入预算
+    record_budget_attach(data, video_queue);
+    record_budget_attach(data, audio_queue);
+
+    if (!gst_element_link(video_queue, video_sink) || !gst_element_link(audio_queue, audio_sink)) {
+        g_printerr("Failed to link raw recording elements inside the bin.\n");
+        return FALSE;
+    }
+
+    g_autofree gchar *base = make_recording_filename(data, "");
+    if (!base) {
+        return FALSE;
+    }
+    g_autofree gchar *audio_location = g_strdup_printf("%s-audio%s", base, RAW_DUMP_EXTENSION);
+    data->recording_filename = g_strdup_printf("%s-video%s", base, RAW_DUMP_EXTENSION);
+    g_object_set(G_OBJECT(video_sink), "location", data->recording_filename, NULL);
+    g_object_set(G_OBJECT(audio_sink), "location", audio_location, NULL);
+    g_print("Saving raw recording to: %s, %s\n", data->recording_filename, audio_location);
+
+    *video_input = video_queue;
+    *audio_input = audio_queue;
+    return TRUE;
+}
+
+// 辅助函数：丢弃启动失败的录制 bin
+static void discard_recording_bin(CustomData *data) {
+    GstElement *recording_bin = g_steal_pointer(&data->recording_bin);
+    if (!recording_bin) return;
+
+    gst_element_set_state(recording_bin, GST_STATE_NULL);
+    if (GST_OBJECT_PARENT(recording_bin) == GST_OBJECT(data->pipeline)) {
+        gst_bin_remove(GST_BIN(data->pipeline), recording_bin);
+    } else {
+        gst_object_unref(recording_bin);
+    }
+}
+
+// 辅助函数：构建常驻分支使用的 appsrc -> muxer -> filesink 尾部 (尚未设置文件名)
+static GstElement *build_preroll_tail(CustomData *data) {
+    const RecordChain *chain = &data->record_chain;
+
+    GstElement *bin = gst_bin_new("recording-bin");
+    if (!bin) {
+        g_printerr("Failed to create recording bin.\n");
+        return NULL;
+    }
+    g_object_set(G_OBJECT(bin), "message-forward", TRUE, NULL);
+
+    GstElement *video_src = create_and_add_element("appsrc", "record-video-src", GST_BIN(bin));
+    GstElement *audio_src = create_and_add_element("appsrc", "record-audio-src", GST_BIN(bin));
+    if (!video_src || !audio_src) {
+        gst_object_unref(bin);
+        return NULL;
+    }
+
+    // 时间戳由常驻分支重新计算为从 0 开始，尾部不参与直播延迟计算
+    g_object_set(G_OBJECT(video_src), "format", GST_FORMAT_TIME, "is-live", FALSE, "block", FALSE, NULL);
+    g_object_set(G_OBJECT(audio_src), "format", GST_FORMAT_TIME, "is-live", FALSE, "block", FALSE, NULL);
+
+    if (!link_record_tail(data, GST_BIN(bin), chain, video_src, audio_src)) {
+        gst_object_unref(bin);
+        return NULL;
+    }
+    return gst_object_ref_sink(bin);
+}
+
+gboolean recorder_prepare_tail(gpointer user_data) {
+    CustomData *data = (CustomData *)user_data;
+
+    if (data->pipeline && preroll_branch_enabled(data) && !data->spare_recording_bin) {
+        data->spare_recording_bin = build_preroll_tail(data);
+#ifdef DEBUG
+        g_print("Spare recording tail %s.\n", data->spare_recording_bin ? "prepared" : "could not be prepared");
+#endif
+    }
+    return G_SOURCE_REMOVE;
+}
+
+// 辅助函数：常驻分支模式下只接入预先构建好的尾部
+static gboolean start_recording_preroll(CustomData *data) {
+    const RecordChain *chain = &data->record_chain;
+    gboolean started = FALSE;
+
+    data->recording_bin = g_steal_pointer(&data->spare_recording_bin);
+    if (!data->recording_bin) {
+        data->recording_bin = build_preroll_tail(data);
+    }
+    if (!data->recording_bin || !set_record_location(data, data->recording_bin, chain->extension)) {
+        goto cleanup;
+    }
+    if (iniparser_getboolean(data->config_dict, "proxy:enable", 0)) {
+        g_printerr("Warning: Proxy recording is only available in ondemand mode without pre-roll. Recording master only.\n");
+    }
+    data->record_sinks_pending = 1;
+
+    // 加入管道后由管道持有引用
+    gst_bin_add(GST_BIN(data->pipeline), data->recording_bin);
+    gst_object_unref(data->recording_bin);
+    gst_element_sync_state_with_parent(data->recording_bin);
+
+    {
+        g_autoptr(GstElement) video_src = gst_bin_get_by_name(GST_BIN(data->recording_bin), "record-video-src");
+        g_autoptr(GstElement) audio_src = gst_bin_get_by_name(GST_BIN(data->recording_bin), "record-audio-src");
+
+        // 先写入环形缓冲中的 GOP，之后继续实时送入
+        started = video_src && audio_src && preroll_branch_start(data, video_src, audio_src);
+    }
+    if (!started) {
+        goto cleanup;
+    }
+
+    g_print("Recording started.\n");
+    data->is_recording = TRUE;
+    live_outputs_start(data);
+    // 为下一次录制预先准备尾部
+    g_idle_add(recorder_prepare_tail, data);
+    return TRUE;
+
+cleanup:
+    g_printerr("Failed to start recording. Cleaning up.\n");
+    discard_recording_bin(data);
+    g_idle_add(cleanup_recording_async, data);
+    return FALSE;
+}
+
 // 辅助函数：构建并链接录制分支
 gboolean start_recording(CustomData *data) {
+    return start_recording_at(data, GST_CLOCK_TIME_NONE);
+}
+
+gboolean start_recording_at(CustomData *data, GstClockTime start) {
     if (!data->video_tee || !data->audio_tee || !data->pipeline || data->is_recording || !data->config_dict) {
         g_printerr("Recording preconditions failed.\n");
         return FALSE;
     }
+    if (!data->record_chain.muxer) {
+        g_printerr("Recording is disabled: no usable recording codec chain.\n");
+        return FALSE;
+    }
 
     g_print("Starting recording...\n");
-    dictionary *dict = data->config_dict;
-    GstElement *muxer, *filesink, *video_record_queue, *video_encoder, *video_parser, *audio_record_queue, *audio_encoder;
-
-    // --- 1. 获取 INI 配置参数 ---
-    const char *record_path = iniparser_getstring(dict, "main:record_path", "/tmp");
-    const char *video_encoder_name = iniparser_getstring(dict, "main:encoder", "x264enc");
-    const char *audio_encoder_name = "fdkaacenc";
-    const char *video_parser_name = NULL;
-    const char *muxer_name = "mp4mux";
-    const char *extension = ".mp4";
-    g_autofree char *filename_with_ext = NULL;
-
-    if (strstr(video_encoder_name, "h264") != NULL || strstr(video_encoder_name, "x264") != NULL) {
-        video_parser_name = "h264parse";
-    } else if (strstr(video_encoder_name, "h265") != NULL || strstr(video_encoder_name, "x265") != NULL) {
-        video_parser_name = "h265parse";
-    } else if (strstr(video_encoder_name, "vp9") != NULL) {
-        video_parser_name = "vp9parse";
-        audio_encoder_name = "opusenc";
-        muxer_name = "webmmux";
-        extension = ".webm";
-    } else {
-        g_printerr("Warning: Unknown encoder %s. Defaulting to h264parse, this might fail.\n", video_encoder_name);
-        video_parser_name = "h264parse";
+    data->record_start_time = g_get_monotonic_time();
+    transcode_pause(data);
+    record_queue_guard_reset(data);
+    record_budget_reset(data);
+    if (preroll_branch_enabled(data)) {
+        if (g_strcmp0(iniparser_getstring(data->config_dict, "main:record_format", "encoded"), "raw") == 0) {
+            g_printerr("Warning: Raw recording is only available in ondemand mode without pre-roll. Recording encoded.\n");
+        }
+        if (GST_CLOCK_TIME_IS_VALID(start)) {
+            g_printerr("Warning: Scheduled start is not available with pre-roll. Starting now.\n");
+        }
+        return start_recording_preroll(data);
     }
 
+    dictionary *dict = data->config_dict;
+    GstElement *video_record_queue, *video_encoder, *video_parser = NULL, *audio_record_queue, *audio_encoder;
+    GstElement *video_input, *audio_input, *audio_output;
+    gboolean proxy = iniparser_getboolean(dict, "proxy:enable", 0);
+    gboolean raw = g_strcmp0(iniparser_getstring(dict, "main:record_format", "encoded"), "raw") == 0;
+
+    // --- 1. 启动时已解析好的编码器/解析器/复用器 ---
+    const RecordChain *chain = &data->record_chain;
+
     // --- 2. 创建并组装一个 GstBin 作为录制子管道 ---
     data->recording_bin = gst_bin_new("recording-bin");
     if (!data->recording_bin) {
@@ -126,62 +665,86 @@ gboolean start_recording(CustomData *data) {
     }
     g_object_set(G_OBJECT(data->recording_bin), "message-forward", TRUE, NULL);
 
+    // 原始数据模式：编码器跟不上时直接保存未编码的帧
+    if (raw) {
+        if (proxy || live_outputs_configured(data)) {
+            g_printerr("Warning: Proxy and live outputs need the encoder branch. Recording raw frames only.\n");
+        }
+        if (!link_raw_dump(data, GST_BIN(data->recording_bin), &video_input, &audio_input)) {
+            goto cleanup;
+        }
+        data->record_sinks_pending = 2;
+        goto link_inputs;
+    }
+
     // 在 Bin 内部创建所有元素
-    video_record_queue = gst_element_factory_make("queue", "record-video-queue");
-    video_encoder        = gst_element_factory_make(video_encoder_name, "record-video-encoder");
-    video_parser         = gst_element_factory_make(video_parser_name, "record-video-parser");
+    video_record_queue = record_queue_make(data, "record-video-queue", TRUE);
+    video_encoder        = gst_element_factory_make(chain->video_encoder, "record-video-encoder");
+    if (chain->video_parser) {
+        video_parser     = gst_element_factory_make(chain->video_parser, "record-video-parser");
+    }
     audio_record_queue = gst_element_factory_make("queue", "record-audio-queue");
-    audio_encoder        = gst_element_factory_make(audio_encoder_name, "record-audio-encoder");
-    muxer                = gst_element_factory_make(muxer_name, "record-muxer");
-    filesink             = gst_element_factory_make("filesink", "record-filesink");
+    audio_encoder        = gst_element_factory_make(chain->audio_encoder, "record-audio-encoder");
 
-    if (!video_record_queue || !video_encoder || !video_parser || !audio_record_queue || !audio_encoder || !muxer || !filesink) {
+    if (!video_record_queue || !video_encoder || (chain->video_parser && !video_parser) || !audio_record_queue || !audio_encoder) {
         g_printerr("One or more recording elements could not be created.\n");
         goto cleanup;
     }
 
     // 将所有新元素添加到 bin 中
     gst_bin_add_many(GST_BIN(data->recording_bin), 
-                     video_record_queue, video_encoder, video_parser, 
-                     audio_record_queue, audio_encoder, muxer, filesink, NULL);
+                     video_record_queue, video_encoder, 
+                     audio_record_queue, audio_encoder, NULL);
+    if (video_parser) {
+        gst_bin_add(GST_BIN(data->recording_bin), video_parser);
+    }
 
     // --- 3. 配置元素 ---
     configure_element_from_ini(video_record_queue, dict, "queue_record");
     configure_element_from_ini(audio_record_queue, dict, "queue_record");
-    configure_element_from_ini(video_encoder, dict, video_encoder_name);
-    configure_element_from_ini(audio_encoder, dict, audio_encoder_name);
-    configure_element_from_ini(muxer, dict, muxer_name);
+    record_queue_guard_attach(data, video_record_queue, TRUE);
+    record_queue_guard_attach(data, audio_record_queue, FALSE);
+    configure_element_from_ini(video_encoder, dict, chain->video_encoder);
+    encoder_control_attach(data, video_encoder);
+    configure_element_from_ini(audio_encoder, dict, chain->audio_encoder);
 
-    // 尝试创建目录（包括父目录）
-    if (g_mkdir_with_parents(record_path, 0755) == -1 && errno != EEXIST) {
-        g_printerr("Failed to create recording directory: %s\n", record_path);
+    // --- 4. 链接 Bin 内部的元素 ---
+    if (!gst_element_link(video_record_queue, video_encoder) ||
+        (video_parser && !gst_element_link(video_encoder, video_parser)) ||
+        !gst_element_link(audio_record_queue, audio_encoder)) {
+        g_printerr("Failed to link recording elements inside the bin.\n");
         goto cleanup;
     }
 
-    // 生成当前时间戳 YYYYMMDD-HHmmss
-    time_t rawtime;
-    struct tm *info;
-    char timestamp[80];
-    time(&rawtime);
-    info = localtime(&rawtime);
-    strftime(timestamp, sizeof(timestamp), "%Y%m%d-%H%M%S", info);
-    filename_with_ext = g_strdup_printf("%s%s", timestamp, extension);
-    data->recording_filename = g_build_filename(record_path, filename_with_ext, NULL);
-
-    g_print("Saving recording to: %s\n", data->recording_filename);
-    g_object_set(G_OBJECT(filesink), "location", data->recording_filename, NULL);
+    video_input = video_record_queue;
+    audio_input = audio_record_queue;
+    audio_output = audio_encoder;
+    if (proxy) {
+        // 代理模式：原始视频和已编码音频各经过一个 tee，分给主文件和代理文件
+        GstElement *video_split = create_and_add_element("tee", "record-video-split", GST_BIN(data->recording_bin));
+        GstElement *audio_split = create_and_add_element("tee", "record-audio-split", GST_BIN(data->recording_bin));
+        GstElement *audio_mux_queue = create_and_add_element("queue", "record-audio-mux-queue", GST_BIN(data->recording_bin));
+        if (!video_split || !audio_split || !audio_mux_queue ||
+            !gst_element_link(video_split, video_record_queue) ||
+            !gst_element_link_many(audio_encoder, audio_split, audio_mux_queue, NULL) ||
+            !link_proxy_branch(data, GST_BIN(data->recording_bin), chain, video_split, audio_split)) {
+            goto cleanup;
+        }
+        video_input = video_split;
+        audio_output = audio_mux_queue;
+    }
 
-    // --- 4. 链接 Bin 内部的元素 ---
-    if (!gst_element_link_many(video_record_queue, video_encoder, video_parser, muxer, NULL) ||
-        !gst_element_link_many(audio_record_queue, audio_encoder, muxer, filesink, NULL)) { // filesink 直接连到 muxer
-        g_printerr("Failed to link recording elements inside the bin.\n");
+    if (!link_record_tail(data, GST_BIN(data->recording_bin), chain, video_parser ? video_parser : video_encoder, audio_output) ||
+        !set_record_location(data, data->recording_bin, chain->extension)) {
         goto cleanup;
     }
+    data->record_sinks_pending = proxy ? 2 : 1;
 
+link_inputs:
     {
         // --- 5. 为 Bin 创建幽灵垫 (Ghost Pads) 作为输入接口 ---
-        g_autoptr(GstPad) v_queue_sink_pad = gst_element_get_static_pad(video_record_queue, "sink");
-        g_autoptr(GstPad) a_queue_sink_pad = gst_element_get_static_pad(audio_record_queue, "sink");
+        g_autoptr(GstPad) v_queue_sink_pad = gst_element_get_static_pad(video_input, "sink");
+        g_autoptr(GstPad) a_queue_sink_pad = gst_element_get_static_pad(audio_input, "sink");
 
         if (!v_queue_sink_pad || !a_queue_sink_pad) {
             g_printerr("Failed to get sink pads for queues.\n");
@@ -208,6 +771,11 @@ gboolean start_recording(CustomData *data) {
         g_autoptr(GstPad) v_bin_sink_pad = gst_element_get_static_pad(data->recording_bin, "videosink");
         g_autoptr(GstPad) a_bin_sink_pad = gst_element_get_static_pad(data->recording_bin, "audiosink");
 
+        // 链接之前安装切分探针，第一帧即从切分点开始
+        if (v_tee_src_pad && a_tee_src_pad) {
+            record_cut_attach(data, v_tee_src_pad, a_tee_src_pad, start);
+        }
+
         if (!v_tee_src_pad || !v_bin_sink_pad || !a_tee_src_pad || !a_bin_sink_pad ||
             gst_pad_link(v_tee_src_pad, v_bin_sink_pad) != GST_PAD_LINK_OK ||
             gst_pad_link(a_tee_src_pad, a_bin_sink_pad) != GST_PAD_LINK_OK) {
@@ -230,6 +798,7 @@ gboolean start_recording(CustomData *data) {
 #endif
         g_print("Recording started.\n");
         data->is_recording = TRUE;
+        live_outputs_start(data);
         return TRUE;
     end_of_scope1:;
     }
@@ -237,11 +806,7 @@ gboolean start_recording(CustomData *data) {
 cleanup:
     g_printerr("Failed to start recording. Cleaning up.\n");
 
-    if (data->recording_bin) {
-         gst_element_set_state(data->recording_bin, GST_STATE_NULL);
-         gst_object_unref(data->recording_bin);
-         data->recording_bin = NULL;
-    }
+    discard_recording_bin(data);
 
     g_idle_add(cleanup_recording_async, data);
 
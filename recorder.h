@@ -3,6 +3,13 @@
 
 #include "config.h"
 
+/*
+ * Build the appsrc -> muxer -> filesink tail for the next recording ahead of time.
+ * user_data: Pointer to the CustomData structure (usable with g_idle_add).
+ * Returns: G_SOURCE_REMOVE.
+ */
+gboolean recorder_prepare_tail(gpointer user_data);
+
 /*
  * Start the recording process.
  * data: Pointer to the CustomData structure.
@@ -10,6 +17,16 @@
  */
 gboolean start_recording(CustomData *data);
 
+/*
+ * Start a recording whose first video frame is the first one at or after a pipeline
+ * running time (see record_cut_running_time()); audio is cut at the same instant.
+ * Buffers before it are dropped at the tee, so the bin is linked right away.
+ * Pre-roll mode starts immediately.
+ * start: Running time, or GST_CLOCK_TIME_NONE for the next frame.
+ * Returns: TRUE if successful, FALSE otherwise.
+ */
+gboolean start_recording_at(CustomData *data, GstClockTime start);
+
 /*
  * Stop the recording process.
  * data: Pointer to the CustomData structure.
@@ -17,6 +34,28 @@ gboolean start_recording(CustomData *data);
  */
 gboolean stop_recording(CustomData *data);
 
+/*
+ * Stop the recording at a pipeline running time, frame-accurately. A time that
+ * has already passed, or pre-roll mode, stops immediately like stop_recording().
+ * Returns: TRUE if the stop was scheduled or started, FALSE if not recording.
+ */
+gboolean stop_recording_at(CustomData *data, GstClockTime stop);
+
+/*
+ * Track segment switches posted by splitmuxsink in segmented mode.
+ * data: Pointer to the CustomData structure.
+ * msg: Element message received on the pipeline bus.
+ */
+void recorder_handle_element_message(CustomData *data, GstMessage *msg);
+
+/*
+ * Account for an EOS forwarded from a direct child of the recording bin.
+ * data: Pointer to the CustomData structure.
+ * sink: Source of the EOS message; only file sinks (master and proxy) are counted.
+ * Returns: TRUE once every file sink of the recording has finished.
+ */
+gboolean recorder_sink_eos(CustomData *data, GstObject *sink);
+
 /*
  * Helper function to clean up recording branch GStreamer elements asynchronously.
  * user_data: Pointer to the CustomData structure (used in g_idle_add).
@@ -25,4 +64,3 @@ gboolean stop_recording(CustomData *data);
 gboolean cleanup_recording_async(gpointer user_data);
 
 #endif // RECORDER_H
-
@@ -0,0 +1,251 @@
+#include "utils.h"
+#include "config.h"
+#include "recqueue.h"
+#include <gst/gst.h>
+#include <string.h>
+#include <iniparser.h>
+
+typedef enum {
+    RECORD_POLICY_DROP_OLDEST,          /* 队列满时丢弃最旧的帧 (leaky=downstream) */
+    RECORD_POLICY_DROP_NON_REF,         /* 超过高水位后隔帧丢弃，降低送入编码器的帧率 */
+    RECORD_POLICY_PAUSE,                /* 超过高水位后暂停录制输入，回落到低水位后恢复 */
+} RecordPolicy;
+
+struct _RecordQueueGuard {
+    RecordPolicy policy;
+    gdouble high_watermark;             /* 相对队列容量的比例 */
+    gdouble low_watermark;
+    GstClockTime max_time;              /* 视频录制队列的 max-size-time */
+    guint max_buffers;                  /* 视频录制队列的 max-size-buffers */
+
+    /* 以下计数器由流线程无锁更新 */
+    guint64 in_buffers;                 /* 进入视频队列的帧数 */
+    guint64 out_buffers;                /* 离开视频队列的帧数 */
+    guint64 last_in_pts;
+    guint64 last_out_pts;
+    guint64 dropped_full;               /* 队列满时被 leaky 丢弃的视频帧 */
+    guint64 dropped_audio;              /* 队列满时被 leaky 丢弃的音频 buffer */
+    guint64 dropped_policy;             /* 按策略在入队前丢弃的视频帧 */
+    guint64 decimate_count;
+    guint64 paused;
+
+    guint64 reported_drops;             /* 上次报告时的丢帧总数 (仅主线程) */
+    GstClockTime max_lag;               /* 本次录制中观察到的最大延迟 (仅主线程) */
+    guint report_id;
+};
+
+static const char *policy_names[] = { "drop-oldest", "drop-non-ref", "pause" };
+
+static GstClockTime guard_lag(RecordQueueGuard *guard) {
+    guint64 in_pts = counter_get(&guard->last_in_pts);
+    guint64 out_pts = counter_get(&guard->last_out_pts);
+    return in_pts > out_pts ? in_pts - out_pts : 0;
+}
+
+// 辅助函数：根据时间延迟和帧数估算视频队列的填充比例
+static gdouble guard_fill(RecordQueueGuard *guard) {
+    gdouble fill = 0.0;
+    if (guard->max_time > 0) {
+        fill = (gdouble)guard_lag(guard) / guard->max_time;
+    }
+    if (guard->max_buffers > 0) {
+        guint64 in = counter_get(&guard->in_buffers);
+        guint64 gone = counter_get(&guard->out_buffers) + counter_get(&guard->dropped_full);
+        fill = MAX(fill, in > gone ? (gdouble)(in - gone) / guard->max_buffers : 0.0);
+    }
+    return fill;
+}
+
+// 探针回调：视频帧进入录制队列之前，按策略决定是否丢弃
+static GstPadProbeReturn queue_in_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    RecordQueueGuard *guard = (RecordQueueGuard *)user_data;
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+
+    if (guard->policy != RECORD_POLICY_DROP_OLDEST) {
+        gdouble fill = guard_fill(guard);
+        gboolean drop = FALSE;
+
+        if (guard->policy == RECORD_POLICY_DROP_NON_REF) {
+            drop = fill >= guard->high_watermark && (counter_get(&guard->decimate_count) & 1);
+            counter_add(&guard->decimate_count, 1);
+        } else if (counter_get(&guard->paused)) {
+            if (fill <= guard->low_watermark) {
+                counter_set(&guard->paused, 0);
+            } else {
+                drop = TRUE;
+            }
+        } else if (fill >= guard->high_watermark) {
+            counter_set(&guard->paused, 1);
+            drop = TRUE;
+        }
+
+        if (drop) {
+            counter_add(&guard->dropped_policy, 1);
+            return GST_PAD_PROBE_DROP;
+        }
+    }
+
+    counter_add(&guard->in_buffers, 1);
+    if (GST_BUFFER_PTS_IS_VALID(buf)) {
+        counter_set(&guard->last_in_pts, GST_BUFFER_PTS(buf));
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+// 探针回调：视频帧离开录制队列 (编码器线程)
+static GstPadProbeReturn queue_out_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    RecordQueueGuard *guard = (RecordQueueGuard *)user_data;
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+
+    counter_add(&guard->out_buffers, 1);
+    if (GST_BUFFER_PTS_IS_VALID(buf)) {
+        counter_set(&guard->last_out_pts, GST_BUFFER_PTS(buf));
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+// 信号回调：leaky 队列已满，即将丢弃最旧的 buffer
+static void on_video_overrun(GstElement *queue, gpointer user_data) {
+    counter_add(&((RecordQueueGuard *)user_data)->dropped_full, 1);
+}
+
+static void on_audio_overrun(GstElement *queue, gpointer user_data) {
+    counter_add(&((RecordQueueGuard *)user_data)->dropped_audio, 1);
+}
+
+static guint64 guard_total_drops(RecordQueueGuard *guard) {
+    return counter_get(&guard->dropped_full) + counter_get(&guard->dropped_policy) + counter_get(&guard->dropped_audio);
+}
+
+static gboolean report_timeout(gpointer user_data) {
+    CustomData *data = (CustomData *)user_data;
+    RecordQueueGuard *guard = data->record_guard;
+    if (!data->is_recording) return G_SOURCE_CONTINUE;
+
+    GstClockTime lag = guard_lag(guard);
+    guard->max_lag = MAX(guard->max_lag, lag);
+
+    // 只在有新的丢帧或延迟超过高水位时输出
+    guint64 drops = guard_total_drops(guard);
+    if (drops != guard->reported_drops || guard_fill(guard) >= guard->high_watermark) {
+        record_queue_guard_report(data);
+        guard->reported_drops = drops;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+void record_queue_guard_init(CustomData *data) {
+    dictionary *dict = data->config_dict;
+    RecordQueueGuard *guard = g_new0(RecordQueueGuard, 1);
+
+    const char *policy = iniparser_getstring(dict, "main:record_policy", "drop-oldest");
+    guard->policy = RECORD_POLICY_DROP_OLDEST;
+    for (guint i = 0; i < G_N_ELEMENTS(policy_names); i++) {
+        if (strcmp(policy, policy_names[i]) == 0) {
+            guard->policy = (RecordPolicy)i;
+        }
+    }
+    if (strcmp(policy, policy_names[guard->policy]) != 0) {
+        g_printerr("Warning: Unknown record_policy '%s'. Using drop-oldest.\n", policy);
+    }
+
+    guard->high_watermark = iniparser_getdouble(dict, "main:record_policy_high", 0.8);
+    guard->low_watermark = iniparser_getdouble(dict, "main:record_policy_low", 0.5);
+
+    int interval = iniparser_getint(dict, "main:record_policy_report", 5);
+    if (interval > 0) {
+        guard->report_id = g_timeout_add_seconds(interval, report_timeout, data);
+    }
+    data->record_guard = guard;
+}
+
+GstElement *record_queue_make(CustomData *data, const char *name, gboolean is_video) {
+    dictionary *dict = data->config_dict;
+    if (!is_video || g_strcmp0(iniparser_getstring(dict, "main:record_buffer", "queue"), "spill") != 0) {
+        return gst_element_factory_make("queue", name);
+    }
+
+    // 内存上限之外的帧写入映射的暂存文件，默认放在缓存目录 (/tmp 可能是 tmpfs，仍然占用内存)
+    GstElement *queue = gst_element_factory_make("spillqueue", name);
+    if (!queue) return NULL;
+    g_autofree gchar *spill_dir = g_build_filename(g_get_user_cache_dir(), "gst-capture", NULL);
+    g_mkdir_with_parents(spill_dir, 0700);
+    g_object_set(G_OBJECT(queue), "spill-directory", spill_dir, NULL);
+    configure_element_from_ini(queue, dict, "spillqueue");
+    return queue;
+}
+
+void record_queue_guard_attach(CustomData *data, GstElement *queue, gboolean is_video) {
+    RecordQueueGuard *guard = data->record_guard;
+    if (!guard || !queue) return;
+
+    // 无论哪种策略，录制队列都不允许阻塞 tee，从而不会拖住预览
+    g_object_set(G_OBJECT(queue), "leaky", 2, NULL);
+
+    if (!is_video) {
+        g_signal_connect(queue, "overrun", G_CALLBACK(on_audio_overrun), guard);
+        return;
+    }
+
+    guint64 max_time = 0;
+    g_object_get(G_OBJECT(queue), "max-size-time", &max_time, "max-size-buffers", &guard->max_buffers, NULL);
+    guard->max_time = max_time;
+    g_signal_connect(queue, "overrun", G_CALLBACK(on_video_overrun), guard);
+
+    g_autoptr(GstPad) sink_pad = gst_element_get_static_pad(queue, "sink");
+    g_autoptr(GstPad) src_pad = gst_element_get_static_pad(queue, "src");
+    gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, queue_in_probe, guard, NULL);
+    gst_pad_add_probe(src_pad, GST_PAD_PROBE_TYPE_BUFFER, queue_out_probe, guard, NULL);
+
+#ifdef DEBUG
+    g_print("Recording queue %s: policy %s, watermarks %.2f/%.2f.\n", GST_OBJECT_NAME(queue),
+            policy_names[guard->policy], guard->high_watermark, guard->low_watermark);
+#endif
+}
+
+void record_queue_guard_reset(CustomData *data) {
+    RecordQueueGuard *guard = data->record_guard;
+    if (!guard) return;
+
+    counter_set(&guard->in_buffers, 0);
+    counter_set(&guard->out_buffers, 0);
+    counter_set(&guard->last_in_pts, 0);
+    counter_set(&guard->last_out_pts, 0);
+    counter_set(&guard->dropped_full, 0);
+    counter_set(&guard->dropped_audio, 0);
+    counter_set(&guard->dropped_policy, 0);
+    counter_set(&guard->paused, 0);
+    guard->reported_drops = 0;
+    guard->max_lag = 0;
+}
+
+void record_queue_guard_report(CustomData *data) {
+    RecordQueueGuard *guard = data->record_guard;
+    if (!guard) return;
+
+    GstClockTime lag = guard_lag(guard);
+    guard->max_lag = MAX(guard->max_lag, lag);
+    g_print("Recording branch: lag %.1f ms (max %.1f ms), dropped video %" G_GUINT64_FORMAT
+            " (queue full) + %" G_GUINT64_FORMAT " (%s), audio %" G_GUINT64_FORMAT ".\n",
+            (double)lag / GST_MSECOND, (double)guard->max_lag / GST_MSECOND,
+            counter_get(&guard->dropped_full), counter_get(&guard->dropped_policy),
+            policy_names[guard->policy], counter_get(&guard->dropped_audio));
+}
+
+GstClockTime record_queue_guard_lag(CustomData *data) {
+    return data->record_guard ? guard_lag(data->record_guard) : 0;
+}
+
+gdouble record_queue_guard_fill(CustomData *data) {
+    return data->record_guard ? guard_fill(data->record_guard) : 0.0;
+}
+
+void record_queue_guard_free(CustomData *data) {
+    RecordQueueGuard *guard = g_steal_pointer(&data->record_guard);
+    if (!guard) return;
+
+    if (guard->report_id > 0) {
+        g_source_remove(guard->report_id);
+    }
+    g_free(guard);
+}
@@ -0,0 +1,49 @@
+#ifndef RECQUEUE_H
+#define RECQUEUE_H
+
+#include "config.h"
+
+/*
+ * Parse main:record_policy and start the periodic drop/lag report.
+ * data: Pointer to the CustomData structure.
+ */
+void record_queue_guard_init(CustomData *data);
+
+/*
+ * Create (but do not add) a recording queue. The video queue is a "spillqueue" when
+ * main:record_buffer=spill, configured from the [spillqueue] section; otherwise a plain queue.
+ * name: Element name, e.g. "record-video-queue".
+ * Returns: The new element, or NULL on failure.
+ */
+GstElement *record_queue_make(CustomData *data, const char *name, gboolean is_video);
+
+/*
+ * Make a recording queue leaky and apply the configured overload policy to it.
+ * queue: The record-video-queue or record-audio-queue element.
+ * is_video: TRUE for the video queue, which also gets the drop-non-ref/pause policies.
+ */
+void record_queue_guard_attach(CustomData *data, GstElement *queue, gboolean is_video);
+
+/*
+ * Reset the counters at the start of a recording.
+ */
+void record_queue_guard_reset(CustomData *data);
+
+/*
+ * Print dropped frames and lag of the recording branch.
+ */
+void record_queue_guard_report(CustomData *data);
+
+/*
+ * Current lag of the video recording queue in nanoseconds.
+ */
+GstClockTime record_queue_guard_lag(CustomData *data);
+
+/*
+ * Fill level of the video recording queue relative to its max-size-time/buffers (0.0 - 1.0+).
+ */
+gdouble record_queue_guard_fill(CustomData *data);
+
+void record_queue_guard_free(CustomData *data);
+
+#endif // RECQUEUE_H
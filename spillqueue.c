@@ -0,0 +1,601 @@
+#include "spillqueue.h"
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#define DEFAULT_MAX_SIZE_TIME (10 * GST_SECOND)
+#define DEFAULT_MAX_SIZE_BUFFERS 0
+#define DEFAULT_MAX_MEMORY (256 * 1024 * 1024)
+#define DEFAULT_MAX_SPILL (G_GUINT64_CONSTANT(4) * 1024 * 1024 * 1024)
+#define DEFAULT_LEAKY 2
+
+enum {
+    PROP_0,
+    PROP_MAX_SIZE_TIME,
+    PROP_MAX_SIZE_BUFFERS,
+    PROP_MAX_MEMORY,
+    PROP_MAX_SPILL,
+    PROP_SPILL_DIRECTORY,
+    PROP_LEAKY,
+    PROP_CURRENT_MEMORY,
+    PROP_CURRENT_SPILL,
+};
+
+enum {
+    SIGNAL_OVERRUN,
+    LAST_SIGNAL,
+};
+
+static guint spill_queue_signals[LAST_SIGNAL];
+
+/* 队列项：事件、内存中的 buffer，或者已写入暂存文件的 buffer */
+typedef struct {
+    GstMiniObject *object;              /* 事件或内存中的 buffer；已溢出时为只含元数据的空 buffer */
+    gboolean spilled;
+    guint64 offset;                     /* 在暂存文件中的偏移 */
+    gsize size;
+} SpillItem;
+
+struct _GstSpillQueue {
+    GstElement parent;
+    GstPad *sinkpad;
+    GstPad *srcpad;
+
+    /* 属性 */
+    guint64 max_size_time;
+    guint max_size_buffers;
+    guint64 max_memory;
+    guint64 max_spill;
+    gchar *spill_directory;
+    gint leaky;
+
+    GMutex lock;
+    GCond item_add;
+    GCond item_del;
+    GQueue items;
+    gboolean flushing;
+    GstFlowReturn srcresult;
+
+    guint buffers;                      /* 队列中的 buffer 数 */
+    guint64 memory;                     /* 内存中的 buffer 字节数 */
+
+    /* 暂存文件：按先进先出顺序使用的环形区域 */
+    int spill_fd;
+    guint8 *spill_map;
+    guint64 spill_head;                 /* 最旧的已溢出 buffer 的偏移 */
+    guint64 spill_tail;                 /* 下一次写入的偏移 */
+    gboolean spill_wrapped;
+    guint64 spill_used;
+    guint spill_count;
+
+    /* 统计 */
+    guint64 peak_memory;
+    guint64 peak_spill;
+    guint64 spilled_bytes;
+    guint64 spilled_buffers;
+    guint64 dropped;
+};
+
+G_DEFINE_TYPE(GstSpillQueue, gst_spill_queue, GST_TYPE_ELEMENT)
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE("sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE("src", GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+// 辅助函数：在暂存文件中分配一段连续空间 (调用者持有锁)
+static gboolean spill_alloc(GstSpillQueue *self, gsize size, guint64 *offset) {
+    if (!self->spill_map) return FALSE;
+
+    if (!self->spill_wrapped) {
+        if (self->spill_tail + size <= self->max_spill) {
+            *offset = self->spill_tail;
+        } else if (size <= self->spill_head) {
+            // 尾部空间不足，从文件开头继续 (读取位置之前的空间已经释放)
+            self->spill_wrapped = TRUE;
+            *offset = 0;
+        } else {
+            return FALSE;
+        }
+    } else if (self->spill_tail + size <= self->spill_head) {
+        *offset = self->spill_tail;
+    } else {
+        return FALSE;
+    }
+
+    self->spill_tail = *offset + size;
+    self->spill_used += size;
+    self->spill_count++;
+    self->peak_spill = MAX(self->peak_spill, self->spill_used);
+    return TRUE;
+}
+
+// 辅助函数：释放最旧的已溢出 buffer 占用的空间 (调用者持有锁)
+static void spill_release(GstSpillQueue *self, SpillItem *item) {
+    if (item->offset < self->spill_head) {
+        self->spill_wrapped = FALSE;    // 读取位置也回到了文件开头
+    }
+    self->spill_head = item->offset + item->size;
+    self->spill_used -= item->size;
+    if (--self->spill_count == 0) {
+        self->spill_head = self->spill_tail = 0;
+        self->spill_wrapped = FALSE;
+    }
+    // 已读出的数据不需要再保留在页缓存中
+    madvise(self->spill_map + (item->offset & ~(guint64)(sysconf(_SC_PAGESIZE) - 1)),
+            item->size + (item->offset & (sysconf(_SC_PAGESIZE) - 1)), MADV_DONTNEED);
+}
+
+// 辅助函数：只有系统内存中的 buffer 可以溢出 (GPU 显存等不占用进程内存)
+static gboolean buffer_is_spillable(GstBuffer *buffer) {
+    for (guint i = 0; i < gst_buffer_n_memory(buffer); i++) {
+        if (!gst_memory_is_type(gst_buffer_peek_memory(buffer, i), GST_ALLOCATOR_SYSMEM)) {
+            return FALSE;
+        }
+    }
+    return gst_buffer_n_memory(buffer) > 0;
+}
+
+static GstClockTime queued_time(GstSpillQueue *self, GstBuffer *incoming) {
+    GstClockTime first = GST_CLOCK_TIME_NONE;
+    for (GList *l = self->items.head; l; l = l->next) {
+        SpillItem *item = l->data;
+        if (GST_IS_BUFFER(item->object) && GST_BUFFER_PTS_IS_VALID(GST_BUFFER_CAST(item->object))) {
+            first = GST_BUFFER_PTS(GST_BUFFER_CAST(item->object));
+            break;
+        }
+    }
+    if (!GST_CLOCK_TIME_IS_VALID(first) || !GST_BUFFER_PTS_IS_VALID(incoming) || GST_BUFFER_PTS(incoming) < first) {
+        return 0;
+    }
+    return GST_BUFFER_PTS(incoming) - first;
+}
+
+static void free_item(GstSpillQueue *self, SpillItem *item) {
+    if (GST_IS_BUFFER(item->object)) {
+        self->buffers--;
+        if (item->spilled) {
+            spill_release(self, item);
+        } else {
+            self->memory -= item->size;
+        }
+    }
+    gst_mini_object_unref(item->object);
+    g_free(item);
+}
+
+// 辅助函数：丢弃最旧的 buffer，保留事件 (调用者持有锁)
+static gboolean drop_oldest(GstSpillQueue *self) {
+    for (GList *l = self->items.head; l; l = l->next) {
+        SpillItem *item = l->data;
+        if (!GST_IS_BUFFER(item->object)) continue;
+
+        // 最旧的 buffer 如果已溢出，它一定位于 spill_head，暂存空间仍按顺序释放
+        g_queue_delete_link(&self->items, l);
+        free_item(self, item);
+        self->dropped++;
+        g_signal_emit(self, spill_queue_signals[SIGNAL_OVERRUN], 0);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static void flush_items(GstSpillQueue *self) {
+    SpillItem *item;
+    while ((item = g_queue_pop_head(&self->items)) != NULL) {
+        free_item(self, item);
+    }
+}
+
+static GstFlowReturn gst_spill_queue_chain(GstPad *pad, GstObject *parent, GstBuffer *buffer) {
+    GstSpillQueue *self = GST_SPILL_QUEUE(parent);
+    gsize size = gst_buffer_get_size(buffer);
+    gboolean spillable = buffer_is_spillable(buffer);
+
+    g_mutex_lock(&self->lock);
+    for (;;) {
+        if (self->flushing || self->srcresult != GST_FLOW_OK) {
+            GstFlowReturn ret = self->flushing ? GST_FLOW_FLUSHING : self->srcresult;
+            g_mutex_unlock(&self->lock);
+            gst_buffer_unref(buffer);
+            return ret;
+        }
+
+        gboolean full = (self->max_size_time > 0 && queued_time(self, buffer) >= self->max_size_time) ||
+                        (self->max_size_buffers > 0 && self->buffers >= self->max_size_buffers);
+        if (!full) {
+            SpillItem *item = g_new0(SpillItem, 1);
+            item->size = size;
+
+            if (self->memory + size <= self->max_memory) {
+                // 内存上限以内：直接保存
+                item->object = GST_MINI_OBJECT_CAST(buffer);
+            } else if (spillable && spill_alloc(self, size, &item->offset)) {
+                // 超过内存上限：数据写入暂存文件，只保留时间戳、标志和 meta
+                GstBuffer *shell = gst_buffer_new();
+                gst_buffer_copy_into(shell, buffer, GST_BUFFER_COPY_METADATA, 0, -1);
+                gst_buffer_extract(buffer, 0, self->spill_map + item->offset, size);
+                gst_buffer_unref(buffer);
+                item->object = GST_MINI_OBJECT_CAST(shell);
+                item->spilled = TRUE;
+                self->spilled_bytes += size;
+                self->spilled_buffers++;
+            } else if (self->buffers == 0) {
+                // 单个 buffer 超过全部上限时仍然放行，避免永久阻塞
+                item->object = GST_MINI_OBJECT_CAST(buffer);
+            } else {
+                g_free(item);
+                item = NULL;
+            }
+
+            if (item) {
+                if (!item->spilled) {
+                    self->memory += size;
+                    self->peak_memory = MAX(self->peak_memory, self->memory);
+                }
+                self->buffers++;
+                g_queue_push_tail(&self->items, item);
+                g_cond_signal(&self->item_add);
+                g_mutex_unlock(&self->lock);
+                return GST_FLOW_OK;
+            }
+        }
+
+        // 队列已满 (时间/数量上限，或内存和暂存文件都已用完)
+        if (self->leaky == 2 && drop_oldest(self)) {
+            continue;
+        }
+        g_cond_wait(&self->item_del, &self->lock);
+    }
+}
+
+// 辅助函数：把队列项转换为可以向下游发送的对象 (调用者持有锁)
+static GstMiniObject *take_item(GstSpillQueue *self, SpillItem *item) {
+    GstMiniObject *object = gst_mini_object_ref(item->object);
+    GstMemory *memory = NULL;
+
+    if (item->spilled) {
+        // 从暂存文件读回数据，释放暂存空间之前完成复制
+        memory = gst_allocator_alloc(NULL, item->size, NULL);
+        GstMapInfo map;
+        if (gst_memory_map(memory, &map, GST_MAP_WRITE)) {
+            memcpy(map.data, self->spill_map + item->offset, item->size);
+            gst_memory_unmap(memory, &map);
+        }
+    }
+    free_item(self, item);
+
+    if (memory) {
+        // 队列项的引用已释放，拼接到保存的元数据上时不会复制
+        GstBuffer *buffer = gst_buffer_make_writable(GST_BUFFER_CAST(object));
+        gst_buffer_append_memory(buffer, memory);
+        object = GST_MINI_OBJECT_CAST(buffer);
+    }
+    return object;
+}
+
+static void gst_spill_queue_loop(gpointer user_data) {
+    GstSpillQueue *self = GST_SPILL_QUEUE(user_data);
+
+    g_mutex_lock(&self->lock);
+    while (g_queue_is_empty(&self->items) && !self->flushing) {
+        g_cond_wait(&self->item_add, &self->lock);
+    }
+    if (self->flushing) {
+        g_mutex_unlock(&self->lock);
+        gst_pad_pause_task(self->srcpad);
+        return;
+    }
+
+    GstMiniObject *object = take_item(self, g_queue_pop_head(&self->items));
+    g_cond_signal(&self->item_del);
+    g_mutex_unlock(&self->lock);
+
+    if (GST_IS_BUFFER(object)) {
+        GstFlowReturn ret = gst_pad_push(self->srcpad, GST_BUFFER_CAST(object));
+        if (ret != GST_FLOW_OK) {
+            g_mutex_lock(&self->lock);
+            self->srcresult = ret;
+            g_cond_signal(&self->item_del);
+            g_mutex_unlock(&self->lock);
+            if (ret == GST_FLOW_NOT_NEGOTIATED || ret < GST_FLOW_EOS) {
+                GST_ELEMENT_FLOW_ERROR(self, ret);
+                gst_pad_push_event(self->srcpad, gst_event_new_eos());
+            }
+            gst_pad_pause_task(self->srcpad);
+        }
+    } else {
+        GstEvent *event = GST_EVENT_CAST(object);
+        gboolean is_eos = GST_EVENT_TYPE(event) == GST_EVENT_EOS;
+        gst_pad_push_event(self->srcpad, event);
+        if (is_eos) {
+            g_mutex_lock(&self->lock);
+            self->srcresult = GST_FLOW_EOS;
+            g_mutex_unlock(&self->lock);
+            gst_pad_pause_task(self->srcpad);
+        }
+    }
+}
+
+static gboolean gst_spill_queue_sink_event(GstPad *pad, GstObject *parent, GstEvent *event) {
+    GstSpillQueue *self = GST_SPILL_QUEUE(parent);
+
+    switch (GST_EVENT_TYPE(event)) {
+        case GST_EVENT_FLUSH_START:
+            gst_pad_push_event(self->srcpad, event);
+            g_mutex_lock(&self->lock);
+            self->flushing = TRUE;
+            self->srcresult = GST_FLOW_FLUSHING;
+            g_cond_signal(&self->item_add);
+            g_cond_signal(&self->item_del);
+            g_mutex_unlock(&self->lock);
+            gst_pad_pause_task(self->srcpad);
+            return TRUE;
+        case GST_EVENT_FLUSH_STOP:
+            gst_pad_push_event(self->srcpad, event);
+            g_mutex_lock(&self->lock);
+            flush_items(self);
+            self->flushing = FALSE;
+            self->srcresult = GST_FLOW_OK;
+            g_mutex_unlock(&self->lock);
+            return gst_pad_start_task(self->srcpad, gst_spill_queue_loop, self, NULL);
+        default:
+            break;
+    }
+
+    if (!GST_EVENT_IS_SERIALIZED(event)) {
+        return gst_pad_push_event(self->srcpad, event);
+    }
+
+    // 串行事件 (caps、segment、EOS 等) 与 buffer 保持相对顺序
+    g_mutex_lock(&self->lock);
+    if (self->flushing) {
+        g_mutex_unlock(&self->lock);
+        gst_event_unref(event);
+        return FALSE;
+    }
+    SpillItem *item = g_new0(SpillItem, 1);
+    item->object = GST_MINI_OBJECT_CAST(event);
+    g_queue_push_tail(&self->items, item);
+    g_cond_signal(&self->item_add);
+    g_mutex_unlock(&self->lock);
+    return TRUE;
+}
+
+static gboolean gst_spill_queue_src_activate_mode(GstPad *pad, GstObject *parent, GstPadMode mode, gboolean active) {
+    GstSpillQueue *self = GST_SPILL_QUEUE(parent);
+    if (mode != GST_PAD_MODE_PUSH) return FALSE;
+
+    g_mutex_lock(&self->lock);
+    self->flushing = !active;
+    self->srcresult = active ? GST_FLOW_OK : GST_FLOW_FLUSHING;
+    g_cond_signal(&self->item_add);
+    g_cond_signal(&self->item_del);
+    g_mutex_unlock(&self->lock);
+
+    if (active) {
+        return gst_pad_start_task(pad, gst_spill_queue_loop, self, NULL);
+    }
+    gboolean ret = gst_pad_stop_task(pad);
+    g_mutex_lock(&self->lock);
+    flush_items(self);
+    g_mutex_unlock(&self->lock);
+    return ret;
+}
+
+// 辅助函数：创建并映射暂存文件，创建后立即删除，进程退出时自动回收
+static gboolean open_spill_file(GstSpillQueue *self) {
+    if (self->max_spill == 0) return TRUE;
+
+    const char *directory = self->spill_directory ? self->spill_directory : g_get_tmp_dir();
+    g_autofree gchar *template = g_build_filename(directory, "spillqueue-XXXXXX", NULL);
+    self->spill_fd = g_mkstemp_full(template, O_RDWR | O_CLOEXEC, 0600);
+    if (self->spill_fd < 0) {
+        GST_ELEMENT_WARNING(self, RESOURCE, OPEN_WRITE, ("Could not create spill file in %s.", directory),
+                            ("%s", g_strerror(errno)));
+        return TRUE;
+    }
+    g_unlink(template);
+
+    if (ftruncate(self->spill_fd, (off_t)self->max_spill) != 0 ||
+        (self->spill_map = mmap(NULL, self->max_spill, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                self->spill_fd, 0)) == MAP_FAILED) {
+        GST_ELEMENT_WARNING(self, RESOURCE, OPEN_WRITE, ("Could not map spill file."), ("%s", g_strerror(errno)));
+        self->spill_map = NULL;
+        close(self->spill_fd);
+        self->spill_fd = -1;
+    }
+    return TRUE;
+}
+
+static void close_spill_file(GstSpillQueue *self) {
+    if (self->spill_map) {
+        munmap(self->spill_map, self->max_spill);
+        self->spill_map = NULL;
+    }
+    if (self->spill_fd >= 0) {
+        close(self->spill_fd);
+        self->spill_fd = -1;
+    }
+    self->spill_head = self->spill_tail = self->spill_used = 0;
+    self->spill_count = 0;
+    self->spill_wrapped = FALSE;
+}
+
+static GstStateChangeReturn gst_spill_queue_change_state(GstElement *element, GstStateChange transition) {
+    GstSpillQueue *self = GST_SPILL_QUEUE(element);
+
+    if (transition == GST_STATE_CHANGE_READY_TO_PAUSED) {
+        self->peak_memory = self->peak_spill = self->spilled_bytes = self->spilled_buffers = self->dropped = 0;
+        open_spill_file(self);
+    }
+
+    GstStateChangeReturn ret = GST_ELEMENT_CLASS(gst_spill_queue_parent_class)->change_state(element, transition);
+
+    if (transition == GST_STATE_CHANGE_PAUSED_TO_READY) {
+        g_print("%s: peak memory %.1f MB, spilled %" G_GUINT64_FORMAT " buffers (%.1f MB, peak %.1f MB), dropped %"
+                G_GUINT64_FORMAT ".\n", GST_OBJECT_NAME(self), self->peak_memory / 1e6, self->spilled_buffers,
+                self->spilled_bytes / 1e6, self->peak_spill / 1e6, self->dropped);
+        close_spill_file(self);
+    }
+    return ret;
+}
+
+static void gst_spill_queue_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec) {
+    GstSpillQueue *self = GST_SPILL_QUEUE(object);
+
+    g_mutex_lock(&self->lock);
+    switch (prop_id) {
+        case PROP_MAX_SIZE_TIME:
+            self->max_size_time = g_value_get_uint64(value);
+            break;
+        case PROP_MAX_SIZE_BUFFERS:
+            self->max_size_buffers = g_value_get_uint(value);
+            break;
+        case PROP_MAX_MEMORY:
+            self->max_memory = g_value_get_uint64(value);
+            break;
+        case PROP_MAX_SPILL:
+            // 暂存文件在 READY->PAUSED 时按该大小创建
+            if (!self->spill_map) self->max_spill = g_value_get_uint64(value);
+            break;
+        case PROP_SPILL_DIRECTORY:
+            g_free(self->spill_directory);
+            self->spill_directory = g_value_dup_string(value);
+            break;
+        case PROP_LEAKY:
+            self->leaky = g_value_get_int(value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+    // 上限变化后可能可以继续入队
+    g_cond_signal(&self->item_del);
+    g_mutex_unlock(&self->lock);
+}
+
+static void gst_spill_queue_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec) {
+    GstSpillQueue *self = GST_SPILL_QUEUE(object);
+
+    g_mutex_lock(&self->lock);
+    switch (prop_id) {
+        case PROP_MAX_SIZE_TIME:
+            g_value_set_uint64(value, self->max_size_time);
+            break;
+        case PROP_MAX_SIZE_BUFFERS:
+            g_value_set_uint(value, self->max_size_buffers);
+            break;
+        case PROP_MAX_MEMORY:
+            g_value_set_uint64(value, self->max_memory);
+            break;
+        case PROP_MAX_SPILL:
+            g_value_set_uint64(value, self->max_spill);
+            break;
+        case PROP_SPILL_DIRECTORY:
+            g_value_set_string(value, self->spill_directory);
+            break;
+        case PROP_LEAKY:
+            g_value_set_int(value, self->leaky);
+            break;
+        case PROP_CURRENT_MEMORY:
+            g_value_set_uint64(value, self->memory);
+            break;
+        case PROP_CURRENT_SPILL:
+            g_value_set_uint64(value, self->spill_used);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+    g_mutex_unlock(&self->lock);
+}
+
+static void gst_spill_queue_finalize(GObject *object) {
+    GstSpillQueue *self = GST_SPILL_QUEUE(object);
+
+    flush_items(self);
+    close_spill_file(self);
+    g_free(self->spill_directory);
+    g_mutex_clear(&self->lock);
+    g_cond_clear(&self->item_add);
+    g_cond_clear(&self->item_del);
+    G_OBJECT_CLASS(gst_spill_queue_parent_class)->finalize(object);
+}
+
+static void gst_spill_queue_class_init(GstSpillQueueClass *klass) {
+    GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+    GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+
+    gobject_class->set_property = gst_spill_queue_set_property;
+    gobject_class->get_property = gst_spill_queue_get_property;
+    gobject_class->finalize = gst_spill_queue_finalize;
+
+    g_object_class_install_property(gobject_class, PROP_MAX_SIZE_TIME,
+        g_param_spec_uint64("max-size-time", "Max. size (ns)", "Max. amount of data in the queue (in ns, 0=disable)",
+                            0, G_MAXUINT64, DEFAULT_MAX_SIZE_TIME, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_MAX_SIZE_BUFFERS,
+        g_param_spec_uint("max-size-buffers", "Max. size (buffers)", "Max. number of buffers in the queue (0=disable)",
+                          0, G_MAXUINT, DEFAULT_MAX_SIZE_BUFFERS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_MAX_MEMORY,
+        g_param_spec_uint64("max-memory", "Max. memory", "Bytes of buffers kept in RAM before spilling",
+                            0, G_MAXUINT64, DEFAULT_MAX_MEMORY, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_MAX_SPILL,
+        g_param_spec_uint64("max-spill", "Max. spill", "Size of the memory-mapped scratch file (0=no spilling)",
+                            0, G_MAXUINT64, DEFAULT_MAX_SPILL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_SPILL_DIRECTORY,
+        g_param_spec_string("spill-directory", "Spill directory", "Directory for the scratch file (default: temp dir)",
+                            NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_LEAKY,
+        g_param_spec_int("leaky", "Leaky", "0 = block when full, 2 = drop the oldest buffer",
+                         0, 2, DEFAULT_LEAKY, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_CURRENT_MEMORY,
+        g_param_spec_uint64("current-memory", "Current memory", "Bytes of queued buffers held in RAM",
+                            0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_CURRENT_SPILL,
+        g_param_spec_uint64("current-spill", "Current spill", "Bytes of queued buffers held in the scratch file",
+                            0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+    spill_queue_signals[SIGNAL_OVERRUN] = g_signal_new("overrun", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_FIRST,
+                                                       0, NULL, NULL, NULL, G_TYPE_NONE, 0);
+
+    gst_element_class_set_static_metadata(element_class, "Spill queue", "Generic",
+                                          "Queue with a RAM cap that spills overflow to a memory-mapped file",
+                                          "gst-capture");
+    gst_element_class_add_static_pad_template(element_class, &sink_template);
+    gst_element_class_add_static_pad_template(element_class, &src_template);
+    element_class->change_state = GST_DEBUG_FUNCPTR(gst_spill_queue_change_state);
+}
+
+static void gst_spill_queue_init(GstSpillQueue *self) {
+    self->max_size_time = DEFAULT_MAX_SIZE_TIME;
+    self->max_size_buffers = DEFAULT_MAX_SIZE_BUFFERS;
+    self->max_memory = DEFAULT_MAX_MEMORY;
+    self->max_spill = DEFAULT_MAX_SPILL;
+    self->leaky = DEFAULT_LEAKY;
+    self->spill_fd = -1;
+    self->flushing = TRUE;
+    self->srcresult = GST_FLOW_FLUSHING;
+    g_mutex_init(&self->lock);
+    g_cond_init(&self->item_add);
+    g_cond_init(&self->item_del);
+    g_queue_init(&self->items);
+
+    self->sinkpad = gst_pad_new_from_static_template(&sink_template, "sink");
+    gst_pad_set_chain_function(self->sinkpad, GST_DEBUG_FUNCPTR(gst_spill_queue_chain));
+    gst_pad_set_event_function(self->sinkpad, GST_DEBUG_FUNCPTR(gst_spill_queue_sink_event));
+    GST_PAD_SET_PROXY_CAPS(self->sinkpad);
+    GST_PAD_SET_PROXY_ALLOCATION(self->sinkpad);
+    gst_element_add_pad(GST_ELEMENT(self), self->sinkpad);
+
+    self->srcpad = gst_pad_new_from_static_template(&src_template, "src");
+    gst_pad_set_activatemode_function(self->srcpad, GST_DEBUG_FUNCPTR(gst_spill_queue_src_activate_mode));
+    GST_PAD_SET_PROXY_CAPS(self->srcpad);
+    gst_element_add_pad(GST_ELEMENT(self), self->srcpad);
+}
+
+gboolean spill_queue_register(void) {
+    return gst_element_register(NULL, "spillqueue", GST_RANK_NONE, GST_TYPE_SPILL_QUEUE);
+}
@@ -0,0 +1,27 @@
+#ifndef SPILLQUEUE_H
+#define SPILLQUEUE_H
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/*
+ * spillqueue: recording queue with a hard RAM cap. Buffers are held in memory up to
+ * "max-memory" bytes; beyond that system-memory buffers are copied into a memory-mapped
+ * scratch file of "max-spill" bytes under "spill-directory" and replayed in order once
+ * the encoder catches up. It exposes the queue properties the recording guard relies on
+ * ("leaky", "max-size-time", "max-size-buffers" and the "overrun" signal) so it can
+ * stand in for the video record queue.
+ */
+#define GST_TYPE_SPILL_QUEUE (gst_spill_queue_get_type())
+G_DECLARE_FINAL_TYPE(GstSpillQueue, gst_spill_queue, GST, SPILL_QUEUE, GstElement)
+
+/*
+ * Register "spillqueue" as an application-local element factory.
+ * Returns: TRUE if successful, FALSE otherwise.
+ */
+gboolean spill_queue_register(void);
+
+G_END_DECLS
+
+#endif // SPILLQUEUE_H
@@ -0,0 +1,458 @@
+#define _GNU_SOURCE
+#include "utils.h"
+#include "config.h"
+#include "threads.h"
+#include <gst/gst.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <iniparser.h>
+
+typedef struct {
+    guint64 run_ns;                     /* schedstat：在 CPU 上运行的时间 */
+    guint64 wait_ns;                    /* schedstat：在运行队列中等待的时间 */
+    guint64 voluntary;                  /* 主动切换，即睡眠后被唤醒的次数 */
+    guint64 involuntary;                /* 被抢占的次数 */
+} ThreadStats;
+
+typedef struct {
+    gboolean has_cpus;
+    cpu_set_t cpus;                     /* 允许运行的 CPU */
+    gboolean has_nice;
+    int nice;
+    int priority;                       /* SCHED_FIFO 优先级，0 表示不改调度策略 */
+} SchedPolicy;
+
+typedef struct {
+    gchar *name;                        /* "任务所属元素 -> 下游元素" */
+    guint started;                      /* 累计启动的线程数 */
+    guint live;                         /* 当前运行的线程数 */
+    ThreadStats total;                  /* 所有线程的累计值 (已退出的和运行中已采集的部分) */
+    guint64 reported_run_ns;            /* 上次输出时的 total.run_ns，用于计算占用率 */
+} ThreadSegment;
+
+typedef struct {
+    pid_t tid;
+    ThreadSegment *segment;
+    ThreadStats last;                   /* 上次采集时的读数，差值计入 segment->total */
+    char original_name[16];             /* 改名前的线程名，LEAVE 时恢复 (线程池会复用线程)；未改名时为空 */
+    gboolean placed;                    /* 应用了 [sched_*] 设置，LEAVE 时恢复以下原值 */
+    cpu_set_t original_cpus;
+    int original_policy;
+    struct sched_param original_param;
+    int original_nice;
+} ThreadRecord;
+
+struct _ThreadMonitor {
+    CustomData *data;
+    GstBus *bus;
+    gulong sync_id;
+    gboolean accounting;                /* [threads] enable：线程命名和 CPU 统计 */
+    GHashTable *policies;               /* [sched_<元素名或工厂名>] -> SchedPolicy，初始化后只读 */
+    GMutex lock;                        /* 流线程进入/退出和主线程输出都会访问以下成员 */
+    GHashTable *threads;                /* tid -> ThreadRecord */
+    GPtrArray *segments;                /* 按首次出现顺序 */
+    GHashTable *by_name;
+    gint64 last_report;
+    guint report_id;
+};
+
+// 辅助函数：读取 /proc/self/task/<tid> 下的调度统计
+static gboolean read_stats(pid_t tid, ThreadStats *stats) {
+    g_autofree gchar *path = g_strdup_printf("/proc/self/task/%d/schedstat", (int)tid);
+    g_autofree gchar *contents = NULL;
+    memset(stats, 0, sizeof(*stats));
+    if (!g_file_get_contents(path, &contents, NULL, NULL)) {
+        return FALSE;
+    }
+    sscanf(contents, "%" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT, &stats->run_ns, &stats->wait_ns);
+
+    g_free(path);
+    g_clear_pointer(&contents, g_free);
+    path = g_strdup_printf("/proc/self/task/%d/status", (int)tid);
+    if (!g_file_get_contents(path, &contents, NULL, NULL)) {
+        return FALSE;
+    }
+    const char *line = strstr(contents, "\nvoluntary_ctxt_switches:");
+    if (line) stats->voluntary = g_ascii_strtoull(line + strlen("\nvoluntary_ctxt_switches:"), NULL, 10);
+    line = strstr(contents, "\nnonvoluntary_ctxt_switches:");
+    if (line) stats->involuntary = g_ascii_strtoull(line + strlen("\nnonvoluntary_ctxt_switches:"), NULL, 10);
+    return TRUE;
+}
+
+// 辅助函数：把线程自上次采集以来的增量计入所属分段；线程已退出时返回 FALSE
+static gboolean collect(ThreadRecord *record) {
+    ThreadStats now;
+    if (!read_stats(record->tid, &now)) {
+        return FALSE;
+    }
+    ThreadStats *total = &record->segment->total;
+    total->run_ns += now.run_ns - record->last.run_ns;
+    total->wait_ns += now.wait_ns - record->last.wait_ns;
+    total->voluntary += now.voluntary - record->last.voluntary;
+    total->involuntary += now.involuntary - record->last.involuntary;
+    record->last = now;
+    return TRUE;
+}
+
+static void record_free(gpointer user_data) {
+    ThreadRecord *record = (ThreadRecord *)user_data;
+    if (record->segment) {
+        record->segment->live--;
+    }
+    g_free(record);
+}
+
+static ThreadSegment *lookup_segment(ThreadMonitor *tm, const gchar *name) {
+    ThreadSegment *segment = g_hash_table_lookup(tm->by_name, name);
+    if (!segment) {
+        segment = g_new0(ThreadSegment, 1);
+        segment->name = g_strdup(name);
+        g_ptr_array_add(tm->segments, segment);
+        g_hash_table_insert(tm->by_name, segment->name, segment);
+    }
+    return segment;
+}
+
+// 辅助函数：越过 bin 边界的 ghost pad，找到 pad 实际推送到的元素
+static GstElement *downstream_element(GstPad *pad) {
+    GstPad *peer = gst_pad_get_peer(pad);
+    for (int i = 0; peer && i < 8; i++) {
+        if (GST_IS_GHOST_PAD(peer)) {
+            // 进入 bin：ghost sink pad 的目标是 bin 内的元素
+            GstPad *target = gst_ghost_pad_get_target(GST_GHOST_PAD(peer));
+            gst_object_unref(peer);
+            peer = target;
+        } else if (GST_IS_PROXY_PAD(peer)) {
+            // 离开 bin：ghost src pad 的内部 pad，继续找 ghost pad 的对端
+            GstProxyPad *ghost = gst_proxy_pad_get_internal(GST_PROXY_PAD(peer));
+            gst_object_unref(peer);
+            peer = ghost ? gst_pad_get_peer(GST_PAD(ghost)) : NULL;
+            if (ghost) gst_object_unref(ghost);
+        } else {
+            break;
+        }
+    }
+    if (!peer) return NULL;
+    GstElement *element = gst_pad_get_parent_element(peer);
+    gst_object_unref(peer);
+    return element;
+}
+
+// 辅助函数：解析 "0-3,6" 形式的 CPU 列表
+static gboolean parse_cpu_list(const char *list, cpu_set_t *cpus) {
+    CPU_ZERO(cpus);
+    g_auto(GStrv) parts = g_strsplit(list, ",", -1);
+    for (int i = 0; parts[i]; i++) {
+        gchar *part = g_strstrip(parts[i]);
+        if (*part == '\0') continue;
+        gchar *end = NULL;
+        guint64 first = g_ascii_strtoull(part, &end, 10);
+        guint64 last = first;
+        if (end == part) return FALSE;
+        if (*end == '-') {
+            gchar *start = end + 1;
+            last = g_ascii_strtoull(start, &end, 10);
+            if (end == start) return FALSE;
+        }
+        if (*end != '\0' || last < first || last >= CPU_SETSIZE) return FALSE;
+        for (guint64 cpu = first; cpu <= last; cpu++) {
+            CPU_SET(cpu, cpus);
+        }
+    }
+    return CPU_COUNT(cpus) > 0;
+}
+
+static gchar *format_cpu_list(const cpu_set_t *cpus) {
+    GString *out = g_string_new(NULL);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, cpus)) continue;
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, cpus)) last++;
+        g_string_append_printf(out, out->len ? ",%d" : "%d", cpu);
+        if (last > cpu) g_string_append_printf(out, "-%d", last);
+        cpu = last;
+    }
+    return g_string_free(out, FALSE);
+}
+
+// 辅助函数：读取所有 [sched_*] 段，段名是任务所属元素的名字 (例如 queue-2) 或工厂名 (例如 alsasrc)
+static void load_policies(ThreadMonitor *tm, dictionary *dict) {
+    for (int i = 0; i < iniparser_getnsec(dict); i++) {
+        const char *section = iniparser_getsecname(dict, i);
+        if (!g_str_has_prefix(section, "sched_") || section[strlen("sched_")] == '\0') continue;
+
+        SchedPolicy *policy = g_new0(SchedPolicy, 1);
+        g_autofree gchar *cpus_key = g_strdup_printf("%s:cpus", section);
+        g_autofree gchar *nice_key = g_strdup_printf("%s:nice", section);
+        g_autofree gchar *priority_key = g_strdup_printf("%s:priority", section);
+        const char *cpus = iniparser_getstring(dict, cpus_key, NULL);
+        if (cpus && *cpus) {
+            policy->has_cpus = parse_cpu_list(cpus, &policy->cpus);
+            if (!policy->has_cpus) {
+                g_printerr("Warning: Invalid CPU list '%s' in [%s], ignored.\n", cpus, section);
+            }
+        }
+        policy->has_nice = iniparser_find_entry(dict, nice_key);
+        policy->nice = CLAMP(iniparser_getint(dict, nice_key, 0), -20, 19);
+        policy->priority = iniparser_getint(dict, priority_key, 0);
+        if (policy->priority != 0) {
+            policy->priority = CLAMP(policy->priority, sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO));
+        }
+        g_hash_table_insert(tm->policies, g_strdup(section + strlen("sched_")), policy);
+    }
+}
+
+// 在流线程上应用 [sched_*] 设置，先把原来的设置保存到 record，并输出实际生效的位置和策略
+// 返回 TRUE 表示该线程有对应的设置
+static gboolean apply_policy(ThreadMonitor *tm, GstElement *owner, ThreadRecord *record) {
+    // iniparser 的段名是小写的
+    g_autofree gchar *name = g_ascii_strdown(GST_OBJECT_NAME(owner), -1);
+    GstElementFactory *factory = gst_element_get_factory(owner);
+    SchedPolicy *policy = g_hash_table_lookup(tm->policies, name);
+    if (!policy && factory) {
+        policy = g_hash_table_lookup(tm->policies, GST_OBJECT_NAME(factory));
+    }
+    if (!policy) return FALSE;
+
+    pid_t tid = record->tid;
+    sched_getaffinity(0, sizeof(record->original_cpus), &record->original_cpus);
+    record->original_policy = sched_getscheduler(0);
+    sched_getparam(0, &record->original_param);
+    errno = 0;
+    record->original_nice = getpriority(PRIO_PROCESS, (id_t)tid);
+    if (errno != 0) record->original_nice = 0;
+
+    if (policy->has_cpus && sched_setaffinity(0, sizeof(policy->cpus), &policy->cpus) != 0) {
+        g_printerr("Warning: Could not set the CPU affinity of the %s thread: %s\n", GST_OBJECT_NAME(owner), g_strerror(errno));
+    }
+    if (policy->priority > 0) {
+        struct sched_param param = { .sched_priority = policy->priority };
+        if (sched_setscheduler(0, SCHED_FIFO, &param) != 0) {
+            // 需要 CAP_SYS_NICE 或足够的 RLIMIT_RTPRIO (例如 /etc/security/limits.conf 中的 rtprio)
+            g_printerr("Warning: Could not use SCHED_FIFO %d for the %s thread: %s\n", policy->priority, GST_OBJECT_NAME(owner), g_strerror(errno));
+        }
+    }
+    if (policy->has_nice && setpriority(PRIO_PROCESS, (id_t)tid, policy->nice) != 0) {
+        g_printerr("Warning: Could not set nice %d for the %s thread: %s\n", policy->nice, GST_OBJECT_NAME(owner), g_strerror(errno));
+    }
+
+    cpu_set_t cpus;
+    g_autofree gchar *cpu_list = sched_getaffinity(0, sizeof(cpus), &cpus) == 0 ? format_cpu_list(&cpus) : g_strdup("?");
+    struct sched_param param = { 0 };
+    int sched_policy = sched_getscheduler(0);
+    sched_getparam(0, &param);
+    errno = 0;
+    int nice = getpriority(PRIO_PROCESS, (id_t)tid);
+    if (errno != 0) nice = 0;
+    if (sched_policy == SCHED_FIFO || sched_policy == SCHED_RR) {
+        g_print("Streaming thread %d of %s: cpus %s, %s priority %d.\n", (int)tid, GST_OBJECT_NAME(owner), cpu_list,
+                sched_policy == SCHED_FIFO ? "SCHED_FIFO" : "SCHED_RR", param.sched_priority);
+    } else {
+        g_print("Streaming thread %d of %s: cpus %s, %s, nice %d.\n", (int)tid, GST_OBJECT_NAME(owner), cpu_list,
+                sched_policy == SCHED_IDLE ? "SCHED_IDLE" : sched_policy == SCHED_BATCH ? "SCHED_BATCH" : "SCHED_OTHER", nice);
+    }
+    return TRUE;
+}
+
+// 辅助函数：恢复线程进入任务前的名字和调度设置，线程回到线程池后可能被其他分段或转码任务复用 (在该线程上调用)
+static void restore_thread(ThreadRecord *record) {
+    if (record->original_name[0] != '\0') {
+        prctl(PR_SET_NAME, record->original_name, 0, 0, 0);
+    }
+    if (!record->placed) return;
+
+    sched_setaffinity(0, sizeof(record->original_cpus), &record->original_cpus);
+    if (sched_setscheduler(0, record->original_policy, &record->original_param) != 0) {
+        g_printerr("Warning: Could not restore the scheduling policy of thread %d: %s\n", (int)record->tid, g_strerror(errno));
+    }
+    // 非特权进程不能降低 nice 值 (RLIMIT_NICE)，失败时线程保留较低的优先级
+    if (getpriority(PRIO_PROCESS, (id_t)record->tid) != record->original_nice &&
+        setpriority(PRIO_PROCESS, (id_t)record->tid, record->original_nice) != 0) {
+        g_printerr("Warning: Could not restore nice %d of thread %d: %s\n", record->original_nice, (int)record->tid, g_strerror(errno));
+    }
+}
+
+// 流线程启动：应用调度设置，命名线程并记录调度统计的起点 (在新线程上调用)
+static void thread_enter(ThreadMonitor *tm, GstElement *owner, GstObject *src) {
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+
+    // 线程池复用了没有收到 LEAVE 的线程：先结算旧记录并恢复原状
+    g_mutex_lock(&tm->lock);
+    ThreadRecord *previous = g_hash_table_lookup(tm->threads, GINT_TO_POINTER(tid));
+    if (previous) {
+        if (previous->segment) collect(previous);
+        restore_thread(previous);
+        g_hash_table_remove(tm->threads, GINT_TO_POINTER(tid));
+    }
+    g_mutex_unlock(&tm->lock);
+
+    ThreadRecord *record = g_new0(ThreadRecord, 1);
+    record->tid = tid;
+    record->placed = apply_policy(tm, owner, record);
+    if (!tm->accounting) {
+        if (!record->placed) {
+            g_free(record);
+            return;
+        }
+        g_mutex_lock(&tm->lock);
+        g_hash_table_insert(tm->threads, GINT_TO_POINTER(tid), record);
+        g_mutex_unlock(&tm->lock);
+        return;
+    }
+
+    g_autoptr(GstElement) downstream = GST_IS_PAD(src) ? downstream_element(GST_PAD(src)) : NULL;
+    g_autofree gchar *segment_name = downstream ? g_strdup_printf("%s -> %s", GST_OBJECT_NAME(owner), GST_OBJECT_NAME(downstream))
+                                                : g_strdup(GST_OBJECT_NAME(owner));
+
+    // 源元素的线程就是采集线程，用源的名字；其余按下游元素命名 (内核截断到 15 个字符)
+    const gchar *thread_name = (downstream && !GST_OBJECT_FLAG_IS_SET(owner, GST_ELEMENT_FLAG_SOURCE))
+                               ? GST_OBJECT_NAME(downstream) : GST_OBJECT_NAME(owner);
+    prctl(PR_GET_NAME, record->original_name, 0, 0, 0);
+    prctl(PR_SET_NAME, thread_name, 0, 0, 0);
+    read_stats(tid, &record->last);
+
+    g_mutex_lock(&tm->lock);
+    record->segment = lookup_segment(tm, segment_name);
+    record->segment->started++;
+    record->segment->live++;
+    g_hash_table_insert(tm->threads, GINT_TO_POINTER(tid), record);
+    g_mutex_unlock(&tm->lock);
+
+#ifdef DEBUG
+    g_print("Streaming thread %d (%s) started for %s.\n", (int)tid, thread_name, segment_name);
+#endif
+}
+
+// 流线程退出：结算最后的增量，恢复线程名和调度设置 (在该线程上调用)
+static void thread_leave(ThreadMonitor *tm) {
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+    g_mutex_lock(&tm->lock);
+    ThreadRecord *record = g_hash_table_lookup(tm->threads, GINT_TO_POINTER(tid));
+    if (record) {
+        if (record->segment) collect(record);
+        restore_thread(record);
+        g_hash_table_remove(tm->threads, GINT_TO_POINTER(tid));
+    }
+    g_mutex_unlock(&tm->lock);
+}
+
+// 同步总线消息：在发送消息的流线程上执行
+static void on_sync_stream_status(GstBus *bus, GstMessage *msg, gpointer user_data) {
+    ThreadMonitor *tm = (ThreadMonitor *)user_data;
+    GstStreamStatusType type;
+    GstElement *owner = NULL;
+    gst_message_parse_stream_status(msg, &type, &owner);
+    if (!owner) return;
+
+    if (type == GST_STREAM_STATUS_TYPE_ENTER) {
+        thread_enter(tm, owner, GST_MESSAGE_SRC(msg));
+    } else if (type == GST_STREAM_STATUS_TYPE_LEAVE) {
+        thread_leave(tm);
+    }
+}
+
+static gboolean report_timeout(gpointer user_data) {
+    thread_monitor_report((CustomData *)user_data);
+    return G_SOURCE_CONTINUE;
+}
+
+void thread_monitor_init(CustomData *data) {
+    dictionary *dict = data->config_dict;
+    if (!data->pipeline) {
+        return;
+    }
+
+    ThreadMonitor *tm = g_new0(ThreadMonitor, 1);
+    tm->accounting = iniparser_getboolean(dict, "threads:enable", 0);
+    tm->policies = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    load_policies(tm, dict);
+    if (!tm->accounting && g_hash_table_size(tm->policies) == 0) {
+        g_hash_table_unref(tm->policies);
+        g_free(tm);
+        return;
+    }
+    tm->data = data;
+    tm->bus = gst_element_get_bus(data->pipeline);
+    g_mutex_init(&tm->lock);
+    tm->threads = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, record_free);
+    tm->segments = g_ptr_array_new();
+    tm->by_name = g_hash_table_new(g_str_hash, g_str_equal);
+    tm->last_report = g_get_monotonic_time();
+
+    gst_bus_enable_sync_message_emission(tm->bus);
+    tm->sync_id = g_signal_connect(tm->bus, "sync-message::stream-status", G_CALLBACK(on_sync_stream_status), tm);
+    int interval = iniparser_getint(dict, "threads:report", 0);
+    if (tm->accounting && interval > 0) {
+        tm->report_id = g_timeout_add_seconds(interval, report_timeout, data);
+    }
+    data->thread_monitor = tm;
+    if (tm->accounting) {
+        g_print("Streaming thread accounting enabled. Send SIGUSR2 to print the per-segment CPU usage.\n");
+    }
+    if (g_hash_table_size(tm->policies) > 0) {
+        g_print("Scheduling settings loaded for %u segment(s).\n", g_hash_table_size(tm->policies));
+    }
+}
+
+void thread_monitor_report(CustomData *data) {
+    ThreadMonitor *tm = data->thread_monitor;
+    if (!tm || !tm->accounting) return;
+
+    gint64 now = g_get_monotonic_time();
+    gdouble elapsed_ns = (now - tm->last_report) * 1000.0;
+    tm->last_report = now;
+
+    g_mutex_lock(&tm->lock);
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, tm->threads);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        // 读不到说明线程已经退出而没有 LEAVE，丢弃上次采集之后的部分
+        if (!collect((ThreadRecord *)value)) {
+            g_hash_table_iter_remove(&iter);
+        }
+    }
+
+    g_print("Streaming threads by segment                         threads   cpu(s)   cpu%%  runq(ms)  wakeups  preempt\n");
+    for (guint i = 0; i < tm->segments->len; i++) {
+        ThreadSegment *segment = g_ptr_array_index(tm->segments, i);
+        gdouble usage = elapsed_ns > 0 ? (segment->total.run_ns - segment->reported_run_ns) * 100.0 / elapsed_ns : 0.0;
+        segment->reported_run_ns = segment->total.run_ns;
+        g_autofree gchar *threads = g_strdup_printf("%u/%u", segment->live, segment->started);
+        g_print("  %-50s %9s %8.2f %6.1f %9.1f %8" G_GUINT64_FORMAT " %8" G_GUINT64_FORMAT "\n",
+                segment->name, threads, segment->total.run_ns / 1e9, usage, segment->total.wait_ns / 1e6,
+                segment->total.voluntary, segment->total.involuntary);
+    }
+    g_mutex_unlock(&tm->lock);
+}
+
+void thread_monitor_free(CustomData *data) {
+    ThreadMonitor *tm = data->thread_monitor;
+    if (!tm) return;
+
+    thread_monitor_report(data);
+    data->thread_monitor = NULL;
+    if (tm->report_id > 0) {
+        g_source_remove(tm->report_id);
+    }
+    g_signal_handler_disconnect(tm->bus, tm->sync_id);
+    gst_bus_disable_sync_message_emission(tm->bus);
+    gst_object_unref(tm->bus);
+    g_hash_table_unref(tm->threads);
+    for (guint i = 0; i < tm->segments->len; i++) {
+        ThreadSegment *segment = g_ptr_array_index(tm->segments, i);
+        g_free(segment->name);
+        g_free(segment);
+    }
+    g_ptr_array_unref(tm->segments);
+    g_hash_table_unref(tm->by_name);
+    g_hash_table_unref(tm->policies);
+    g_mutex_clear(&tm->lock);
+    g_free(tm);
+}
@@ -0,0 +1,37 @@
+#ifndef THREADS_H
+#define THREADS_H
+
+#include "config.h"
+
+/*
+ * Watch streaming threads of the pipeline, including those of each recording
+ * bin, through synchronous STREAM_STATUS messages. When [threads] enable is set,
+ * every thread is renamed after the element it pushes into (sources keep their
+ * own name), so top -H and perf can tell the branches apart; threads created by
+ * an element from its streaming thread (e.g. encoder workers) inherit the name.
+ * CPU time and run-queue wait (/proc schedstat), wakeups (voluntary context
+ * switches) and preemptions are accounted per segment, i.e. per task owner and
+ * its downstream element.
+ * Independently of [threads] enable, a [sched_<name>] section applies CPU
+ * affinity (cpus), a nice value and/or a SCHED_FIFO priority to the thread of
+ * the segment that starts at the element called <name> (or any element of
+ * factory <name>), e.g. [sched_queue-2] or [sched_alsasrc]. Settings are applied
+ * on the streaming thread as it starts and the effective placement is logged.
+ * When the thread leaves its task, its original name, affinity, policy and nice
+ * value are restored, because task pool threads are reused by other segments.
+ * Call after initialize_gstreamer_pipeline() and before the pipeline goes to
+ * PLAYING.
+ */
+void thread_monitor_init(CustomData *data);
+
+/*
+ * Print the totals of every segment and its CPU usage since the previous report.
+ */
+void thread_monitor_report(CustomData *data);
+
+/*
+ * Print a final report and release the monitor. Call after the pipeline is stopped.
+ */
+void thread_monitor_free(CustomData *data);
+
+#endif // THREADS_H
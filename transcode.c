@@ -0,0 +1,568 @@
+#define _GNU_SOURCE
+#include "utils.h"
+#include "config.h"
+#include "transcode.h"
+#include "archive.h"
+#include "control.h"
+#include "rawdump.h"
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <iniparser.h>
+
+/* 原始数据模式下与视频 dump 成对的音频 dump */
+#define RAW_AUDIO_SUFFIX "-audio" RAW_DUMP_EXTENSION
+#define RAW_VIDEO_SUFFIX "-video" RAW_DUMP_EXTENSION
+
+typedef struct {
+    Transcoder *tc;
+    gchar *source;
+    gchar *audio_source;                /* 原始数据模式的音频 dump，其他情况为 NULL */
+    gchar *output;
+    gchar *part;
+    GstElement *pipeline;
+    guint bus_watch_id;
+    guint64 source_bytes;
+    gint64 active_us;                   /* 不计暂停时间的运行时长 */
+    gint64 resumed_at;
+} TranscodeJob;
+
+struct _Transcoder {
+    CustomData *data;
+    gchar *video_desc;
+    gchar *audio_desc;
+    gchar *muxer;
+    gchar *extension;
+    gchar *suffix;
+    gboolean keep_source;
+    guint max_workers;
+    gdouble min_idle;                   /* 启动新任务所需的空闲核数 */
+    int report_interval;
+    gchar *journal_path;
+
+    GQueue pending;                     /* 尚未开始的源文件 */
+    GList *running;                     /* TranscodeJob */
+    gboolean paused;
+    guint timeout_id;
+    gint64 last_report;
+
+    guint64 cpu_idle;                   /* 上一次 /proc/stat 采样 */
+    guint64 cpu_total;
+    gdouble idle_cores;
+    GstTaskPool *task_pool;             /* 转码任务专用的流线程 */
+};
+
+/*
+ * 转码任务的线程池：每个 GstTask 一个新线程，结束后退出而不是回到线程池。
+ * 默认的 GstTaskPool 使用非独占的 GThreadPool，空闲线程在进程内共享，
+ * 降到 SCHED_IDLE 的线程会被采集/录制管道复用；非特权进程也无法从 SCHED_IDLE 恢复。
+ */
+typedef struct {
+    GstTaskPool parent;
+} JobTaskPool;
+
+typedef struct {
+    GstTaskPoolClass parent_class;
+} JobTaskPoolClass;
+
+typedef struct {
+    GstTaskPoolFunction func;
+    gpointer user_data;
+} JobThreadStart;
+
+G_DEFINE_TYPE(JobTaskPool, job_task_pool, GST_TYPE_TASK_POOL)
+
+static gpointer job_thread_func(gpointer user_data) {
+    JobThreadStart start = *(JobThreadStart *)user_data;
+    g_free(user_data);
+    start.func(start.user_data);
+    return NULL;
+}
+
+// 不创建 GThreadPool
+static void job_task_pool_prepare(GstTaskPool *pool, GError **error) {
+}
+
+static void job_task_pool_cleanup(GstTaskPool *pool) {
+}
+
+static gpointer job_task_pool_push(GstTaskPool *pool, GstTaskPoolFunction func, gpointer user_data, GError **error) {
+    JobThreadStart *start = g_new(JobThreadStart, 1);
+    start->func = func;
+    start->user_data = user_data;
+    GThread *thread = g_thread_try_new("transcode", job_thread_func, start, error);
+    if (!thread) {
+        g_free(start);
+    }
+    return thread;
+}
+
+static void job_task_pool_join(GstTaskPool *pool, gpointer id) {
+    if (id) g_thread_join((GThread *)id);
+}
+
+#if GST_CHECK_VERSION(1, 20, 0)
+static void job_task_pool_dispose_handle(GstTaskPool *pool, gpointer id) {
+    if (id) g_thread_unref((GThread *)id);
+}
+#endif
+
+static void job_task_pool_class_init(JobTaskPoolClass *klass) {
+    GstTaskPoolClass *pool_class = GST_TASK_POOL_CLASS(klass);
+    pool_class->prepare = job_task_pool_prepare;
+    pool_class->cleanup = job_task_pool_cleanup;
+    pool_class->push = job_task_pool_push;
+    pool_class->join = job_task_pool_join;
+#if GST_CHECK_VERSION(1, 20, 0)
+    pool_class->dispose_handle = job_task_pool_dispose_handle;
+#endif
+}
+
+static void job_task_pool_init(JobTaskPool *pool) {
+}
+
+static void save_journal(Transcoder *tc) {
+    g_autoptr(GString) contents = g_string_new(NULL);
+    for (GList *l = tc->running; l; l = l->next) {
+        g_string_append_printf(contents, "%s\n", ((TranscodeJob *)l->data)->source);
+    }
+    for (GList *l = tc->pending.head; l; l = l->next) {
+        g_string_append_printf(contents, "%s\n", (const char *)l->data);
+    }
+
+    g_autoptr(GError) error = NULL;
+    if (!g_file_set_contents(tc->journal_path, contents->str, contents->len, &error)) {
+        g_printerr("Warning: Could not write transcode journal %s: %s\n", tc->journal_path, error->message);
+    }
+}
+
+static void load_journal(Transcoder *tc) {
+    g_autofree gchar *contents = NULL;
+    if (!g_file_get_contents(tc->journal_path, &contents, NULL, NULL)) {
+        return;
+    }
+
+    g_auto(GStrv) lines = g_strsplit(contents, "\n", -1);
+    for (int i = 0; lines[i] != NULL; i++) {
+        if (lines[i][0] != '\0' && g_file_test(lines[i], G_FILE_TEST_IS_REGULAR)) {
+            g_queue_push_tail(&tc->pending, g_strdup(lines[i]));
+        }
+    }
+    if (tc->pending.length > 0) {
+        g_print("Transcode: resuming %u file(s) from the previous run.\n", tc->pending.length);
+    }
+}
+
+// 辅助函数：根据 /proc/stat 两次采样之间的空闲时间估算空闲核数
+static void sample_idle_cores(Transcoder *tc) {
+    unsigned long long user = 0, nice = 0, system = 0, idle = 0, iowait = 0, irq = 0, softirq = 0, steal = 0;
+    FILE *f = fopen("/proc/stat", "r");
+    if (!f) return;
+    int n = fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu %llu", &user, &nice, &system, &idle, &iowait,
+                   &irq, &softirq, &steal);
+    fclose(f);
+    if (n < 4) return;
+
+    guint64 idle_now = idle + iowait;
+    guint64 total_now = user + nice + system + idle + iowait + irq + softirq + steal;
+    if (tc->cpu_total > 0 && total_now > tc->cpu_total) {
+        gdouble fraction = (gdouble)(idle_now - tc->cpu_idle) / (total_now - tc->cpu_total);
+        tc->idle_cores = fraction * g_get_num_processors();
+    }
+    tc->cpu_idle = idle_now;
+    tc->cpu_total = total_now;
+}
+
+// 同步总线回调：任务使用专用线程池；流线程启动时把自己降到空闲调度，编码器随后创建的线程会继承
+static GstBusSyncReply job_sync_handler(GstBus *bus, GstMessage *msg, gpointer user_data) {
+    if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_STREAM_STATUS) {
+        GstStreamStatusType type;
+        gst_message_parse_stream_status(msg, &type, NULL);
+        if (type == GST_STREAM_STATUS_TYPE_CREATE) {
+            const GValue *object = gst_message_get_stream_status_object(msg);
+            if (object && G_VALUE_HOLDS_OBJECT(object) && GST_IS_TASK(g_value_get_object(object))) {
+                gst_task_set_pool(GST_TASK(g_value_get_object(object)), GST_TASK_POOL(user_data));
+            }
+        } else if (type == GST_STREAM_STATUS_TYPE_ENTER) {
+            // 专用线程在任务结束后退出，不需要恢复调度策略
+            struct sched_param param = { 0 };
+            if (sched_setscheduler(0, SCHED_IDLE, &param) != 0) {
+                setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);
+            }
+        }
+    }
+    return GST_BUS_PASS;
+}
+
+// 辅助函数：输出文件名 <去掉扩展名的源文件><suffix><extension>
+static gchar *make_output_path(Transcoder *tc, const char *source) {
+    g_autofree gchar *stem = NULL;
+    if (g_str_has_suffix(source, RAW_VIDEO_SUFFIX)) {
+        stem = g_strndup(source, strlen(source) - strlen(RAW_VIDEO_SUFFIX));
+    } else {
+        const char *dot = strrchr(source, '.');
+        const char *slash = strrchr(source, G_DIR_SEPARATOR);
+        stem = (dot && (!slash || dot > slash)) ? g_strndup(source, dot - source) : g_strdup(source);
+    }
+    return g_strdup_printf("%s%s%s", stem, tc->suffix, tc->extension);
+}
+
+static void set_location(GstElement *pipeline, const char *name, const char *location) {
+    g_autoptr(GstElement) element = gst_bin_get_by_name(GST_BIN(pipeline), name);
+    if (element) {
+        g_object_set(G_OBJECT(element), "location", location, NULL);
+    }
+}
+
+// 辅助函数：构建转码管道，普通文件经过 decodebin，原始 dump 由 rawdumpsrc 读取
+static GstElement *build_job_pipeline(Transcoder *tc, TranscodeJob *job, GError **error) {
+    g_autofree gchar *description = NULL;
+    if (g_str_has_suffix(job->source, RAW_VIDEO_SUFFIX)) {
+        g_autofree gchar *audio = job->audio_source
+            ? g_strdup_printf("rawdumpsrc name=asrc ! queue ! audioconvert ! audioresample ! %s ! mux. ", tc->audio_desc)
+            : g_strdup("");
+        description = g_strdup_printf("rawdumpsrc name=src ! queue ! videoconvert ! %s ! mux. %s"
+                                      "%s name=mux ! filesink name=sink",
+                                      tc->video_desc, audio, tc->muxer);
+    } else {
+        description = g_strdup_printf("filesrc name=src ! decodebin name=dec "
+                                      "dec. ! queue ! videoconvert ! %s ! mux. "
+                                      "dec. ! queue ! audioconvert ! audioresample ! %s ! mux. "
+                                      "%s name=mux ! filesink name=sink",
+                                      tc->video_desc, tc->audio_desc, tc->muxer);
+    }
+
+    GstElement *pipeline = gst_parse_launch(description, error);
+    if (!pipeline) return NULL;
+
+    set_location(pipeline, "src", job->source);
+    set_location(pipeline, "asrc", job->audio_source);
+    set_location(pipeline, "sink", job->part);
+    return pipeline;
+}
+
+static gchar *format_eta(gdouble seconds) {
+    guint64 s = (guint64)MAX(seconds, 0);
+    if (s >= 3600) {
+        return g_strdup_printf("%" G_GUINT64_FORMAT "h %02" G_GUINT64_FORMAT "m", s / 3600, s / 60 % 60);
+    }
+    return g_strdup_printf("%" G_GUINT64_FORMAT "m %02" G_GUINT64_FORMAT "s", s / 60, s % 60);
+}
+
+static gint64 job_active_us(TranscodeJob *job) {
+    return job->active_us + (job->resumed_at > 0 ? g_get_monotonic_time() - job->resumed_at : 0);
+}
+
+// 辅助函数：输出进度、相对实时的速度和剩余时间估计
+static void report_job(TranscodeJob *job) {
+    g_autofree gchar *name = g_path_get_basename(job->source);
+    gint64 position = 0, duration = 0;
+    gdouble elapsed = MAX(job_active_us(job), 1) / (gdouble)G_USEC_PER_SEC;
+
+    if (!gst_element_query_position(job->pipeline, GST_FORMAT_TIME, &position) ||
+        !gst_element_query_duration(job->pipeline, GST_FORMAT_TIME, &duration) || duration <= 0) {
+        g_print("Transcode: %s running for %.0f s.\n", name, elapsed);
+        return;
+    }
+
+    gdouble fraction = CLAMP((gdouble)position / duration, 0.0, 1.0);
+    gdouble speed = position / (gdouble)GST_SECOND / elapsed;
+    g_autofree gchar *eta = format_eta(speed > 0 ? (duration - position) / (gdouble)GST_SECOND / speed : 0);
+    g_print("Transcode: %s %.0f%% at %.2fx realtime (%.1f MB/s), ~%s left%s.\n", name, fraction * 100, speed,
+            job->source_bytes * fraction / 1e6 / elapsed, eta, job->resumed_at > 0 ? "" : ", paused");
+}
+
+static void free_job(TranscodeJob *job) {
+    if (job->bus_watch_id) {
+        g_source_remove(job->bus_watch_id);
+    }
+    if (job->pipeline) {
+        gst_element_set_state(job->pipeline, GST_STATE_NULL);
+        gst_object_unref(job->pipeline);
+    }
+    g_free(job->source);
+    g_free(job->audio_source);
+    g_free(job->output);
+    g_free(job->part);
+    g_free(job);
+}
+
+// 辅助函数：把录制文件连同 marker 命令写下的标记文件一起交给迁移队列
+static void archive_with_markers(CustomData *data, const char *path) {
+    if (!path) return;
+    archive_enqueue(data, path);
+
+    g_autofree gchar *markers = g_strconcat(path, RECORD_MARKERS_SUFFIX, NULL);
+    if (g_file_test(markers, G_FILE_TEST_IS_REGULAR)) {
+        archive_enqueue(data, markers);
+    }
+}
+
+// 辅助函数：转码结果沿用源文件的标记 (时间相对于第一帧，转码后不变)，保留源文件时复制一份
+static void carry_markers(Transcoder *tc, TranscodeJob *job) {
+    g_autofree gchar *from = g_strconcat(job->source, RECORD_MARKERS_SUFFIX, NULL);
+    g_autofree gchar *to = g_strconcat(job->output, RECORD_MARKERS_SUFFIX, NULL);
+    if (!g_file_test(from, G_FILE_TEST_IS_REGULAR)) return;
+
+    if (!tc->keep_source) {
+        if (g_rename(from, to) != 0) {
+            g_printerr("Transcode: could not rename %s: %s\n", from, g_strerror(errno));
+        }
+        return;
+    }
+    g_autofree gchar *contents = NULL;
+    gsize length = 0;
+    g_autoptr(GError) error = NULL;
+    if (!g_file_get_contents(from, &contents, &length, &error) ||
+        !g_file_set_contents(to, contents, length, &error)) {
+        g_printerr("Transcode: could not copy %s: %s\n", from, error->message);
+    }
+}
+
+// 辅助函数：任务结束，成功时改名并把结果交给迁移队列
+static void finish_job(TranscodeJob *job, gboolean success) {
+    Transcoder *tc = job->tc;
+    CustomData *data = tc->data;
+    g_autofree gchar *name = g_path_get_basename(job->source);
+
+    tc->running = g_list_remove(tc->running, job);
+    gst_element_set_state(job->pipeline, GST_STATE_NULL);
+
+    if (success && g_rename(job->part, job->output) == 0) {
+        GStatBuf st;
+        guint64 output_bytes = g_stat(job->output, &st) == 0 ? (guint64)st.st_size : 0;
+        g_print("Transcode: finished %s in %.0f s, %.1f MB -> %.1f MB.\n", name,
+                job_active_us(job) / (gdouble)G_USEC_PER_SEC, job->source_bytes / 1e6, output_bytes / 1e6);
+        carry_markers(tc, job);
+        archive_with_markers(data, job->output);
+        if (tc->keep_source) {
+            archive_with_markers(data, job->source);
+            archive_enqueue(data, job->audio_source);
+        } else {
+            g_unlink(job->source);
+            if (job->audio_source) g_unlink(job->audio_source);
+        }
+    } else {
+        // 失败的源文件保持原样，继续走迁移流程
+        g_printerr("Transcode: %s failed, keeping the original.\n", name);
+        g_unlink(job->part);
+        archive_with_markers(data, job->source);
+        archive_enqueue(data, job->audio_source);
+    }
+
+    free_job(job);
+    save_journal(tc);
+}
+
+static gboolean job_bus_callback(GstBus *bus, GstMessage *msg, gpointer user_data) {
+    TranscodeJob *job = (TranscodeJob *)user_data;
+
+    switch (GST_MESSAGE_TYPE(msg)) {
+        case GST_MESSAGE_EOS:
+            job->bus_watch_id = 0;
+            finish_job(job, TRUE);
+            return G_SOURCE_REMOVE;
+        case GST_MESSAGE_ERROR: {
+            g_autoptr(GError) err = NULL;
+            g_autofree gchar *debug_info = NULL;
+            gst_message_parse_error(msg, &err, &debug_info);
+            g_printerr("Transcode error from %s: %s\n", GST_OBJECT_NAME(msg->src), err->message);
+            job->bus_watch_id = 0;
+            finish_job(job, FALSE);
+            return G_SOURCE_REMOVE;
+        }
+        default:
+            return G_SOURCE_CONTINUE;
+    }
+}
+
+static gboolean start_job(Transcoder *tc, const char *source) {
+    TranscodeJob *job = g_new0(TranscodeJob, 1);
+    job->tc = tc;
+    job->source = g_strdup(source);
+    job->output = make_output_path(tc, source);
+    job->part = g_strconcat(job->output, ".part", NULL);
+    if (g_str_has_suffix(source, RAW_VIDEO_SUFFIX)) {
+        g_autofree gchar *stem = g_strndup(source, strlen(source) - strlen(RAW_VIDEO_SUFFIX));
+        g_autofree gchar *audio = g_strconcat(stem, RAW_AUDIO_SUFFIX, NULL);
+        if (g_file_test(audio, G_FILE_TEST_IS_REGULAR)) {
+            job->audio_source = g_steal_pointer(&audio);
+        }
+    }
+
+    GStatBuf st;
+    job->source_bytes = g_stat(source, &st) == 0 ? (guint64)st.st_size : 0;
+
+    g_autoptr(GError) error = NULL;
+    job->pipeline = build_job_pipeline(tc, job, &error);
+    if (!job->pipeline) {
+        g_printerr("Transcode: could not build pipeline for %s: %s\n", source, error ? error->message : "unknown error");
+        archive_with_markers(tc->data, job->source);
+        archive_enqueue(tc->data, job->audio_source);
+        free_job(job);
+        return FALSE;
+    }
+
+    g_autoptr(GstBus) bus = gst_element_get_bus(job->pipeline);
+    gst_bus_set_sync_handler(bus, job_sync_handler, tc->task_pool, NULL);
+    job->bus_watch_id = gst_bus_add_watch(bus, job_bus_callback, job);
+
+    if (gst_element_set_state(job->pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        g_printerr("Transcode: could not start %s.\n", source);
+        archive_with_markers(tc->data, job->source);
+        archive_enqueue(tc->data, job->audio_source);
+        free_job(job);
+        return FALSE;
+    }
+    job->resumed_at = g_get_monotonic_time();
+    tc->running = g_list_append(tc->running, job);
+
+    g_autofree gchar *name = g_path_get_basename(source);
+    g_print("Transcode: started %s (%.1f idle cores, %u running).\n", name, tc->idle_cores, g_list_length(tc->running));
+    return TRUE;
+}
+
+static void set_jobs_paused(Transcoder *tc, gboolean paused) {
+    if (tc->paused == paused) return;
+    tc->paused = paused;
+
+    gint64 now = g_get_monotonic_time();
+    for (GList *l = tc->running; l; l = l->next) {
+        TranscodeJob *job = l->data;
+        if (paused) {
+            job->active_us += now - job->resumed_at;
+            job->resumed_at = 0;
+        } else {
+            job->resumed_at = now;
+        }
+        gst_element_set_state(job->pipeline, paused ? GST_STATE_PAUSED : GST_STATE_PLAYING);
+    }
+    if (tc->running) {
+        g_print("Transcode: %s %u job(s).\n", paused ? "pausing" : "resuming", g_list_length(tc->running));
+    }
+}
+
+static gboolean transcode_tick(gpointer user_data) {
+    Transcoder *tc = (Transcoder *)user_data;
+    CustomData *data = tc->data;
+
+    sample_idle_cores(tc);
+
+    // --- 1. 录制期间暂停，不与采集和实时编码争抢 CPU ---
+    set_jobs_paused(tc, data->is_recording || data->is_stopping_recording);
+
+    // --- 2. 按空闲核数启动新任务，每次最多一个，下一次采样能看到它的负载 ---
+    if (!tc->paused && tc->pending.length > 0 && g_list_length(tc->running) < tc->max_workers &&
+        tc->idle_cores >= tc->min_idle) {
+        g_autofree gchar *source = g_queue_pop_head(&tc->pending);
+        start_job(tc, source);
+        save_journal(tc);
+    }
+
+    // --- 3. 定期报告进度 ---
+    gint64 now = g_get_monotonic_time();
+    if (tc->report_interval > 0 && tc->running && now - tc->last_report >= tc->report_interval * G_TIME_SPAN_SECOND) {
+        tc->last_report = now;
+        g_list_foreach(tc->running, (GFunc)report_job, NULL);
+        if (tc->pending.length > 0) {
+            g_print("Transcode: %u file(s) queued.\n", tc->pending.length);
+        }
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+void transcode_init(CustomData *data) {
+    dictionary *dict = data->config_dict;
+    if (!iniparser_getboolean(dict, "transcode:enable", 0)) {
+        return;
+    }
+
+    Transcoder *tc = g_new0(Transcoder, 1);
+    tc->data = data;
+    tc->video_desc = g_strdup(iniparser_getstring(dict, "transcode:video", "x265enc speed-preset=slow ! h265parse"));
+    tc->audio_desc = g_strdup(iniparser_getstring(dict, "transcode:audio", "opusenc"));
+    tc->muxer = g_strdup(iniparser_getstring(dict, "transcode:muxer", "matroskamux"));
+    tc->extension = g_strdup(iniparser_getstring(dict, "transcode:extension", ".mkv"));
+    tc->suffix = g_strdup(iniparser_getstring(dict, "transcode:suffix", "-small"));
+    tc->keep_source = iniparser_getboolean(dict, "transcode:keep_source", 0);
+    tc->max_workers = (guint)MAX(iniparser_getint(dict, "transcode:max_workers", MAX(g_get_num_processors() / 4, 1)), 1);
+    tc->min_idle = iniparser_getdouble(dict, "transcode:min_idle_cores", 2.0);
+    tc->report_interval = iniparser_getint(dict, "transcode:report", 30);
+    g_autofree gchar *cache_dir = g_build_filename(g_get_user_cache_dir(), "gst-capture", NULL);
+    g_mkdir_with_parents(cache_dir, 0755);
+    tc->journal_path = g_build_filename(cache_dir, "transcode-journal", NULL);
+    g_queue_init(&tc->pending);
+    tc->task_pool = gst_object_ref_sink(g_object_new(job_task_pool_get_type(), NULL));
+    load_journal(tc);
+
+    data->transcoder = tc;
+    sample_idle_cores(tc);
+    tc->timeout_id = g_timeout_add_seconds(1, transcode_tick, tc);
+    g_print("Transcoding finished recordings to %s%s (up to %u worker(s)).\n", tc->muxer, tc->extension, tc->max_workers);
+}
+
+void transcode_enqueue(CustomData *data, const char *path) {
+    Transcoder *tc = data->transcoder;
+    if (!path) return;
+    if (!tc) {
+        archive_with_markers(data, path);
+        return;
+    }
+
+    // 音频 dump 随对应的视频 dump 一起转码
+    if (g_str_has_suffix(path, RAW_AUDIO_SUFFIX)) {
+        return;
+    }
+    if (g_queue_find_custom(&tc->pending, path, (GCompareFunc)g_strcmp0)) {
+        return;
+    }
+    g_queue_push_tail(&tc->pending, g_strdup(path));
+    save_journal(tc);
+#ifdef DEBUG
+    g_print("Transcode: queued %s.\n", path);
+#endif
+}
+
+void transcode_pause(CustomData *data) {
+    if (data->transcoder) {
+        set_jobs_paused(data->transcoder, TRUE);
+    }
+}
+
+void transcode_free(CustomData *data) {
+    Transcoder *tc = g_steal_pointer(&data->transcoder);
+    if (!tc) return;
+
+    if (tc->timeout_id) {
+        g_source_remove(tc->timeout_id);
+    }
+    // 未完成的任务保留在日志中，下次启动重新转码
+    save_journal(tc);
+    guint unfinished = g_list_length(tc->running) + tc->pending.length;
+    for (GList *l = tc->running; l; l = l->next) {
+        TranscodeJob *job = l->data;
+        gst_element_set_state(job->pipeline, GST_STATE_NULL);
+        g_unlink(job->part);
+        free_job(job);
+    }
+    g_list_free(tc->running);
+    if (unfinished > 0) {
+        g_print("Transcode: %u file(s) left for the next run.\n", unfinished);
+    }
+
+    g_queue_clear_full(&tc->pending, g_free);
+    gst_object_unref(tc->task_pool);
+    g_free(tc->video_desc);
+    g_free(tc->audio_desc);
+    g_free(tc->muxer);
+    g_free(tc->extension);
+    g_free(tc->suffix);
+    g_free(tc->journal_path);
+    g_free(tc);
+}
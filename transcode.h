@@ -0,0 +1,36 @@
+#ifndef TRANSCODE_H
+#define TRANSCODE_H
+
+#include "config.h"
+
+/*
+ * Start the deferred transcode queue when [transcode] enable is set. Jobs left in the
+ * journal by a previous run are started again from the beginning.
+ * data: Pointer to the CustomData structure; call after archive_init().
+ */
+void transcode_init(CustomData *data);
+
+/*
+ * Hand a finalized recording to the transcode queue. Jobs run one pipeline each at
+ * idle CPU priority, start only while enough cores are idle (at most [transcode]
+ * max_workers) and are paused while a recording is active. The result, and the source
+ * when keep_source is set, go on to archive_enqueue(). With transcoding disabled the
+ * file is passed to archive_enqueue() directly. A <path>.markers file written by the
+ * control socket travels with the recording (renamed after the transcoded output).
+ * path: Finished recording file. For a raw dump, the audio dump next to the video
+ *       dump is consumed by the video job.
+ */
+void transcode_enqueue(CustomData *data, const char *path);
+
+/*
+ * Pause running jobs right away, e.g. when a recording is starting. They resume on
+ * their own once the recording has finished.
+ */
+void transcode_pause(CustomData *data);
+
+/*
+ * Stop running jobs. Unfinished jobs stay in the journal.
+ */
+void transcode_free(CustomData *data);
+
+#endif // TRANSCODE_H
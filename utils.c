@@ -186,3 +186,24 @@ void configure_element_from_ini(GstElement *element, dictionary *dict, const cha
     }
 }
 
+
+// 辅助函数：读取字节大小配置，支持 K/M/G 后缀 (1024 进制)
+guint64 get_ini_size(dictionary *dict, const char *key, guint64 default_value) {
+    const char *value_str = iniparser_getstring(dict, key, NULL);
+    if (!value_str || value_str[0] == '\0') return default_value;
+
+    char *endptr = NULL;
+    guint64 value = g_ascii_strtoull(value_str, &endptr, 10);
+    if (endptr == value_str) {
+        g_printerr("Warning: Invalid size '%s' for key '%s'. Using default.\n", value_str, key);
+        return default_value;
+    }
+
+    switch (g_ascii_toupper(*endptr)) {
+        case 'G': value <<= 10; /* fall through */
+        case 'M': value <<= 10; /* fall through */
+        case 'K': value <<= 10; break;
+        default: break;
+    }
+    return value;
+}
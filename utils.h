@@ -20,5 +20,31 @@ void set_element_property(GstElement *element, const char *key_name, const char
  */
 void configure_element_from_ini(GstElement *element, dictionary *dict, const char *section_name);
 
+/*
+ * Helper function: Read a byte size such as "64M" or "2G" from the INI dictionary
+ */
+guint64 get_ini_size(dictionary *dict, const char *key, guint64 default_value);
+
+/*
+ * Lock-free counters shared between streaming threads and the main loop
+ */
+static inline void counter_add(guint64 *counter, guint64 value) {
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static inline void counter_set(guint64 *counter, guint64 value) {
+    __atomic_store_n(counter, value, __ATOMIC_RELAXED);
+}
+
+static inline guint64 counter_get(const guint64 *counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static inline void counter_max(guint64 *counter, guint64 value) {
+    guint64 old = __atomic_load_n(counter, __ATOMIC_RELAXED);
+    while (value > old && !__atomic_compare_exchange_n(counter, &old, value, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
 #endif // UTILS_H
 